@@ -0,0 +1,664 @@
+/* command.c - a small command interpreter for controlling the experiment over the uart
+ *
+ * Characters are received by the uart ISR and collected into a line by cmd_Rx().
+ * When a complete line has been received it is handed over to cmd_Poll(), which runs in the idle loop,
+ * i.e. outside frame time. Changes to the experiment are passed to the frame manager with fm_Request()
+ * and take effect at the next round boundary.
+ *
+ * Type "help" for a list of commands.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <frame-manager.h>
+#include <rm-manager.h>
+#include <uart-buffer.h>
+#include <command.h>
+#include <mmu.h>
+#include <profile.h>
+#include <membench.h>
+#include <osbench.h>
+#include <event-server.h>
+#if TGT_BOARD == TGT_PI3_ARM64
+#include <multicore.h>
+#endif
+
+struct command_s
+{
+	char rxline[CMD_LINELEN];		/* Line being received (ISR) */
+	int rxlen;
+	char line[CMD_LINELEN];			/* Complete line for cmd_Poll() */
+	volatile int ready;
+	dv_u32_t n_lost;				/* Lines that arrived before the previous one was processed */
+};
+
+struct command_s command;
+
+struct cmd_s
+{
+	const char *name;
+	void (*fn)(const char *args);
+	const char *help;
+};
+
+static void cmd_Help(const char *args);
+static void cmd_Show(const char *args);
+static void cmd_Where(const char *args);
+static void cmd_Ops(const char *args);
+static void cmd_Rounds(const char *args);
+static void cmd_Ignore(const char *args);
+static void cmd_Start(const char *args);
+static void cmd_Stop(const char *args);
+static void cmd_Reset(const char *args);
+static void cmd_Dump(const char *args);
+static void cmd_Mode(const char *args);
+static void cmd_Mmu(const char *args);
+static void cmd_Trace(const char *args);
+static void cmd_Flight(const char *args);
+static void cmd_Budget(const char *args);
+static void cmd_Profile(const char *args);
+static void cmd_Admit(const char *args);
+static void cmd_Events(const char *args);
+static void cmd_Idle(const char *args);
+static void cmd_Multicore(const char *args);
+static void cmd_Membench(const char *args);
+static void cmd_Osbench(const char *args);
+
+static const struct cmd_s cmd_table[] =
+{
+	{	"help",		cmd_Help,	"help                       - this list"							},
+	{	"show",		cmd_Show,	"show                       - show the current configuration"		},
+	{	"where",	cmd_Where,	"where none|round|start|end - where to do cache maintenance"		},
+	{	"ops",		cmd_Ops,	"ops [idpbtcw]|-            - cache maintenance operations"			},
+	{	"rounds",	cmd_Rounds,	"rounds n                   - stop after n rounds (0 = never)"		},
+	{	"ignore",	cmd_Ignore,	"ignore n                   - warm-up rounds after start/reset"		},
+	{	"start",	cmd_Start,	"start                      - reset the statistics and start"		},
+	{	"stop",		cmd_Stop,	"stop                       - stop at the end of the round"			},
+	{	"reset",	cmd_Reset,	"reset                      - reset the statistics"					},
+	{	"dump",		cmd_Dump,	"dump                       - print the results (when stopped)"		},
+	{	"mode",		cmd_Mode,	"mode name                  - switch mode at the end of the round"	},
+	{	"trace",	cmd_Trace,	"trace off|on|overrun|dump  - control or print the event trace"		},
+	{	"flight",	cmd_Flight,	"flight arm|off|dump        - jitter anomaly flight recorder\n"
+								"  flight margin us         - trip above p99 + margin"				},
+	{	"budget",	cmd_Budget,	"budget log|kill|skip       - reaction to a job budget overrun\n"
+								"  budget mode frame job us   - set a job's budget (0 = none)"		},
+	{	"admit",	cmd_Admit,	"admit [measured]           - check the frames' demand against their length"	},
+	{	"idle",		cmd_Idle,	"idle spin|wfi|wfe|hybrid   - what the idle loop does between polls"	},
+	{	"events",	cmd_Events,	"events on|off|reset|dump   - synthetic sporadic events, event server results"	},
+	{	"profile",	cmd_Profile,"profile on|off|reset|dump  - function profile (make PROFILE=1)"	},
+	{	"membench",	cmd_Membench,"membench                   - memory latency, bandwidth, TLB, cache ops"	},
+	{	"osbench",	cmd_Osbench,"osbench [n]                - cost of the OS primitives, warm and cold"	},
+	{	"multicore",cmd_Multicore,"multicore [n]              - core-to-core latency and skew (pi3)"	},
+	{	"mmu",		cmd_Mmu,	"mmu                        - show the MMU layout and TLB usage"	},
+	{	0,			0,			0																	}
+};
+
+/* cmd_Word() - copy the next word of the line into w and return a pointer to the rest of the line
+*/
+static const char *cmd_Word(const char *p, char *w, int max)
+{
+	int n = 0;
+
+	while ( *p == ' ' || *p == '\t' )
+		p++;
+
+	while ( *p != '\0' && *p != ' ' && *p != '\t' )
+	{
+		if ( n < (max - 1) )
+			w[n++] = *p;
+		p++;
+	}
+
+	w[n] = '\0';
+	return p;
+}
+
+/* cmd_Equal() - compare two strings
+*/
+static int cmd_Equal(const char *a, const char *b)
+{
+	while ( *a != '\0' && *a == *b )
+	{
+		a++;
+		b++;
+	}
+	return *a == *b;
+}
+
+/* cmd_Number() - convert a decimal number. Returns 0 if the word isn't a number.
+*/
+static int cmd_Number(const char *w, dv_u32_t *v)
+{
+	dv_u32_t n = 0;
+
+	if ( *w == '\0' )
+		return 0;
+
+	while ( *w != '\0' )
+	{
+		if ( *w < '0' || *w > '9' )
+			return 0;
+		n = n * 10 + (*w - '0');
+		w++;
+	}
+
+	*v = n;
+	return 1;
+}
+
+/* cmd_Request() - pass a request to the frame manager and, in the rate-monotonic build, to the rm manager
+*/
+static void cmd_Request(dv_u32_t req, const struct fm_config_s *cfg)
+{
+	fm_Request(req, cfg);
+#if SCHED_RM
+	rm_Request(req);
+#endif
+}
+
+/* cmd_Rx() - handle a received character
+ *
+ * Called from the uart ISR. Echoes the character and collects the line.
+*/
+void cmd_Rx(int c)
+{
+	if ( c == '\r' || c == '\n' )
+	{
+		ub_Putc('\r');
+		ub_Putc('\n');
+
+		if ( command.rxlen > 0 )
+		{
+			if ( command.ready )
+			{
+				command.n_lost++;
+			}
+			else
+			{
+				for ( int i = 0; i <= command.rxlen; i++ )
+					command.line[i] = command.rxline[i];
+				command.ready = 1;
+			}
+		}
+		command.rxlen = 0;
+		command.rxline[0] = '\0';
+	}
+	else
+	if ( c == '\b' || c == 0x7f )
+	{
+		if ( command.rxlen > 0 )
+		{
+			command.rxlen--;
+			command.rxline[command.rxlen] = '\0';
+			ub_Putc('\b');
+			ub_Putc(' ');
+			ub_Putc('\b');
+		}
+	}
+	else
+	if ( c >= ' ' && command.rxlen < (CMD_LINELEN - 1) )
+	{
+		command.rxline[command.rxlen++] = (char)c;
+		command.rxline[command.rxlen] = '\0';
+		ub_Putc(c);
+	}
+}
+
+/* cmd_Poll() - execute the received command, if there is one
+ *
+ * Called from the idle loop.
+*/
+void cmd_Poll(void)
+{
+	char w[16];
+	const char *args;
+	const struct cmd_s *cmd;
+
+	if ( !command.ready )
+		return;
+
+	args = cmd_Word(command.line, w, sizeof(w));
+
+	for ( cmd = cmd_table; cmd->name != 0; cmd++ )
+	{
+		if ( cmd_Equal(w, cmd->name) )
+		{
+			cmd->fn(args);
+			break;
+		}
+	}
+
+	if ( cmd->name == 0 )
+	{
+		dv_printf("Unknown command \"%s\" - type help for a list\n", w);
+	}
+
+	command.ready = 0;
+	dv_printf("> ");
+}
+
+static void cmd_Help(const char *args)
+{
+	for ( const struct cmd_s *cmd = cmd_table; cmd->name != 0; cmd++ )
+	{
+		dv_printf("  %s\n", cmd->help);
+	}
+	if ( command.n_lost != 0 )
+		dv_printf("(%u command lines were lost)\n", command.n_lost);
+}
+
+static void cmd_Show(const char *args)
+{
+	fm_PrintConfig();
+}
+
+static void cmd_Where(const char *args)
+{
+	struct fm_config_s cfg;
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+	fm_GetConfig(&cfg);
+
+	for ( int i = 0; i < FM_NLOCATIONS; i++ )
+	{
+		if ( cmd_Equal(w, fm_whereNames[i]) )
+		{
+			cfg.whereCacheMaintenance = (enum fm_frameLocation_e)i;
+			cmd_Request(FM_REQ_CONFIG, &cfg);
+			return;
+		}
+	}
+	dv_printf("where: expected none, round, start or end\n");
+}
+
+static void cmd_Ops(const char *args)
+{
+	struct fm_config_s cfg;
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+	fm_GetConfig(&cfg);
+
+	cfg.cacheop.icache = 0;
+	cfg.cacheop.dcache = 0;
+	cfg.cacheop.prefetch = 0;
+	cfg.cacheop.branchpredict = 0;
+	cfg.cacheop.tlb = 0;
+	cfg.cacheop.scratchclean = 0;
+	cfg.cacheop.scratchwarm = 0;
+
+	for ( const char *p = w; *p != '\0'; p++ )
+	{
+		switch ( *p )
+		{
+		case 'i':	cfg.cacheop.icache = 1;			break;
+		case 'd':	cfg.cacheop.dcache = 1;			break;
+		case 'p':	cfg.cacheop.prefetch = 1;		break;
+		case 'b':	cfg.cacheop.branchpredict = 1;	break;
+		case 't':	cfg.cacheop.tlb = 1;			break;
+		case 'c':	cfg.cacheop.scratchclean = 1;	break;
+		case 'w':	cfg.cacheop.scratchwarm = 1;	break;
+		case '-':									break;
+		default:
+			dv_printf("ops: unknown operation '%c'\n", *p);
+			return;
+		}
+	}
+
+	cmd_Request(FM_REQ_CONFIG, &cfg);
+}
+
+static void cmd_Rounds(const char *args)
+{
+	struct fm_config_s cfg;
+	char w[16];
+	dv_u32_t n;
+
+	cmd_Word(args, w, sizeof(w));
+	if ( !cmd_Number(w, &n) )
+	{
+		dv_printf("rounds: expected a number\n");
+		return;
+	}
+
+	fm_GetConfig(&cfg);
+	cfg.nrounds = n;
+	cmd_Request(FM_REQ_CONFIG, &cfg);
+}
+
+static void cmd_Ignore(const char *args)
+{
+	struct fm_config_s cfg;
+	char w[16];
+	dv_u32_t n;
+
+	cmd_Word(args, w, sizeof(w));
+	if ( !cmd_Number(w, &n) )
+	{
+		dv_printf("ignore: expected a number\n");
+		return;
+	}
+
+	fm_GetConfig(&cfg);
+	cfg.ignorerounds = n;
+	cmd_Request(FM_REQ_CONFIG, &cfg);
+}
+
+static void cmd_Start(const char *args)
+{
+	cmd_Request(FM_REQ_START, 0);
+}
+
+static void cmd_Stop(const char *args)
+{
+	cmd_Request(FM_REQ_STOP, 0);
+}
+
+static void cmd_Reset(const char *args)
+{
+	cmd_Request(FM_REQ_RESET, 0);
+}
+
+/* cmd_Stopped() - returns nonzero if the scheduler is stopped, otherwise tells the user to stop it
+ *
+ * For the commands that mustn't run alongside the frames: the dump, because the statistics change
+ * while it prints, and the benchmarks, which disturb the frames and are disturbed by them.
+*/
+static int cmd_Stopped(const char *cmd)
+{
+#if SCHED_RM
+	if ( rm_Stopped() )
+#else
+	if ( fm_Stopped() )
+#endif
+		return 1;
+
+	dv_printf("%s: the experiment is running - \"stop\" first\n", cmd);
+	return 0;
+}
+
+static void cmd_Dump(const char *args)
+{
+	if ( !cmd_Stopped("dump") )
+		return;
+
+#if SCHED_RM
+	rm_PrintResults();
+#else
+	fm_PrintResults();
+#endif
+}
+
+static void cmd_Mode(const char *args)
+{
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+
+	dv_id_t m = fm_FindMode(w);
+	if ( m < 0 )
+	{
+		dv_printf("mode: unknown mode \"%s\"\n", w);
+		return;
+	}
+
+	fm_RequestMode(m);
+}
+
+static void cmd_Mmu(const char *args)
+{
+	mmu_Report();
+}
+
+static void cmd_Trace(const char *args)
+{
+	struct fm_config_s cfg;
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+
+	if ( cmd_Equal(w, "dump") )
+	{
+		fm_PrintTrace();
+		return;
+	}
+
+	fm_GetConfig(&cfg);
+
+	for ( int i = 0; i < FM_NTRACEMODES; i++ )
+	{
+		if ( cmd_Equal(w, fm_traceNames[i]) )
+		{
+			cfg.trace = (enum fm_traceMode_e)i;
+			cmd_Request(FM_REQ_CONFIG, &cfg);
+			return;
+		}
+	}
+	dv_printf("trace: expected off, on, overrun or dump\n");
+}
+
+static void cmd_Flight(const char *args)
+{
+	char w[16];
+	dv_u32_t us;
+
+	args = cmd_Word(args, w, sizeof(w));
+
+	if ( cmd_Equal(w, "arm") )
+		fm_FlightArm(1);
+	else
+	if ( cmd_Equal(w, "off") )
+		fm_FlightArm(0);
+	else
+	if ( cmd_Equal(w, "dump") )
+		fm_PrintFlight();
+	else
+	if ( cmd_Equal(w, "margin") )
+	{
+		cmd_Word(args, w, sizeof(w));
+		if ( cmd_Number(w, &us) )
+			fm_FlightMargin(us);
+		else
+			dv_printf("flight: expected margin us\n");
+	}
+	else
+		dv_printf("flight: expected arm, off, dump or margin\n");
+}
+
+static void cmd_Budget(const char *args)
+{
+	struct fm_config_s cfg;
+	char name[16];
+	char w[16];
+	dv_u32_t f, j, us;
+
+	args = cmd_Word(args, name, sizeof(name));
+
+	for ( int i = 0; i < FM_NBUDGETREACTIONS; i++ )
+	{
+		if ( cmd_Equal(name, fm_budgetNames[i]) )
+		{
+			fm_GetConfig(&cfg);
+			cfg.budget = (enum fm_budgetReaction_e)i;
+			cmd_Request(FM_REQ_CONFIG, &cfg);
+			return;
+		}
+	}
+
+	dv_id_t m = fm_FindMode(name);
+	if ( m < 0 )
+	{
+		dv_printf("budget: expected log, kill, skip or a mode name\n");
+		return;
+	}
+
+	args = cmd_Word(args, w, sizeof(w));
+	if ( cmd_Number(w, &f) )
+	{
+		args = cmd_Word(args, w, sizeof(w));
+		if ( cmd_Number(w, &j) )
+		{
+			cmd_Word(args, w, sizeof(w));
+			if ( cmd_Number(w, &us) )
+			{
+				/* The change waits for the round boundary; the admission check follows it.
+				 * The rate-monotonic scheduler doesn't run the frames, so there's no boundary to wait for.
+				*/
+#if SCHED_RM
+				int r = fm_SetJobBudget(m, f, j, us);
+				if ( r > 0 )
+					fm_CheckSchedule(0);
+#else
+				int r = fm_RequestBudget(m, f, j, us);
+#endif
+
+				if ( r == 0 )
+					dv_printf("budget: no job %u in frame %u of mode %s\n", j, f, name);
+				else
+				if ( r < 0 )
+					dv_printf("budget: too many changes waiting for the end of the round\n");
+				return;
+			}
+		}
+	}
+	dv_printf("budget: expected mode frame job us\n");
+}
+
+static void cmd_Admit(const char *args)
+{
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+
+	if ( w[0] == '\0' )
+		fm_CheckSchedule(0);
+	else
+	if ( cmd_Equal(w, "measured") )
+		fm_CheckSchedule(1);
+	else
+		dv_printf("admit: expected measured or nothing\n");
+}
+
+static void cmd_Idle(const char *args)
+{
+	struct fm_config_s cfg;
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+
+	for ( int i = 0; i < FM_NIDLE; i++ )
+	{
+		if ( cmd_Equal(w, fm_idleNames[i]) )
+		{
+			fm_GetConfig(&cfg);
+			cfg.idle = (enum fm_idle_e)i;
+			cmd_Request(FM_REQ_CONFIG, &cfg);
+			return;
+		}
+	}
+	dv_printf("idle: expected spin, wfi, wfe or hybrid\n");
+}
+
+static void cmd_Events(const char *args)
+{
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+
+	if ( cmd_Equal(w, "on") )
+		es_Generate(1);
+	else
+	if ( cmd_Equal(w, "off") )
+		es_Generate(0);
+	else
+	if ( cmd_Equal(w, "reset") )
+		es_ResetStats();
+	else
+	if ( cmd_Equal(w, "dump") )
+		es_PrintResults();
+	else
+		dv_printf("events: expected on, off, reset or dump\n");
+}
+
+static void cmd_Profile(const char *args)
+{
+#if FM_PROFILE
+	char w[16];
+
+	cmd_Word(args, w, sizeof(w));
+
+	if ( cmd_Equal(w, "on") )
+		pf_Enable(1);
+	else
+	if ( cmd_Equal(w, "off") )
+		pf_Enable(0);
+	else
+	if ( cmd_Equal(w, "reset") )
+		pf_Reset();
+	else
+	if ( cmd_Equal(w, "dump") )
+		pf_Print();
+	else
+		dv_printf("profile: expected on, off, reset or dump\n");
+#else
+	dv_printf("Profile not configured (make PROFILE=1)\n");
+#endif
+}
+
+static void cmd_Multicore(const char *args)
+{
+#if TGT_BOARD == TGT_PI3_ARM64
+	char w[16];
+	dv_u32_t n = 0;
+
+	cmd_Word(args, w, sizeof(w));
+	if ( w[0] != '\0' && !cmd_Number(w, &n) )
+	{
+		dv_printf("multicore: expected a number of samples\n");
+		return;
+	}
+
+	/* The measurements disable interrupts, which would delay the frame tick
+	*/
+	if ( !cmd_Stopped("multicore") )
+		return;
+
+	mc_Bench(n);
+#else
+	dv_printf("multicore: the pi zero has only one core\n");
+#endif
+}
+
+static void cmd_Membench(const char *args)
+{
+	/* The benchmark pollutes the caches and TLB under the frames, and the frames disturb its numbers
+	*/
+	if ( !cmd_Stopped("membench") )
+		return;
+
+	mb_Bench();
+}
+
+static void cmd_Osbench(const char *args)
+{
+	char w[16];
+	dv_u32_t n = 0;
+
+	cmd_Word(args, w, sizeof(w));
+	if ( w[0] != '\0' && !cmd_Number(w, &n) )
+	{
+		dv_printf("osbench: expected a number of iterations\n");
+		return;
+	}
+
+	/* The benchmark's tasks preempt the frames and it uses the budget timer
+	*/
+	if ( !cmd_Stopped("osbench") )
+		return;
+
+	ob_Bench(n);
+}
@@ -0,0 +1,372 @@
+/* event-server.c - a polling server for sporadic events
+ *
+ * The frames only run periodic work. Inputs that arrive at any time (uart characters, GPIO edges, messages)
+ * would otherwise have to be handled in their ISRs, which adds their handling time to the jitter of
+ * whatever they interrupt. Here an ISR only stamps the event and puts it in a queue with es_Post().
+ * The work is done by es_Serve(), called from a job that is placed in chosen frames like any other (the
+ * server's reserved slots). The server handles the queued events, oldest first, until the queues are
+ * empty or its budget is used up; the remaining events wait for the next slot. The response time of an
+ * event is therefore bounded by the distance between the slots, provided that the budget is enough for
+ * the events that arrive in between.
+ *
+ * Each source has its own single-producer single-consumer ring buffer: its ISR is the only writer of head
+ * and the server is the only writer of tail, so neither side needs to lock out the other. A source
+ * must only be posted from one ISR (or one task). Everything runs on core 0, so the ordering only has
+ * to be enforced against the compiler.
+ *
+ * The results show, for each source, the response time (from es_Post() to the end of the handler) and
+ * the depth of the queue when the server starts, as min/mean/max and as a histogram. Like the frame
+ * manager's statistics they are only recorded after the warm-up rounds, and are cleared by a start
+ * or a reset (see es_SetRecording()).
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <frame-manager.h>
+#include <event-server.h>
+
+#include TARGET_HDR
+
+struct event_s
+{
+	dv_u64_t time;						/* When the event was posted */
+	dv_u32_t data;
+};
+
+struct source_s
+{
+	const char *name;
+	es_handler_t handler;
+	struct event_s queue[ES_QSIZE];
+	volatile dv_u32_t head;				/* Next slot to write (ISR) */
+	volatile dv_u32_t tail;				/* Next slot to read (server) */
+	dv_u32_t n_posted;
+	dv_u32_t n_dropped;					/* Posted while the queue was full */
+	dv_u32_t n_handled;
+	dv_u32_t max_depth;					/* Deepest queue after a post */
+	struct timing_s response;			/* From es_Post() to the end of the handler */
+	struct timing_s depth;				/* Queue depth when the server starts */
+	dv_u32_t response_histo[ES_NBUCKETS];
+	dv_u32_t depth_histo[ES_QSIZE + 1];
+};
+
+struct eventserver_s
+{
+	struct source_s sources[ES_MAXSOURCES];
+	dv_qty_t n_sources;
+	dv_u32_t n_serves;
+	dv_u32_t n_exhausted;				/* Server jobs that used up the budget with events still queued */
+	dv_u32_t n_aborted;					/* Server jobs stopped by the scheduler's budget (fm_JobAborted()) */
+	struct timing_s serve_time;			/* Runtime of es_Serve() */
+	dv_id_t gen_source;					/* Source of the synthetic events (es_AddGenerator()). -1 = none */
+	int gen_on;
+	dv_u32_t gen_seq;
+	dv_u32_t gen_seed;
+	int recording;						/* Statistics are recorded (es_SetRecording()) */
+	dv_u32_t resets;					/* The scheduler's reset count when the statistics were last reset */
+};
+
+struct eventserver_s eventserver FM_HOT_DATA = { .gen_source = -1 };
+
+static inline void es_Barrier(void)
+{
+	__asm__ volatile("" : : : "memory");
+}
+
+/* es_AddSource() - add an event source with a handler that the server calls for each event
+ *
+ * Returns the source's ID, or -1 if there are already ES_MAXSOURCES sources.
+*/
+dv_id_t es_AddSource(const char *name, es_handler_t handler)
+{
+	if ( eventserver.n_sources >= ES_MAXSOURCES )
+	{
+		dv_printf("es_AddSource: can't add %s\n", name);
+		return -1;
+	}
+
+	dv_id_t src = eventserver.n_sources++;
+	struct source_s *s = &eventserver.sources[src];
+
+	s->name = name;
+	s->handler = handler;
+	s->head = 0;
+	s->tail = 0;
+	return src;
+}
+
+/* es_Post() - queue an event. Called by the source's ISR.
+ *
+ * Returns 0 if the queue is full; the event is dropped and counted.
+*/
+FM_HOT_TEXT int es_Post(dv_id_t src, dv_u32_t data)
+{
+	struct source_s *s = &eventserver.sources[src];
+	dv_u32_t head = s->head;
+	dv_u32_t used = head - s->tail;
+	int recording = eventserver.recording;
+
+	if ( recording )
+		s->n_posted++;
+
+	if ( used >= ES_QSIZE )
+	{
+		if ( recording )
+			s->n_dropped++;
+		return 0;
+	}
+
+	struct event_s *e = &s->queue[head % ES_QSIZE];
+	e->time = dv_readtime();
+	e->data = data;
+
+	es_Barrier();
+	s->head = head + 1;
+
+	if ( recording && used + 1 > s->max_depth )
+		s->max_depth = used + 1;
+
+	return 1;
+}
+
+/* es_StoreResponse() - record the response time of an event
+*/
+static inline void es_StoreResponse(struct source_s *s, dv_u64_t t)
+{
+	dv_u64_t us = t / hw_TicksPerMicrosecond;
+	int b = 0;
+
+	while ( b < (ES_NBUCKETS - 1) && us >= (1u << b) )
+		b++;
+
+	fm_StoreValue(&s->response, t);
+	s->response_histo[b]++;
+}
+
+/* es_Serve() - handle the queued events, oldest first, for at most budget microseconds
+ *
+ * Called by the server's job. The budget is checked before each event, so the job can take longer
+ * than the budget by the time of one handler. So is fm_JobAborted(): if the scheduler's budget for the
+ * job has expired with the "kill" or "skip" reaction, the remaining events stay queued for the next job.
+*/
+FM_HOT_TEXT void es_Serve(dv_u32_t budget)
+{
+	dv_u64_t t_start = dv_readtime();
+	dv_u64_t limit = (dv_u64_t)budget * hw_TicksPerMicrosecond;
+	int recording = eventserver.recording;
+
+	for ( dv_id_t i = 0; recording && i < eventserver.n_sources; i++ )
+	{
+		struct source_s *s = &eventserver.sources[i];
+		dv_u32_t depth = s->head - s->tail;
+
+		fm_StoreValue(&s->depth, depth);
+		s->depth_histo[depth]++;
+	}
+
+	for (;;)
+	{
+		struct source_s *oldest = 0;
+
+		for ( dv_id_t i = 0; i < eventserver.n_sources; i++ )
+		{
+			struct source_s *s = &eventserver.sources[i];
+
+			if ( s->head != s->tail &&
+				 (oldest == 0 || s->queue[s->tail % ES_QSIZE].time < oldest->queue[oldest->tail % ES_QSIZE].time) )
+			{
+				oldest = s;
+			}
+		}
+
+		if ( oldest == 0 )
+			break;
+
+		if ( fm_JobAborted() )
+		{
+			if ( recording )
+				eventserver.n_aborted++;
+			break;
+		}
+
+		if ( (dv_readtime() - t_start) >= limit )
+		{
+			if ( recording )
+				eventserver.n_exhausted++;
+			break;
+		}
+
+		es_Barrier();
+		struct event_s e = oldest->queue[oldest->tail % ES_QSIZE];
+		es_Barrier();
+		oldest->tail++;
+
+		oldest->handler(e.data);
+
+		if ( recording )
+		{
+			oldest->n_handled++;
+			es_StoreResponse(oldest, dv_readtime() - e.time);
+		}
+	}
+
+	if ( recording )
+	{
+		eventserver.n_serves++;
+		fm_StoreValue(&eventserver.serve_time, dv_readtime() - t_start);
+	}
+}
+
+/* es_SetRecording() - follow the scheduler's recording state and resets
+ *
+ * Called by the server's job before es_Serve() with the scheduler's fm_StatsRecording() and fm_StatsResets()
+ * (or the rm_ equivalents). The statistics are reset when the reset count has changed since the last call.
+*/
+FM_HOT_TEXT void es_SetRecording(int recording, dv_u32_t resets)
+{
+	if ( resets != eventserver.resets )
+	{
+		eventserver.resets = resets;
+		es_ResetStats();
+	}
+	eventserver.recording = recording;
+}
+
+/* es_Random() - xorshift32, for the intervals of the synthetic events
+*/
+static dv_u32_t es_Random(void)
+{
+	dv_u32_t x = eventserver.gen_seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	eventserver.gen_seed = x;
+	return x;
+}
+
+static void es_ArmGenerator(void)
+{
+	hw_SetEventTimer(ES_MININTERVAL + es_Random() % (ES_MAXINTERVAL - ES_MININTERVAL + 1));
+}
+
+/* es_AddGenerator() - add a source of synthetic events. When it is switched on with es_Generate(), the
+ * event timer's ISR (es_GeneratorIsr()) posts an event at random intervals between ES_MININTERVAL
+ * and ES_MAXINTERVAL. There can be one generator.
+*/
+dv_id_t es_AddGenerator(const char *name, es_handler_t handler)
+{
+	dv_id_t src = es_AddSource(name, handler);
+
+	eventserver.gen_source = src;
+	eventserver.gen_seed = 2463534242u;
+	return src;
+}
+
+/* es_Generate() - start or stop the synthetic events
+*/
+void es_Generate(int on)
+{
+	if ( eventserver.gen_source < 0 )
+	{
+		dv_printf("es_Generate: there's no generator\n");
+		return;
+	}
+
+	dv_intstatus_t is = dv_disable();
+
+	eventserver.gen_on = on;
+
+	if ( on )
+		es_ArmGenerator();
+	else
+		hw_CancelEventTimer();
+
+	dv_restore(is);
+}
+
+/* es_GeneratorIsr() - called by the event timer's ISR after clearing the interrupt
+*/
+FM_HOT_TEXT void es_GeneratorIsr(void)
+{
+	if ( !eventserver.gen_on )
+		return;
+
+	es_Post(eventserver.gen_source, eventserver.gen_seq++);
+	es_ArmGenerator();
+}
+
+/* es_ResetStats() - reset the statistics. The queues aren't emptied.
+*/
+void es_ResetStats(void)
+{
+	dv_intstatus_t is = dv_disable();
+
+	for ( dv_id_t i = 0; i < eventserver.n_sources; i++ )
+	{
+		struct source_s *s = &eventserver.sources[i];
+
+		s->n_posted = 0;
+		s->n_dropped = 0;
+		s->n_handled = 0;
+		s->max_depth = 0;
+		fm_InitTime(&s->response);
+		fm_InitTime(&s->depth);
+		for ( int b = 0; b < ES_NBUCKETS; b++ )
+			s->response_histo[b] = 0;
+		for ( int d = 0; d <= ES_QSIZE; d++ )
+			s->depth_histo[d] = 0;
+	}
+
+	eventserver.n_serves = 0;
+	eventserver.n_exhausted = 0;
+	eventserver.n_aborted = 0;
+	fm_InitTime(&eventserver.serve_time);
+
+	dv_restore(is);
+}
+
+/* es_PrintResults() - print the statistics of the server and of each source
+ *
+ * The histograms are printed as "limit:count" pairs, leaving out the empty buckets. A response bucket's
+ * limit is the upper end in microseconds (<); the last one also holds the longer responses.
+*/
+void es_PrintResults(void)
+{
+	dv_printf("Event server: %u jobs, budget %u us, %u used up the budget, %u aborted, synthetic events %s\n",
+				eventserver.n_serves, ES_BUDGET, eventserver.n_exhausted, eventserver.n_aborted,
+				eventserver.gen_on ? "on" : "off");
+	fm_PrintTimes(&eventserver.serve_time, "Serve", "server", 0);
+
+	for ( dv_id_t i = 0; i < eventserver.n_sources; i++ )
+	{
+		struct source_s *s = &eventserver.sources[i];
+
+		dv_printf("Source %d (%s): %u posted, %u handled, %u dropped, %u queued, max depth %u\n", i, s->name,
+					s->n_posted, s->n_handled, s->n_dropped, s->head - s->tail, s->max_depth);
+		fm_PrintTimes(&s->response, "Response", "source", i);
+		if ( s->depth.n > 0 )
+			dv_printf("Queue depth for source %d: min %u, mean %u, max %u\n", i, fm_Clip32(s->depth.t_min),
+						fm_Clip32(s->depth.t_sum / s->depth.n), fm_Clip32(s->depth.t_max));
+
+		dv_printf("Response histogram (us) for source %d:", i);
+		for ( int b = 0; b < ES_NBUCKETS; b++ )
+		{
+			if ( s->response_histo[b] != 0 )
+				dv_printf(" <%u:%u", 1u << b, s->response_histo[b]);
+		}
+		dv_printf("\n");
+
+		dv_printf("Queue depth histogram for source %d:", i);
+		for ( int d = 0; d <= ES_QSIZE; d++ )
+		{
+			if ( s->depth_histo[d] != 0 )
+				dv_printf(" %d:%u", d, s->depth_histo[d]);
+		}
+		dv_printf("\n");
+	}
+	dv_printf("\n");
+}
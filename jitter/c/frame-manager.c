@@ -13,31 +13,136 @@
 #include <davroska.h>
 #include <frame-manager.h>
 #include <dv-stdio.h>
+#include <uart-buffer.h>
+#include <mmu.h>
 
 #include TARGET_HDR
 
 #include <dv-arm-cache.h>
 
-#define FM_MAXJOBS		16
-#define FM_MAXFRAMES	16
+#define FM_MAXMODES		4
 
-/* For the experiment: ignore the results for this many rounds
+/* The frames and jobs of all the modes are allocated from an arena by fm_Init(), which sizes each frame's
+ * job array from the declared schedule. Until then the schedule is kept as a list of up to FM_MAXDECL
+ * declarations (fm_AddModeTask(), fm_SetFrameLength()).
+ * The arena has room for FM_ARENAFRAMES frames and FM_ARENAJOBS jobs (including each frame's FrameEnd),
+ * plus FM_CHANNELSPACE bytes for the channel buffers.
+*/
+#define FM_ARENAFRAMES	512
+#define FM_ARENAJOBS	4096
+#define FM_CHANNELSPACE	(16*1024)
+#define FM_ARENASIZE	(FM_ARENAFRAMES * sizeof(struct frame_s) + FM_ARENAJOBS * sizeof(struct job_s) + FM_CHANNELSPACE)
+#define FM_MAXDECL		4096
+
+/* For the footprint report: the dimensions of the old fixed-array layout
+*/
+#define FM_FIXEDFRAMES	16
+#define FM_FIXEDJOBS	16
+
+/* Default length of a frame in microseconds. Can be set for each frame with fm_SetFrameLength()
+*/
+#define FM_FRAMELENGTH	5000
+
+/* For the experiment: ignore the results for this many rounds after a start or reset (warm-up).
+ * The cold executions are still recorded in the "cold" statistics.
+ * This is the initial value. It can be changed at run time with fm_Request()
 */
 #define FM_IGNOREROUNDS	2
 
+/* For the experiment: record the total and the longest frame execution time of this many rounds
+ * after a start or reset, to show how long it takes to reach a steady state.
+ * Steady state is reached when all the following rounds are within FM_STEADYPERMILLE of the median
+ * of the second half of the recorded rounds.
+*/
+#define FM_TRENDROUNDS		64
+#define FM_STEADYPERMILLE	20
+
 /* For the experiment: print the results after this many rounds
+ * This is the initial value. It can be changed at run time with fm_Request()
 */
 #define FM_NROUNDS		10
 
+/* For the experiment: keep the latency and runtime of every job execution in a sample buffer
+ * of this size. The samples are printed with the results for offline analysis (see tools/pwcet.py).
+ * Comment out to omit the sample buffer.
+*/
+#define FM_NSAMPLES		8192
+
+/* The ISRs that are instrumented with fm_IsrStart()/fm_IsrEnd(), and how deeply they can nest
+*/
+#define FM_MAXISRS		4
+#define FM_MAXISRNEST	4
+
+/* Number of resumable (sliced) jobs, see fm_AddWork()
+*/
+#define FM_MAXWORK		4
+
+/* Number of LET channels between jobs, see fm_AddChannel()
+*/
+#define FM_MAXCHANNELS	8
+
+/* Number of budget changes that can wait for the round boundary, see fm_RequestBudget()
+*/
+#define FM_MAXBUDGETREQS	8
+
+/* For the experiment: size in bytes of the scratch arena that the jobs of a frame allocate their working
+ * memory from (see fm_ScratchAlloc()). Comment out to omit the scratch arena.
+*/
+#define FM_SCRATCHSIZE	(16*1024)
+
+/* For the experiment: record every tick, frame start/end, job start/end and cache maintenance
+ * in an event trace of this many entries. The trace is switched on with the "trace" command and
+ * printed with "trace dump" (see tools/trace2json.py). Comment out to omit the trace.
+*/
+#define FM_TRACE		4096
+
+/* For the experiment: a flight recorder that always keeps the timestamps of the last FM_FLIGHT frames
+ * (up to FM_FLIGHTJOBS jobs each). It trips on an overrun, a budget overrun, or a frame latency, job
+ * latency or job runtime that exceeds the running estimate of its 99th percentile by more than the
+ * margin (FM_FLIGHTMARGIN us, see the "flight" command). A job runs once per round, so an estimate
+ * gets one value per round: the estimates are only used after FM_FLIGHTWARMUP values, or half the
+ * configured number of rounds if that is smaller. After a trip the recorder keeps FM_FLIGHT/2 more
+ * frames and freezes; the idle loop prints the history. Comment out FM_FLIGHT to omit the recorder.
+*/
+#define FM_FLIGHT			64
+#define FM_FLIGHTJOBS		8
+#define FM_FLIGHTMARGIN		20
+#define FM_FLIGHTWARMUP		32
+
+/* For the experiment: admission check of the schedule when fm_Init() builds it (see fm_CheckSchedule())
+ *	FM_ADMIT_OFF	- no check
+ *	FM_ADMIT_WARN	- report the frames whose estimated demand exceeds their length
+ *	FM_ADMIT_REJECT	- ... and don't start the frames if there are any
+*/
+#define FM_ADMIT_OFF	0
+#define FM_ADMIT_WARN	1
+#define FM_ADMIT_REJECT	2
+
+#define FM_ADMISSION	FM_ADMIT_WARN
+
+/* For the experiment: dispatch overhead in microseconds for the admission check, until it has been measured.
+ * FM_JOBOVERHEAD is added for each job (chaining it and the frame manager's instrumentation),
+ * FM_FRAMEOVERHEAD for each frame (the timer ISR and FrameStart). The "osbench" command measures the parts.
+*/
+#define FM_JOBOVERHEAD		2
+#define FM_FRAMEOVERHEAD	10
+
 dv_id_t fm_frameStart, fm_frameEnd;	/* Task IDs */
 
-struct timing_s
+#ifdef FM_FLIGHT
+/* Running estimate of the 99th percentile of a time: a step up for a value above the estimate
+ * is 99 times a step down, so the estimate settles where 1% of the values are above it.
+ * The estimate starts at the first value and the step down is 1/FM_P99SCALE of the estimate
+ * (at least one tick), so it follows values of any magnitude in a few steps.
+*/
+#define FM_P99SCALE		256
+
+struct p99_s
 {
-	dv_u64_t t_min;
-	dv_u64_t t_max;
-	dv_u64_t t_sum;
-	unsigned n;
+	dv_u32_t est;
+	dv_u32_t n;
 };
+#endif
 
 struct job_s
 {
@@ -48,394 +153,2889 @@ struct job_s
 	struct timing_s latency;		/* From end of previous task to start of task */
 	struct timing_s runtime;		/* From start of task to end of task */
 	struct timing_s interval;		/* From previous start time to new start time */
+	struct timing_s runtime_cold;	/* Runtime of the first execution after cache maintenance, reset or mode switch */
+	struct timing_s runtime_steady;	/* Runtime of the other executions */
+	dv_u32_t epoch;					/* Cache epoch of the last execution */
+	dv_u64_t isr_mark;				/* fm_isrTable.total at the start of the job */
+	dv_u64_t interference;			/* Time spent in ISRs during the last execution */
+	struct timing_s net_runtime;	/* runtime minus interference */
+	struct timing_s isr_time;		/* interference */
+	dv_u32_t budget;				/* Execution-time budget in microseconds. 0 = none */
+	dv_qty_t n_budget_overruns;
+	struct timing_s detection;		/* From budget expiry to the budget ISR */
+#ifdef FM_FLIGHT
+	struct p99_s latency_p99;		/* Flight recorder thresholds */
+	struct p99_s runtime_p99;
+#endif
 };
 
 struct frame_s
 {
-	struct job_s jobs[FM_MAXJOBS];
+	struct job_s *jobs;					/* n_jobs + 1 entries. The last one is always fm_FrameEnd */
+	dv_u32_t length;					/* Length of the frame in timer ticks */
 	dv_qty_t n_jobs;
 	dv_qty_t n_overruns;
+	dv_qty_t n_skips;					/* No. of times the rest of the frame was skipped (budget) */
+	dv_qty_t n_missed;					/* No. of times the frame didn't run because its tick was lost */
 	dv_u64_t activation_time;
 	dv_u64_t start_time;
 	dv_u64_t prev_activation_time;
 	dv_u64_t prev_start_time;
 	int n_runs;
 	struct timing_s act_interval;		/* From previous activation time to new activation time */
+	struct stiming_s act_error;			/* Actual minus configured length of the previous frame (negative: early) */
 	struct timing_s start_interval;		/* From previous start time to new start time */
 	struct timing_s latency;			/* From activation to start */
+	struct timing_s exectime;			/* From start to end of last job */
+	struct timing_s exectime_cold;		/* exectime of the first execution after cache maintenance etc. */
+	struct timing_s exectime_steady;	/* exectime of the other executions */
+	struct timing_s icache_misses;		/* L1 I-cache misses from the first job to FrameEnd (PMU) */
+	dv_u32_t icache_start;				/* PMU count when the first job was chained */
+	dv_u32_t epoch;						/* Cache epoch of the last execution */
+#ifdef FM_FLIGHT
+	struct p99_s latency_p99;			/* Flight recorder threshold */
+#endif
+#ifdef FM_SCRATCHSIZE
+	struct timing_s scratch;			/* Scratch arena bytes used by the jobs */
+	dv_qty_t n_scratch_failed;			/* No. of scratch allocations that didn't fit */
+#endif
+};
+
+/* A mode is a complete schedule table with its own statistics
+*/
+struct mode_s
+{
+	const char *name;
+	struct frame_s *frames;				/* max_frame + 1 entries */
+	dv_id_t max_frame;
+	dv_u64_t rounds;
+	dv_qty_t n_switches;				/* No. of times the mode has been switched to */
+	struct timing_s switch_latency;		/* From mode request to start of the first frame in the new mode */
+	struct timing_s first_latency;		/* Latency of the first frame after a mode switch */
+	struct timing_s first_exectime;		/* Execution time of the first frame after a mode switch */
 };
 
-/* Different types of cache/TLB etc. maintenance
+/* A budget change waiting for the round boundary (fm_RequestBudget())
 */
-struct cacheop_s
+struct budgetreq_s
 {
-	dv_i8_t icache;
-	dv_i8_t dcache;
-	dv_i8_t prefetch;
-	dv_i8_t branchpredict;
-	dv_i8_t tlb;
+	dv_id_t mode;
+	dv_id_t frame;
+	dv_id_t job;
+	dv_u32_t us;
 };
 
 struct framemanager_s
 {
-	struct frame_s frames[FM_MAXFRAMES];
+	struct mode_s modes[FM_MAXMODES];
+	struct mode_s *mode;				/* The active schedule table */
+	struct mode_s * volatile next_mode;	/* The schedule table for the next round */
+	struct mode_s *latched_mode;		/* next_mode as seen by the timer at the start of the last frame */
+	dv_u64_t mode_request_time;
+	int mode_switched;					/* The current frame is the first after a mode switch */
+	dv_qty_t n_modes;
 	dv_id_t current_frame;
-	dv_id_t next_frame;
+	dv_id_t next_frame;					/* The frame that FrameStart runs next */
+	dv_id_t tick_frame;					/* The frame that the next tick starts (advanced by every tick) */
+	dv_id_t start_frame;				/* The frame that the pending FrameStart is for */
 	dv_id_t current_job;
-	int running;
-	dv_id_t max_frame;
+	dv_id_t jobs_done;					/* No. of jobs that have ended in the current frame */
+	int running;						/* Set by FrameStart, cleared by FrameEnd */
+	int start_pending;					/* FrameStart has been activated but hasn't started yet */
+	volatile int print;					/* Print the results from the idle loop (fm_Poll()) */
 	dv_qty_t n_overruns;
+	dv_qty_t n_lost;					/* Ticks that found FrameStart still pending */
+	dv_u32_t n_resets;					/* No. of times the statistics have been reset */
+	struct job_s * volatile budget_job;	/* The job whose budget is armed on the budget timer */
+	volatile int abort_job;				/* The budget ISR has asked the running job to stop */
+	volatile int skip_frame;			/* The budget ISR has asked for the rest of the frame to be skipped */
+	dv_qty_t n_budget_overruns;
+	struct timing_s detection;			/* From budget expiry to the budget ISR, all jobs */
 	dv_u64_t activation_time;
+	dv_u64_t prev_activation_time;		/* Activation time of the previous frame, for act_error */
+	dv_u32_t prev_length;				/* Configured length of the previous frame */
 	dv_u64_t rounds;
-	enum fm_frameLocation_e whereCacheMaintenance;
-	struct cacheop_s cacheop;
+	dv_u64_t warmup_end;				/* Results are ignored until rounds reaches this value */
+	dv_u32_t epoch;						/* Incremented by cache maintenance, reset and mode switch */
+	dv_u64_t round_total;				/* Sum of the frame execution times in the current round */
+	dv_u64_t round_max;					/* Longest frame execution time in the current round */
+	dv_u32_t frame_count;				/* No. of frames started */
+	int stopped;
+	struct fm_config_s config;
+	struct fm_config_s pending_config;
+	struct budgetreq_s pending_budgets[FM_MAXBUDGETREQS];
+	dv_qty_t n_pending_budgets;
+	volatile int admit;					/* Repeat the admission check from the idle loop (fm_Poll()) */
+	dv_u32_t requests;
 };
 
-struct framemanager_s framemanager;
-
-void main_FrameStart(void);
-void main_FrameEnd(void);
-void fm_ComputeTimes(void);
-void fm_PrintResults(void);
-void fm_CacheMaintenance(enum fm_frameLocation_e where);
+struct framemanager_s framemanager FM_HOT_DATA;
 
-static inline void fm_InitTime(struct timing_s *ts)
+/* The arena for the frames and jobs (allocated once, by fm_Init()) and the channel buffers
+ *
+ * The arena is large, so it is in .bss rather than with the hot data. The part that is used
+ * is added to the hot set by fm_AddHotSet().
+*/
+struct arena_s
 {
-	ts->t_min = 0xffffffffffffffff;
-	ts->t_max = 0;
-	ts->t_sum = 0;
-	ts->n = 0;
-}
+	dv_u64_t mem[FM_ARENASIZE/sizeof(dv_u64_t)] __attribute__((aligned(FM_HOT_ALIGN)));
+	dv_u32_t used;						/* Bytes */
+};
+
+struct arena_s fm_arena;
 
-static inline void fm_StoreTime(struct timing_s *ts, dv_u64_t t_from, dv_u64_t t_to)
+#ifdef FM_SCRATCHSIZE
+/* The scratch arena: a bump allocator that is emptied at the start of every frame. The memory starts
+ * on a cache line, so the allocations of a frame occupy the same lines in every round.
+*/
+struct scratch_s
 {
-	if ( t_from != 0 )
-	{
-		dv_u64_t diff = t_to - t_from;
-		if ( ts->t_min > diff )	ts->t_min = diff;
-		if ( ts->t_max < diff )	ts->t_max = diff;
-		ts->t_sum += diff;
-		ts->n++;
-	}
-}
+	dv_u64_t mem[FM_SCRATCHSIZE/sizeof(dv_u64_t)] __attribute__((aligned(FM_HOT_ALIGN)));
+	dv_u32_t used;						/* Bytes allocated in the current frame */
+	dv_u32_t max_used;					/* Most bytes allocated in any frame since startup */
+};
 
-/* fm_CreateTasks() - create the fm_frameStart and fm_frameEnd tasks
+struct scratch_s fm_scratch FM_HOT_DATA;
+#endif
+
+/* Execution time of the instrumented ISRs
  *
- * To be called in the davroska callout_addtasks() function
+ * Each ISR's own time excludes the ISRs that interrupted it. total is the time spent in the outermost
+ * ISRs since startup; a job's interference is the increase of total while the job was running.
 */
-void fm_CreateTasks(void)
+struct isr_s
 {
-	fm_frameStart = dv_addtask("fm_FrameStart", &main_FrameStart, 4, 1);
-	fm_frameEnd = dv_addtask("fm_FrameEnd", &main_FrameEnd, 4, 1);
-}
+	const char *name;
+	struct timing_s exectime;			/* From fm_IsrStart() to fm_IsrEnd(), without nested ISRs */
+};
 
-/* fm_Init() - initialise the frame manager
-*/
-void fm_Init(void)
+struct isrlevel_s
 {
-	framemanager.n_overruns = 0;
-	framemanager.max_frame = 0;
-	framemanager.running = 0;
-	framemanager.current_job = 0;
-	framemanager.next_frame = 0;
-	framemanager.current_frame = 0;
-	framemanager.activation_time = 0;
-	framemanager.rounds = 0;
-	framemanager.whereCacheMaintenance = fm_nowhere;
+	dv_u64_t start_time;
+	dv_u64_t nested;					/* Time spent in ISRs that interrupted this one */
+};
 
-	for (int f = 0; f < FM_MAXFRAMES; f++)
-	{
-		framemanager.frames[f].n_overruns = 0;
-		framemanager.frames[f].n_jobs = 0;
-		framemanager.frames[f].n_runs = 0;
-		framemanager.frames[f].activation_time = 0;
-		framemanager.frames[f].start_time = 0;
-		framemanager.frames[f].prev_activation_time = 0;
-		framemanager.frames[f].prev_start_time = 0;
-		fm_InitTime(&framemanager.frames[f].act_interval);
-		fm_InitTime(&framemanager.frames[f].start_interval);
-		fm_InitTime(&framemanager.frames[f].latency);
+struct isrtable_s
+{
+	struct isr_s isrs[FM_MAXISRS];
+	struct isrlevel_s stack[FM_MAXISRNEST];
+	dv_qty_t n_isrs;
+	dv_qty_t depth;
+	dv_u64_t total;
+};
 
-		for ( int j = 0; j < FM_MAXJOBS; j++ )
-		{
-			framemanager.frames[f].jobs[j].task = fm_frameEnd;
-			framemanager.frames[f].jobs[j].start_time = 0;
-			framemanager.frames[f].jobs[j].end_time = 0;
-			framemanager.frames[f].jobs[j].prev_start_time = 0;
-			fm_InitTime(&framemanager.frames[f].jobs[j].latency);
-			fm_InitTime(&framemanager.frames[f].jobs[j].runtime);
-			fm_InitTime(&framemanager.frames[f].jobs[j].interval);
-		}
-	}
-}
+struct isrtable_s fm_isrTable FM_HOT_DATA;
 
-/* fm_AddTask() - add a task to the frame manager
+/* Resumable jobs: a long computation that is split into slices, one slice per execution of its job.
+ * The work completes when all its slices have been executed, usually in several frames.
 */
-void fm_AddTask(dv_id_t frame, dv_id_t task)
+struct work_s
 {
-	if ( frame >= FM_MAXFRAMES )
-	{
-		/* Report error here */
-		return;
-	}
+	const char *name;
+	dv_u32_t n_slices;
+	dv_u32_t slice;						/* The slice that runs next */
+	dv_u64_t begin_time;				/* Start of the first slice. 0 if not known (reset) */
+	dv_u64_t slice_start;
+	dv_u32_t begin_frame;				/* frame_count at the first slice */
+	dv_qty_t n_completed;
+	struct timing_s completion;			/* From the start of the first slice to the end of the last */
+	struct timing_s frames;				/* No. of frames from the first slice to the last */
+	struct timing_s slice_time;			/* Runtime of a slice */
+};
 
-	struct frame_s *fr = &framemanager.frames[frame];
+struct worktable_s
+{
+	struct work_s work[FM_MAXWORK];
+	dv_qty_t n_work;
+};
 
-	/* Limit is (FM_MAXJOBS - 1) because the last "job" is always fm_FrameEnd
-	*/
-	if ( fr->n_jobs >= (FM_MAXJOBS - 1) )
-	{
-		/* Report error here */
-		return;
-	}
+struct worktable_s fm_workTable FM_HOT_DATA;
 
-	/* Remember the highest frame
-	*/
-	if ( frame > framemanager.max_frame )
-	{
-		framemanager.max_frame = frame;
-	}
+/* LET channels: each channel has two buffers. The writers fill the back buffer and the readers see the
+ * front buffer, which only changes when the buffers are swapped at the start of a frame or a round.
+ * So a job reads the same data wherever it runs in the frame, and the data that it writes is
+ * visible from the next frame (or round) on.
+*/
+struct channel_s
+{
+	const char *name;
+	void *buf[2];
+	dv_u32_t size;
+	dv_u8_t front;						/* Index of the buffer that the readers see */
+	dv_u8_t written;					/* The back buffer has been written since the last swap */
+	enum fm_frameLocation_e where;		/* fm_atFrameStart or fm_atRoundStart */
+	dv_u64_t write_time[2];				/* When each buffer was last written */
+	dv_qty_t n_swaps;
+	dv_qty_t n_mismatches;				/* Reads that the reader found inconsistent (fm_ChannelMismatch()) */
+	struct timing_s age;				/* From writing the data to reading it */
+};
 
-	struct job_s *job = &fr->jobs[fr->n_jobs];
-	fr->n_jobs++;
-	job->task = task;
-}
+struct channeltable_s
+{
+	struct channel_s channels[FM_MAXCHANNELS];
+	dv_qty_t n_channels;
+	struct timing_s swap_time;			/* Time taken to swap the channels at a frame start */
+};
 
-/* fm_StartFrame() - called by interrupt to start a new frame
- *
- * Record the activation time
- * Activates the fm_FrameStart task
+struct channeltable_s fm_channelTable FM_HOT_DATA;
+
+/* The declared schedule
 */
-void fm_StartFrame(void)
+#define FM_DECL_TASK	0
+#define FM_DECL_LENGTH	1
+#define FM_DECL_BUDGET	2
+
+struct decl_s
 {
-#ifdef FM_NROUNDS
-	/* For timing tests: stop activating after configured number of rounds
-	*/
-	if ( framemanager.rounds >= FM_NROUNDS )
-		return;
-#endif
+	dv_u8_t mode;
+	dv_u8_t kind;
+	dv_u16_t frame;
+	dv_u16_t job;						/* Job index (FM_DECL_BUDGET) */
+	dv_u32_t value;						/* Task ID, frame length (ticks) or budget (us) */
+};
 
-	framemanager.activation_time = dv_readtime();
-	dv_activatetask(fm_frameStart);
-}
+struct schedule_s
+{
+	struct decl_s decls[FM_MAXDECL];
+	dv_qty_t n_decls;
+	dv_qty_t n_errors;					/* Declarations that were rejected */
+	int allocated;						/* fm_Init() has built the schedule */
+};
 
-/* fm_TaskStart() - called at the start of every task
- *
- * Records the start time
+struct schedule_s fm_schedule;
+
+/* Configured worst-case execution time of each task in timer ticks (fm_SetTaskWcet()). 0 = not known
 */
-void fm_TaskStart(void)
-{
-	framemanager.frames[framemanager.current_frame].jobs[framemanager.current_job].start_time = dv_readtime();
-}
+dv_u32_t fm_taskWcet[DV_CFG_MAXEXE];
 
-/* fm_TaskEnd() - called at the end of every task
- *
- * Records the end time;
- * Chains the next task in the frame
+/* Names of the frame locations, for printing and for the command interpreter
+*/
+const char * const fm_whereNames[FM_NLOCATIONS] = { "none", "round", "start", "end" };
+
+#ifdef FM_NSAMPLES
+/* A single job execution, as recorded for offline analysis
 */
-void fm_TaskEnd(void)
+struct sample_s
 {
-	framemanager.frames[framemanager.current_frame].jobs[framemanager.current_job].end_time = dv_readtime();
-	framemanager.current_job++;
-	dv_chaintask(framemanager.frames[framemanager.current_frame].jobs[framemanager.current_job].task);
-}
+	dv_u32_t round;
+	dv_u16_t frame;
+	dv_u16_t job;
+	dv_u32_t latency;
+	dv_u32_t runtime;
+	dv_u8_t mode;
+};
 
-/* main_FrameStart() - main function for the FrameStart task
+struct samplebuffer_s
+{
+	struct sample_s samples[FM_NSAMPLES];
+	dv_qty_t n_samples;
+	dv_qty_t n_dropped;
+};
+
+struct samplebuffer_s samplebuffer;
+#endif
+
+#ifdef FM_TRACE
+/* Trace event types. The letters appear in the dump.
+*/
+#define FM_EV_TICK			'K'			/* Timer tick (fm_StartFrame) */
+#define FM_EV_FRAMESTART	'F'			/* FrameStart task starts */
+#define FM_EV_JOBSTART		'S'			/* Job starts */
+#define FM_EV_JOBEND		'E'			/* Job ends */
+#define FM_EV_FRAMEEND		'X'			/* FrameEnd task starts */
+#define FM_EV_FRAMEDONE		'x'			/* FrameEnd task terminates */
+#define FM_EV_CACHESTART	'C'			/* Cache maintenance starts; job = location */
+#define FM_EV_CACHEEND		'c'			/* Cache maintenance ends; job = location */
+#define FM_EV_OVERRUN		'O'			/* Overrun detected */
+#define FM_EV_MODESWITCH	'M'			/* New mode takes effect */
+#define FM_EV_BUDGET		'B'			/* Job budget exceeded (budget ISR) */
+#define FM_EV_ISRSTART		'I'			/* Instrumented ISR starts; job = ISR index */
+#define FM_EV_ISREND		'i'			/* Instrumented ISR ends; job = ISR index */
+
+/* A single event
  *
- * Note the start time
- * Check for deadline violation
- * Move to the next frame and initialise it for a new run
- * Record the activation time and start time for the frame
+ * 16 bytes, so the task ID has only 8 bits. A wider field would make an event 24 bytes.
 */
-void main_FrameStart(void)
+struct trace_s
 {
-	dv_u64_t start_time = dv_readtime();
+	dv_u64_t time;
+	dv_u8_t type;
+	dv_u8_t core;
+	dv_u8_t mode;
+	dv_i8_t task;						/* -1 if the event is not a job event */
+	dv_u16_t frame;
+	dv_u16_t job;
+};
 
-	if ( framemanager.running )
-	{
-		/* Handle deadline volation
-		*/
-		framemanager.n_overruns++;
-		framemanager.frames[framemanager.current_frame].n_overruns++;
+#if DV_CFG_MAXEXE > 128
+#error "DV_CFG_MAXEXE is too large for the task ID in struct trace_s"
+#endif
 
-		/* Need to determine what the next frame is going to be.
-		 * If next_frame == current_frame we didn't get to the end
-		*/
+/* The trace is a ring buffer. head counts all recorded events; the buffer holds the last FM_TRACE.
+*/
+struct tracebuffer_s
+{
+	struct trace_s events[FM_TRACE];
+	dv_u32_t head;
+	dv_u32_t stop_at;					/* Freeze the trace when head reaches this value (0 = never) */
+	int enabled;
+};
 
-		/* Need to terminate the running task here
-		*/
-	}
+struct tracebuffer_s tracebuffer;
+#endif
 
-	fm_CacheMaintenance(fm_atFrameStart);
+#ifdef FM_FLIGHT
+/* Flight recorder flags. A frame record has the flags of everything that happened in the frame;
+ * FM_FL_TRIP are the ones that trip the recorder.
+*/
+#define FM_FL_OVERRUN		0x01		/* The next tick found the frame still running */
+#define FM_FL_BUDGET		0x02		/* A job exceeded its budget */
+#define FM_FL_FRAMELATENCY	0x04		/* Frame latency above p99 + margin */
+#define FM_FL_JOBLATENCY	0x08		/* Job latency above p99 + margin */
+#define FM_FL_JOBRUNTIME	0x10		/* Job runtime above p99 + margin */
+#define FM_FL_COLD			0x20		/* First execution after cache maintenance etc. */
 
-	/* Go to next frame
-	*/
-	framemanager.current_frame = framemanager.next_frame;
-	framemanager.current_job = 0;
-	framemanager.running = 0;
-	framemanager.frames[framemanager.current_frame].activation_time = framemanager.activation_time;
-	framemanager.frames[framemanager.current_frame].start_time = start_time;
+#define FM_FL_TRIP			0x1f
+#define FM_NFLIGHTFLAGS		6
 
-	dv_chaintask(framemanager.frames[framemanager.current_frame].jobs[0].task);
-}
+static const char * const fm_flightFlagNames[FM_NFLIGHTFLAGS] =
+	{ "overrun", "budget", "frame-latency", "job-latency", "job-runtime", "cold" };
 
-/* main_FrameEnd() - main function for the FrameEnd task
- *
- * Calculate the next frame
- * Clear the running flag
- * Terminate (return to background processing)
+/* Recorder states
 */
-void main_FrameEnd(void)
-{
-	if ( framemanager.next_frame < framemanager.max_frame )
-	{
-		framemanager.next_frame++;
-	}
-	else
-	{
-		framemanager.next_frame = 0;
-		framemanager.rounds++;
-	}
+#define FM_FLIGHT_OFF		0
+#define FM_FLIGHT_ARMED		1			/* Recording, waiting for a trip */
+#define FM_FLIGHT_TRIPPED	2			/* Recording the frames after the trip */
+#define FM_FLIGHT_FROZEN	3			/* Waiting for the idle loop to print the history */
+#define FM_FLIGHT_PRINTED	4			/* Kept until the recorder is armed again */
 
-	fm_ComputeTimes();
+/* One frame. The times are in ticks from the activation.
+*/
+struct flightframe_s
+{
+	dv_u64_t activation_time;
+	dv_u32_t count;						/* framemanager.frame_count */
+	dv_u8_t mode;
+	dv_u8_t flags;
+	dv_u16_t frame;
+	dv_u16_t n_jobs;					/* Jobs that ran (at most FM_FLIGHTJOBS are recorded) */
+	dv_u32_t start;
+	dv_u32_t end;
+	dv_u32_t job_start[FM_FLIGHTJOBS];
+	dv_u32_t job_end[FM_FLIGHTJOBS];
+};
 
-	framemanager.running = 0;
+/* The history is a ring buffer like the trace. head counts all recorded frames.
+*/
+struct flightrecorder_s
+{
+	struct flightframe_s frames[FM_FLIGHT];
+	dv_u32_t head;
+	dv_u32_t stop_at;					/* Freeze when head reaches this value */
+	dv_u32_t trip_at;					/* head of the frame that tripped */
+	dv_u32_t margin;					/* In ticks */
+	volatile int state;
+	dv_u8_t pending;					/* Flags seen by the timer and budget ISRs for the running frame */
+	dv_u8_t trip_flags;
+	dv_id_t trip_job;					/* -1 for the frame */
+	dv_u32_t trip_value;
+	dv_u32_t trip_p99;
+	dv_u32_t n_trips;					/* Trips since the recorder was armed, including ignored ones */
+};
 
-#ifdef FM_NROUNDS
-	if ( framemanager.rounds == FM_NROUNDS )
-		fm_PrintResults();
+struct flightrecorder_s flightrecorder FM_HOT_DATA;
 #endif
 
-	/* Configured cache maintenance
-	*/
-	fm_CacheMaintenance(fm_atFrameEnd);
+const char * const fm_traceNames[FM_NTRACEMODES] = { "off", "on", "overrun" };
 
-	/* Fall back to idle loop
-	*/
-	dv_terminatetask();
-}
+const char * const fm_budgetNames[FM_NBUDGETREACTIONS] = { "log", "kill", "skip" };
 
-/* fm_CacheMaintenance() - performs the configured cache/TLB maintenance
+const char * const fm_idleNames[FM_NIDLE] = { "spin", "wfi", "wfe", "hybrid" };
+
+/* Per-round trend after a start or reset
 */
-void fm_CacheMaintenance(enum fm_frameLocation_e where)
+struct trend_s
 {
-	if ( framemanager.whereCacheMaintenance == where )
-	{
-		if ( framemanager.cacheop.icache )
-		{
-			dv_invalidate_entire_instruction_cache();
-		}
+	dv_u32_t total;						/* Sum of the frame execution times */
+	dv_u32_t max;						/* Longest frame execution time */
+};
 
-		if ( framemanager.cacheop.dcache )
-		{
-			dv_clean_entire_data_cache();
-		}
+struct trendbuffer_s
+{
+	struct trend_s rounds[FM_TRENDROUNDS];
+	dv_qty_t n_rounds;
+};
 
-		if ( framemanager.cacheop.prefetch )
-		{
-			dv_flush_prefetch_buffer();
-		}
+struct trendbuffer_s trendbuffer;
 
-		if ( framemanager.cacheop.branchpredict )
-		{
-			dv_flush_entire_branch_target_cache();
-		}
+void main_FrameStart(void);
+void main_FrameEnd(void);
+void fm_ComputeTimes(void);
+static void fm_NextFrame(void);
+void fm_CacheMaintenance(enum fm_frameLocation_e where);
+void fm_ResetStats(void);
+static void fm_ResetModeStats(struct mode_s *md);
+static int fm_Allocate(void);
+static dv_id_t fm_NewMode(const char *name);
+void fm_PrintFootprint(void);
+void fm_ApplyRequests(void);
+void fm_PrintSamples(void);
+void fm_PrintTrend(void);
 
-		if ( framemanager.cacheop.tlb )
-		{
-		}
+#ifdef FM_NSAMPLES
+/* fm_StoreSample() - record a single job execution in the sample buffer
+ *
+ * Only called for the jobs that ran; a job skipped after a budget overrun has no sample.
+ * When the buffer is full the samples are counted but discarded.
+ * The latency is measured from the job's release (the tick that activated its frame) to its start,
+ * as the rate-monotonic scheduler measures it, so that the samples of both can be compared.
+*/
+static inline void fm_StoreSample(dv_u32_t round, dv_id_t f, dv_id_t j, struct job_s *job, dv_u64_t release)
+{
+	if ( samplebuffer.n_samples >= FM_NSAMPLES )
+	{
+		samplebuffer.n_dropped++;
+		return;
 	}
+
+	struct sample_s *s = &samplebuffer.samples[samplebuffer.n_samples];
+	samplebuffer.n_samples++;
+
+	s->round = round;
+	s->mode = framemanager.mode - framemanager.modes;
+	s->frame = f;
+	s->job = j;
+	s->latency = fm_Clip32(job->start_time - release);
+	s->runtime = fm_Clip32(job->end_time - job->start_time);
 }
+#endif
 
-/* fm_ComputeTimes() - computes the timing for the current frame.
+#ifdef FM_TRACE
+/* fm_Trace() - record an event in the trace buffer
  *
- * Called at the end of each frame
- * Calculates:
- *	- for frame:
- *		- act_interval		- time from previous activation to current activation
- *		- start_interval	- time from previous start to current start
- *		- latency			- time from activation to start
- *	- for each job:
- *		- latency			- time from end of previous job to start of job
- *		- runtime			- time from start to end
- *		- interval			- time from previous start to current start
+ * Events are recorded by the jobs and by the ISRs, so the slot is claimed and filled with interrupts disabled.
 */
-void fm_ComputeTimes(void)
+static inline void fm_Trace(dv_u8_t type, dv_u64_t time, dv_id_t f, dv_id_t j, dv_id_t task)
 {
-	dv_id_t f = framemanager.current_frame;
-	struct frame_s *fr = &framemanager.frames[f];
-
-	fm_StoreTime(&fr->act_interval, fr->prev_activation_time, fr->activation_time);
-	fm_StoreTime(&fr->start_interval, fr->prev_start_time, fr->start_time);
-	fm_StoreTime(&fr->latency, fr->activation_time, fr->start_time);
+	if ( !tracebuffer.enabled )
+		return;
 
-	fr->prev_activation_time = fr->activation_time;
-	fr->prev_start_time = fr->start_time;
+	dv_intstatus_t is = dv_disable();
 
-	for ( dv_id_t j = 0; j < fr->n_jobs; j++)
+	if ( tracebuffer.enabled )
 	{
-		if ( j == 0 )
-		{
-			/* For the first job, the latency is the time from the frame start
-			*/
-			fm_StoreTime(&fr->jobs[j].latency, fr->start_time, fr->jobs[j].start_time);
-		}
-		else
-		{
-			fm_StoreTime(&fr->jobs[j].latency, fr->jobs[j-1].end_time, fr->jobs[j].start_time);
-		}
+		struct trace_s *e = &tracebuffer.events[tracebuffer.head % FM_TRACE];
+		tracebuffer.head++;
 
-		fm_StoreTime(&fr->jobs[j].runtime, fr->jobs[j].start_time, fr->jobs[j].end_time);
-		fm_StoreTime(&fr->jobs[j].interval, fr->jobs[j].prev_start_time, fr->jobs[j].start_time);
+		e->time = time;
+		e->type = type;
+		e->core = hw_CoreId();
+		e->mode = framemanager.mode - framemanager.modes;
+		e->frame = f;
+		e->job = j;
+		e->task = task;
 
-		fr->jobs[j].prev_start_time = fr->jobs[j].start_time;
+		if ( tracebuffer.head == tracebuffer.stop_at )
+			tracebuffer.enabled = 0;
 	}
+
+	dv_restore(is);
 }
 
-/* fm_PrintTimes() - print the contents of a timing structure
- *
+/* fm_TraceOverrun() - record an overrun. In fm_traceOverrun mode, arrange for the trace to freeze
+ * half a buffer later, so that the events leading up to the overrun and following it are kept.
 */
-void fm_PrintTimes(struct timing_s *t, char *descr, char *obj, dv_id_t id)
+static inline void fm_TraceOverrun(dv_u64_t time, dv_id_t f)
 {
-	if ( t->n <= 0 )
+	fm_Trace(FM_EV_OVERRUN, time, f, framemanager.current_job, -1);
+
+	if ( framemanager.config.trace == fm_traceOverrun && tracebuffer.stop_at == 0 )
+	{
+		tracebuffer.stop_at = tracebuffer.head + FM_TRACE/2;
+	}
+}
+
+/* fm_TraceNow() - record an event with the current time
+ *
+ * The time is only read if the trace is enabled.
+*/
+static inline void fm_TraceNow(dv_u8_t type, dv_id_t f, dv_id_t j, dv_id_t task)
+{
+	if ( tracebuffer.enabled )
+		fm_Trace(type, dv_readtime(), f, j, task);
+}
+
+/* fm_TraceSet() - start or stop the trace
+ *
+ * Starting the trace discards the events that were recorded before.
+*/
+static void fm_TraceSet(enum fm_traceMode_e tm)
+{
+	tracebuffer.enabled = 0;
+
+	if ( tm != fm_traceOff )
+	{
+		tracebuffer.head = 0;
+		tracebuffer.stop_at = 0;
+		tracebuffer.enabled = 1;
+	}
+}
+#else
+#define fm_Trace(type, time, f, j, task)	do { } while (0)
+#define fm_TraceNow(type, f, j, task)		do { } while (0)
+#define fm_TraceOverrun(time, f)			do { } while (0)
+#define fm_TraceSet(tm)						do { } while (0)
+#endif
+
+#ifdef FM_FLIGHT
+/* fm_FlightWarmup() - the number of values an estimate needs before it is used
+ *
+ * FM_FLIGHTWARMUP, but at most half the configured number of rounds so that a short experiment
+ * still arms the thresholds.
+*/
+static inline dv_u32_t fm_FlightWarmup(void)
+{
+	dv_u32_t nrounds = framemanager.config.nrounds;
+
+	if ( nrounds != 0 && nrounds/2 < FM_FLIGHTWARMUP )
+		return nrounds/2;
+	return FM_FLIGHTWARMUP;
+}
+
+/* fm_P99Exceeded() - add a value to a p99 estimate
+ *
+ * Returns nonzero if the value exceeds the previous estimate by more than the margin, once the
+ * estimate has seen fm_FlightWarmup() values.
+*/
+static inline int fm_P99Exceeded(struct p99_s *p, dv_u64_t v)
+{
+	int exceeded = (p->n > 0) && (p->n >= fm_FlightWarmup()) && (v > (dv_u64_t)p->est + flightrecorder.margin);
+	dv_u32_t step = p->est / FM_P99SCALE;
+
+	if ( step == 0 )
+		step = 1;
+
+	if ( p->n == 0 )
+		p->est = fm_Clip32(v);
+	else
+	if ( v > p->est )
+		p->est = fm_Clip32((dv_u64_t)p->est + 99 * step);
+	else
+	if ( p->est >= step )
+		p->est -= step;
+	else
+		p->est = 0;
+
+	if ( p->n < FM_FLIGHTWARMUP )
+		p->n++;
+
+	return exceeded;
+}
+
+/* fm_FlightCheck() - check a value against its p99 estimate
+ *
+ * Returns flag if the value is an anomaly. The first anomaly of a frame is noted as the trip
+ * if the recorder is armed.
+*/
+static inline dv_u8_t fm_FlightCheck(struct p99_s *p, dv_u64_t v, dv_u8_t flag, dv_id_t j, dv_u8_t flags)
+{
+	dv_u32_t p99 = p->est;
+
+	if ( !fm_P99Exceeded(p, v) )
+		return 0;
+
+	if ( (flags & FM_FL_TRIP) == 0 && flightrecorder.state == FM_FLIGHT_ARMED )
+	{
+		flightrecorder.trip_job = j;
+		flightrecorder.trip_value = fm_Clip32(v);
+		flightrecorder.trip_p99 = p99;
+	}
+	return flag;
+}
+
+/* fm_FlightFlag() - note an overrun or budget overrun in the running frame. Called from the ISRs.
+*/
+static inline void fm_FlightFlag(dv_u8_t flag, dv_id_t j)
+{
+	if ( flightrecorder.pending == 0 && flightrecorder.state == FM_FLIGHT_ARMED )
+		flightrecorder.trip_job = j;
+	flightrecorder.pending |= flag;
+}
+
+/* fm_FlightRecord() - check the frame that has just ended and add it to the history
+ *
+ * Called by fm_ComputeTimes(). The estimates are updated even when the recorder isn't recording,
+ * so that they're ready when it's armed again. Nothing is checked during the warm-up rounds.
+*/
+static FM_HOT_TEXT void fm_FlightRecord(dv_id_t f, struct frame_s *fr, dv_id_t n_done, dv_u64_t end_time,
+																				int warm, int cold)
+{
+	struct flightrecorder_s *fl = &flightrecorder;
+	dv_intstatus_t is = dv_disable();
+	dv_u8_t flags = fl->pending;
+	fl->pending = 0;
+	dv_restore(is);
+
+	if ( (flags & FM_FL_TRIP) != 0 && fl->state == FM_FLIGHT_ARMED )
+	{
+		fl->trip_value = 0;
+		fl->trip_p99 = 0;
+	}
+
+	if ( cold )
+		flags |= FM_FL_COLD;
+
+	if ( warm )
+	{
+		flags |= fm_FlightCheck(&fr->latency_p99, fr->start_time - fr->activation_time, FM_FL_FRAMELATENCY, -1, flags);
+
+		for ( dv_id_t j = 0; j < n_done; j++ )
+		{
+			struct job_s *job = &fr->jobs[j];
+			dv_u64_t t_prev = (j == 0) ? fr->start_time : fr->jobs[j-1].end_time;
+
+			flags |= fm_FlightCheck(&job->latency_p99, job->start_time - t_prev, FM_FL_JOBLATENCY, j, flags);
+			flags |= fm_FlightCheck(&job->runtime_p99, job->end_time - job->start_time, FM_FL_JOBRUNTIME, j, flags);
+		}
+	}
+
+	if ( fl->state != FM_FLIGHT_ARMED && fl->state != FM_FLIGHT_TRIPPED )
+		return;
+
+	struct flightframe_s *r = &fl->frames[fl->head % FM_FLIGHT];
+	dv_u64_t act = fr->activation_time;
+
+	r->activation_time = act;
+	r->count = framemanager.frame_count;
+	r->mode = framemanager.mode - framemanager.modes;
+	r->frame = f;
+	r->flags = flags;
+	r->n_jobs = n_done;
+	r->start = fm_Clip32(fr->start_time - act);
+	r->end = fm_Clip32(end_time - act);
+
+	for ( dv_id_t j = 0; j < n_done && j < FM_FLIGHTJOBS; j++ )
+	{
+		r->job_start[j] = fm_Clip32(fr->jobs[j].start_time - act);
+		r->job_end[j] = fm_Clip32(fr->jobs[j].end_time - act);
+	}
+
+	fl->head++;
+
+	if ( (flags & FM_FL_TRIP) != 0 )
+	{
+		fl->n_trips++;
+
+		if ( fl->state == FM_FLIGHT_ARMED )
+		{
+			fl->state = FM_FLIGHT_TRIPPED;
+			fl->trip_at = fl->head - 1;
+			fl->trip_flags = flags & FM_FL_TRIP;
+			fl->stop_at = fl->head + FM_FLIGHT/2;
+		}
+	}
+
+	if ( fl->state == FM_FLIGHT_TRIPPED && fl->head == fl->stop_at )
+		fl->state = FM_FLIGHT_FROZEN;
+}
+#else
+#define fm_FlightFlag(flag, j)									do { } while (0)
+#define fm_FlightRecord(f, fr, n_done, end_time, warm, cold)	do { } while (0)
+#endif
+
+#ifdef FM_SCRATCHSIZE
+/* fm_ScratchClean() - clean and invalidate the data cache lines of the part of the scratch arena
+ * that has ever been used
+*/
+static void fm_ScratchClean(void)
+{
+	hw_CleanDataRange(fm_scratch.mem, fm_scratch.max_used);
+}
+
+/* fm_ScratchWarm() - load the next frame's scratch memory into the data cache, up to the frame's high-water mark
+*/
+static void fm_ScratchWarm(void)
+{
+	struct frame_s *fr = &framemanager.mode->frames[framemanager.next_frame];
+	dv_u32_t size = (fr->scratch.n == 0) ? 0 : fm_Clip32(fr->scratch.t_max);
+	const volatile dv_u8_t *p = (const volatile dv_u8_t *)fm_scratch.mem;
+
+	for ( dv_u32_t i = 0; i < size; i += hw_DCacheLineSize )
+		(void)p[i];
+}
+#else
+#define fm_ScratchClean()	do { } while (0)
+#define fm_ScratchWarm()	do { } while (0)
+#endif
+
+/* fm_CreateTasks() - create the fm_frameStart and fm_frameEnd tasks
+ *
+ * To be called in the davroska callout_addtasks() function
+*/
+void fm_CreateTasks(void)
+{
+	fm_frameStart = dv_addtask("fm_FrameStart", &main_FrameStart, 4, 1);
+	fm_frameEnd = dv_addtask("fm_FrameEnd", &main_FrameEnd, 4, 1);
+}
+
+/* fm_Init() - initialise the frame manager
+ *
+ * Called after the schedule has been declared. Allocates the frames and jobs of every mode from
+ * the arena, sized exactly for the declared schedule.
+*/
+void fm_Init(void)
+{
+	if ( framemanager.n_modes == 0 )
+		fm_NewMode("default");
+
+	framemanager.mode = &framemanager.modes[0];
+	framemanager.next_mode = framemanager.mode;
+	framemanager.latched_mode = framemanager.mode;
+	framemanager.mode_switched = 0;
+	framemanager.running = 0;
+	framemanager.start_pending = 0;
+	framemanager.print = 0;
+	framemanager.admit = 0;
+	framemanager.n_pending_budgets = 0;
+	framemanager.budget_job = 0;
+	framemanager.current_job = 0;
+	framemanager.next_frame = 0;
+	framemanager.tick_frame = 0;
+	framemanager.start_frame = 0;
+	framemanager.current_frame = 0;
+	framemanager.activation_time = 0;
+	framemanager.rounds = 0;
+	framemanager.stopped = 0;
+	framemanager.requests = 0;
+	framemanager.config.whereCacheMaintenance = fm_nowhere;
+	framemanager.config.nrounds = FM_NROUNDS;
+	framemanager.config.trace = fm_traceOff;
+	framemanager.config.ignorerounds = FM_IGNOREROUNDS;
+	framemanager.config.budget = fm_budgetLog;
+	framemanager.config.idle = fm_idleSpin;
+
+#ifdef FM_FLIGHT
+	flightrecorder.margin = FM_FLIGHTMARGIN * hw_TicksPerMicrosecond;
+	flightrecorder.state = FM_FLIGHT_ARMED;
+#endif
+
+	/* If the schedule doesn't fit, the tables are incomplete: nothing may touch them
+	*/
+	if ( !fm_Allocate() )
+	{
+		dv_printf("fm_Init: the schedule doesn't fit in the arena (%u bytes) - not started\n", (dv_u32_t)FM_ARENASIZE);
+		framemanager.stopped = 1;
+		return;
+	}
+
+	fm_ResetStats();
+	fm_PrintFootprint();
+
+#if FM_ADMISSION != FM_ADMIT_OFF
+	if ( fm_CheckSchedule(0) > 0 && FM_ADMISSION == FM_ADMIT_REJECT )
+	{
+		dv_printf("fm_Init: the schedule failed the admission check - not started\n");
+		framemanager.stopped = 1;
+	}
+#endif
+}
+
+/* fm_Alloc() - allocate memory from the arena. Returns 0 if there isn't enough.
+*/
+static void *fm_Alloc(dv_u32_t size)
+{
+	size = (size + sizeof(dv_u64_t) - 1) & ~(sizeof(dv_u64_t) - 1);
+
+	if ( size > (FM_ARENASIZE - fm_arena.used) )
+		return 0;
+
+	void *p = (char *)fm_arena.mem + fm_arena.used;
+	fm_arena.used += size;
+	return p;
+}
+
+/* fm_Allocate() - build the schedule tables from the declarations
+ *
+ * Three passes over the declarations: find the number of frames in each mode, count the jobs in
+ * each frame, then fill in the tasks in the order in which they were declared.
+ * The job arrays get one extra entry for fm_FrameEnd, so that fm_TaskEnd() can always chain
+ * the next entry.
+*/
+static int fm_Allocate(void)
+{
+	struct decl_s *d;
+	int i;
+
+	if ( fm_schedule.allocated )
+		return 1;
+
+	for ( dv_id_t m = 0; m < framemanager.n_modes; m++ )
+		framemanager.modes[m].max_frame = 0;
+
+	for ( i = 0, d = fm_schedule.decls; i < fm_schedule.n_decls; i++, d++ )
+	{
+		if ( d->kind != FM_DECL_BUDGET && d->frame > framemanager.modes[d->mode].max_frame )
+			framemanager.modes[d->mode].max_frame = d->frame;
+	}
+
+	for ( dv_id_t m = 0; m < framemanager.n_modes; m++ )
+	{
+		struct mode_s *md = &framemanager.modes[m];
+
+		md->frames = fm_Alloc((md->max_frame + 1) * sizeof(struct frame_s));
+		if ( md->frames == 0 )
+			return 0;
+
+		for ( int f = 0; f <= md->max_frame; f++ )
+		{
+			md->frames[f].n_jobs = 0;
+			md->frames[f].length = FM_FRAMELENGTH * hw_TicksPerMicrosecond;
+		}
+	}
+
+	for ( i = 0, d = fm_schedule.decls; i < fm_schedule.n_decls; i++, d++ )
+	{
+		if ( d->kind == FM_DECL_TASK )
+			framemanager.modes[d->mode].frames[d->frame].n_jobs++;
+	}
+
+	for ( dv_id_t m = 0; m < framemanager.n_modes; m++ )
+	{
+		struct mode_s *md = &framemanager.modes[m];
+
+		for ( int f = 0; f <= md->max_frame; f++ )
+		{
+			struct frame_s *fr = &md->frames[f];
+
+			fr->jobs = fm_Alloc((fr->n_jobs + 1) * sizeof(struct job_s));
+			if ( fr->jobs == 0 )
+				return 0;
+
+			fr->jobs[fr->n_jobs].task = fm_frameEnd;
+			fr->n_jobs = 0;
+		}
+	}
+
+	for ( i = 0, d = fm_schedule.decls; i < fm_schedule.n_decls; i++, d++ )
+	{
+		struct frame_s *fr = &framemanager.modes[d->mode].frames[d->frame];
+
+		if ( d->kind == FM_DECL_TASK )
+		{
+			fr->jobs[fr->n_jobs].task = d->value;
+			fr->n_jobs++;
+		}
+		else
+		if ( d->kind == FM_DECL_LENGTH )
+		{
+			fr->length = d->value;
+		}
+	}
+
+	/* The budgets refer to job indexes, so they are applied when all the jobs are in place
+	*/
+	for ( i = 0, d = fm_schedule.decls; i < fm_schedule.n_decls; i++, d++ )
+	{
+		struct mode_s *md = &framemanager.modes[d->mode];
+
+		if ( d->kind != FM_DECL_BUDGET )
+			continue;
+
+		if ( d->frame <= md->max_frame && d->job < md->frames[d->frame].n_jobs )
+			md->frames[d->frame].jobs[d->job].budget = d->value;
+		else
+			fm_schedule.n_errors++;
+	}
+
+	fm_schedule.allocated = 1;
+	return 1;
+}
+
+/* fm_PrintFootprint() - print the size of the schedule and the memory it uses,
+ * compared with a layout of FM_FIXEDFRAMES frames of FM_FIXEDJOBS jobs per mode.
+*/
+void fm_PrintFootprint(void)
+{
+	dv_u32_t n_frames = 0;
+	dv_u32_t n_jobs = 0;
+	dv_u32_t max_jobs = 0;
+
+	for ( dv_id_t m = 0; m < framemanager.n_modes; m++ )
+	{
+		struct mode_s *md = &framemanager.modes[m];
+
+		if ( md->frames == 0 )
+			continue;
+
+		n_frames += md->max_frame + 1;
+
+		for ( int f = 0; f <= md->max_frame; f++ )
+		{
+			n_jobs += md->frames[f].n_jobs;
+			if ( md->frames[f].n_jobs > max_jobs )
+				max_jobs = md->frames[f].n_jobs;
+		}
+	}
+
+	dv_u32_t fixed = framemanager.n_modes * FM_FIXEDFRAMES *
+						(sizeof(struct frame_s) + FM_FIXEDJOBS * sizeof(struct job_s));
+
+	dv_printf("Schedule: %d modes, %u frames, %u jobs (max %u in a frame), %d declarations, %d rejected\n",
+				framemanager.n_modes, n_frames, n_jobs, max_jobs, fm_schedule.n_decls, fm_schedule.n_errors);
+	dv_printf("Arena: %u of %u bytes used (frame %u bytes, job %u bytes)\n",
+				fm_arena.used, (dv_u32_t)FM_ARENASIZE, (dv_u32_t)sizeof(struct frame_s), (dv_u32_t)sizeof(struct job_s));
+	dv_printf("Fixed layout (%d frames of %d jobs per mode): %u bytes%s\n", FM_FIXEDFRAMES, FM_FIXEDJOBS, fixed,
+				(n_frames > framemanager.n_modes * FM_FIXEDFRAMES || max_jobs >= FM_FIXEDJOBS) ? " - schedule doesn't fit" : "");
+#ifdef FM_SCRATCHSIZE
+	dv_printf("Scratch arena: %u bytes, aligned to %u\n", FM_SCRATCHSIZE, FM_HOT_ALIGN);
+#endif
+}
+
+/* fm_JobEstimate() - the execution time to allow for a job, in timer ticks
+ *
+ * The largest of the job's budget, its task's configured WCET and, if measured is set, the longest
+ * runtime that has been recorded. Returns 0 if none of them is known.
+*/
+static dv_u64_t fm_JobEstimate(struct job_s *job, int measured)
+{
+	dv_u64_t est = (dv_u64_t)job->budget * hw_TicksPerMicrosecond;
+
+	if ( job->task >= 0 && job->task < DV_CFG_MAXEXE && fm_taskWcet[job->task] > est )
+		est = fm_taskWcet[job->task];
+
+	if ( measured && job->runtime.n > 0 && job->runtime.t_max > est )
+		est = job->runtime.t_max;
+
+	return est;
+}
+
+/* fm_CheckSchedule() - admission check: compare each frame's estimated demand with its length
+ *
+ * The demand of a frame is the sum of its jobs' estimates (fm_JobEstimate()) plus the dispatch overhead:
+ * FM_JOBOVERHEAD per job and FM_FRAMEOVERHEAD per frame or, if measured is set and the frame has run,
+ * the longest recorded latency of each job (from the end of the previous one) and of the frame (from the
+ * timer tick to FrameStart). The report shows the utilisation and the headroom of every frame.
+ * Returns the number of frames whose demand exceeds their length.
+*/
+int fm_CheckSchedule(int measured)
+{
+	int n_frames = 0;
+	int n_over = 0;
+	int n_unknown = 0;
+
+	if ( !fm_schedule.allocated )
+	{
+		dv_printf("Admission: the schedule hasn't been built\n");
+		return 0;
+	}
+
+	for ( dv_id_t m = 0; m < framemanager.n_modes; m++ )
+	{
+		struct mode_s *md = &framemanager.modes[m];
+
+		if ( md->frames == 0 )
+			continue;
+
+		for ( int f = 0; f <= md->max_frame; f++ )
+		{
+			struct frame_s *fr = &md->frames[f];
+			dv_u64_t work = 0;
+			dv_u64_t overhead;
+			int unknown = 0;
+
+			if ( measured && fr->latency.n > 0 )
+				overhead = fr->latency.t_max;
+			else
+				overhead = FM_FRAMEOVERHEAD * hw_TicksPerMicrosecond;
+
+			for ( int j = 0; j < fr->n_jobs; j++ )
+			{
+				struct job_s *job = &fr->jobs[j];
+				dv_u64_t est = fm_JobEstimate(job, measured);
+
+				if ( est == 0 )
+					unknown++;
+				work += est;
+
+				if ( measured && job->latency.n > 0 )
+					overhead += job->latency.t_max;
+				else
+					overhead += FM_JOBOVERHEAD * hw_TicksPerMicrosecond;
+			}
+
+			dv_u64_t demand = work + overhead;
+			dv_u32_t permille = (dv_u32_t)((demand * 1000 + fr->length / 2) / fr->length);
+			dv_i32_t headroom = (dv_i32_t)(((dv_i64_t)fr->length - (dv_i64_t)demand) / hw_TicksPerMicrosecond);
+
+			dv_printf("Admission: mode %s frame %d: length %u us, %d jobs, demand %u us (jobs %u, overhead %u), "
+						"utilisation %u.%u%%, headroom %d us%s\n", md->name, f, fr->length / hw_TicksPerMicrosecond,
+						fr->n_jobs, fm_Clip32(demand / hw_TicksPerMicrosecond), fm_Clip32(work / hw_TicksPerMicrosecond),
+						fm_Clip32(overhead / hw_TicksPerMicrosecond), permille / 10, permille % 10, headroom,
+						(demand > fr->length) ? " - OVERLOAD" : "");
+
+			n_frames++;
+			if ( demand > fr->length )
+				n_over++;
+			n_unknown += unknown;
+		}
+	}
+
+	dv_printf("Admission (%s estimates): %d frames, %d overloaded, %d jobs without an estimate\n",
+				measured ? "measured" : "configured", n_frames, n_over, n_unknown);
+	return n_over;
+}
+
+/* fm_AddHotSet() - add the frame manager's per-frame code and data to the MMU report's hot set
+*/
+void fm_AddHotSet(void)
+{
+	mmu_AddHot("fm_StartFrame", fm_StartFrame, MMU_HOTCODE);
+	mmu_AddHot("main_FrameStart", main_FrameStart, MMU_HOTCODE);
+	mmu_AddHot("fm_TaskStart", fm_TaskStart, MMU_HOTCODE);
+	mmu_AddHot("fm_TaskEnd", fm_TaskEnd, MMU_HOTCODE);
+	mmu_AddHot("main_FrameEnd", main_FrameEnd, MMU_HOTCODE);
+	mmu_AddHot("fm_ComputeTimes", fm_ComputeTimes, MMU_HOTCODE);
+	mmu_AddHot("fm_IsrStart", fm_IsrStart, MMU_HOTCODE);
+	mmu_AddHot("fm_IsrEnd", fm_IsrEnd, MMU_HOTCODE);
+	mmu_AddHot("framemanager", &framemanager, sizeof(framemanager));
+	mmu_AddHot("fm_arena", fm_arena.mem, fm_arena.used);
+	mmu_AddHot("fm_isrTable", &fm_isrTable, sizeof(fm_isrTable));
+	mmu_AddHot("fm_workTable", &fm_workTable, sizeof(fm_workTable));
+#ifdef FM_NSAMPLES
+	mmu_AddHot("samplebuffer", &samplebuffer, sizeof(samplebuffer));
+#endif
+}
+
+/* fm_NewMode() - create a mode
+*/
+static dv_id_t fm_NewMode(const char *name)
+{
+	if ( framemanager.n_modes >= FM_MAXMODES || fm_schedule.allocated )
+	{
+		fm_schedule.n_errors++;
+		return -1;
+	}
+
+	dv_id_t m = framemanager.n_modes;
+	struct mode_s *md = &framemanager.modes[m];
+	framemanager.n_modes++;
+
+	md->name = name;
+	md->frames = 0;
+	md->max_frame = 0;
+
+	return m;
+}
+
+/* fm_AddMode() - add a mode (an empty schedule table) to the frame manager
+ *
+ * Mode 0 is always "default", created automatically. Must be called before fm_Init().
+ * Returns the mode's ID, or -1 if there's no room
+*/
+dv_id_t fm_AddMode(const char *name)
+{
+	if ( framemanager.n_modes == 0 )
+		fm_NewMode("default");
+
+	return fm_NewMode(name);
+}
+
+/* fm_ResetModeStats() - reset the statistics of a mode and all its frames and jobs
+*/
+static void fm_ResetModeStats(struct mode_s *md)
+{
+	md->rounds = 0;
+	md->n_switches = 0;
+	fm_InitTime(&md->switch_latency);
+	fm_InitTime(&md->first_latency);
+	fm_InitTime(&md->first_exectime);
+
+	if ( !fm_schedule.allocated )
+		return;
+
+	for ( int f = 0; f <= md->max_frame; f++ )
+	{
+		struct frame_s *fr = &md->frames[f];
+
+		fr->n_overruns = 0;
+		fr->n_skips = 0;
+		fr->n_missed = 0;
+		fr->n_runs = 0;
+		fr->activation_time = 0;
+		fr->start_time = 0;
+		fr->prev_activation_time = 0;
+		fr->prev_start_time = 0;
+		fm_InitTime(&fr->act_interval);
+		fm_InitSTime(&fr->act_error);
+		fm_InitTime(&fr->start_interval);
+		fm_InitTime(&fr->latency);
+		fm_InitTime(&fr->exectime);
+		fm_InitTime(&fr->exectime_cold);
+		fm_InitTime(&fr->icache_misses);
+		fm_InitTime(&fr->exectime_steady);
+#ifdef FM_SCRATCHSIZE
+		fm_InitTime(&fr->scratch);
+		fr->n_scratch_failed = 0;
+#endif
+#ifdef FM_FLIGHT
+		fr->latency_p99.est = 0;
+		fr->latency_p99.n = 0;
+#endif
+
+		for ( int j = 0; j <= fr->n_jobs; j++ )
+		{
+			fr->jobs[j].start_time = 0;
+			fr->jobs[j].end_time = 0;
+			fr->jobs[j].prev_start_time = 0;
+			fm_InitTime(&fr->jobs[j].latency);
+			fm_InitTime(&fr->jobs[j].runtime);
+			fm_InitTime(&fr->jobs[j].interval);
+			fm_InitTime(&fr->jobs[j].runtime_cold);
+			fm_InitTime(&fr->jobs[j].runtime_steady);
+			fm_InitTime(&fr->jobs[j].net_runtime);
+			fm_InitTime(&fr->jobs[j].isr_time);
+			fr->jobs[j].n_budget_overruns = 0;
+			fm_InitTime(&fr->jobs[j].detection);
+#ifdef FM_FLIGHT
+			fr->jobs[j].latency_p99.est = 0;
+			fr->jobs[j].latency_p99.n = 0;
+			fr->jobs[j].runtime_p99.est = 0;
+			fr->jobs[j].runtime_p99.n = 0;
+#endif
+		}
+	}
+}
+
+/* fm_ResetStats() - reset all the statistics
+ *
+ * The previous times are cleared too, so that no intervals are computed across the reset.
+*/
+void fm_ResetStats(void)
+{
+	framemanager.n_resets++;
+	framemanager.n_overruns = 0;
+	framemanager.n_lost = 0;
+	framemanager.n_budget_overruns = 0;
+	fm_InitTime(&framemanager.detection);
+	framemanager.prev_activation_time = 0;
+
+	for ( int i = 0; i < fm_isrTable.n_isrs; i++ )
+	{
+		fm_InitTime(&fm_isrTable.isrs[i].exectime);
+	}
+
+	/* Work in progress carries on, but its completion time isn't recorded
+	*/
+	for ( int i = 0; i < fm_workTable.n_work; i++ )
+	{
+		struct work_s *w = &fm_workTable.work[i];
+
+		w->begin_time = 0;
+		w->n_completed = 0;
+		fm_InitTime(&w->completion);
+		fm_InitTime(&w->frames);
+		fm_InitTime(&w->slice_time);
+	}
+
+	for ( int i = 0; i < fm_channelTable.n_channels; i++ )
+	{
+		fm_channelTable.channels[i].n_swaps = 0;
+		fm_channelTable.channels[i].n_mismatches = 0;
+		fm_InitTime(&fm_channelTable.channels[i].age);
+	}
+	fm_InitTime(&fm_channelTable.swap_time);
+
+	framemanager.warmup_end = framemanager.rounds + framemanager.config.ignorerounds;
+	framemanager.epoch++;
+	framemanager.round_total = 0;
+	framemanager.round_max = 0;
+	trendbuffer.n_rounds = 0;
+
+	for ( int m = 0; m < framemanager.n_modes; m++ )
+	{
+		fm_ResetModeStats(&framemanager.modes[m]);
+	}
+
+#ifdef FM_NSAMPLES
+	samplebuffer.n_samples = 0;
+	samplebuffer.n_dropped = 0;
+#endif
+}
+
+/* fm_AddTask() - add a task to the default mode's schedule table
+*/
+void fm_AddTask(dv_id_t frame, dv_id_t task)
+{
+	fm_AddModeTask(0, frame, task);
+}
+
+/* fm_Declare() - add a declaration to the schedule
+*/
+static void fm_Declare(dv_id_t mode, dv_u8_t kind, dv_id_t frame, dv_id_t job, dv_u32_t value)
+{
+	if ( framemanager.n_modes == 0 )
+		fm_NewMode("default");
+
+	if ( mode < 0 || mode >= framemanager.n_modes || frame < 0 || frame > 0xffff || job < 0 || job > 0xffff ||
+		 fm_schedule.n_decls >= FM_MAXDECL || fm_schedule.allocated )
+	{
+		fm_schedule.n_errors++;
+		return;
+	}
+
+	struct decl_s *d = &fm_schedule.decls[fm_schedule.n_decls++];
+	d->mode = mode;
+	d->kind = kind;
+	d->frame = frame;
+	d->job = job;
+	d->value = value;
+}
+
+/* fm_AddModeTask() - add a task to a mode's schedule table
+ *
+ * Must be called before fm_Init(). The tasks in each frame run in the order in which they are added.
+*/
+void fm_AddModeTask(dv_id_t mode, dv_id_t frame, dv_id_t task)
+{
+	fm_Declare(mode, FM_DECL_TASK, frame, 0, task);
+}
+
+/* fm_SetFrameLength() - set the length of a frame in microseconds
+ *
+ * Before fm_Init() this is part of the schedule declaration. After fm_Init() the frame must exist;
+ * the new length is used from the frame's next activation.
+*/
+void fm_SetFrameLength(dv_id_t mode, dv_id_t frame, dv_u32_t us)
+{
+	if ( !fm_schedule.allocated )
+	{
+		fm_Declare(mode, FM_DECL_LENGTH, frame, 0, us * hw_TicksPerMicrosecond);
+		return;
+	}
+
+	if ( mode < 0 || mode >= framemanager.n_modes || frame < 0 || frame > framemanager.modes[mode].max_frame )
+	{
+		/* Report error here */
+		return;
+	}
+
+	framemanager.modes[mode].frames[frame].length = us * hw_TicksPerMicrosecond;
+}
+
+/* fm_SetJobBudget() - set the execution-time budget of a job in microseconds (0 = no budget)
+ *
+ * job is the job's index in the frame. The budget is armed on the budget timer when the job starts.
+ * The resolution is 1 us (the system timer).
+ * Before fm_Init() the budget is declared, so that the admission check in fm_Init() sees it; a declared
+ * budget for a job that doesn't exist is counted as a rejected declaration.
+ * Returns 0 if the job doesn't exist (after fm_Init()) or the declaration was rejected.
+ * After fm_Init() the budget is changed at once; use fm_RequestBudget() while the frames are running.
+*/
+int fm_SetJobBudget(dv_id_t mode, dv_id_t frame, dv_id_t job, dv_u32_t us)
+{
+	if ( !fm_schedule.allocated )
+	{
+		dv_qty_t n_errors = fm_schedule.n_errors;
+
+		fm_Declare(mode, FM_DECL_BUDGET, frame, job, us);
+		return fm_schedule.n_errors == n_errors;
+	}
+
+	if ( mode < 0 || mode >= framemanager.n_modes ||
+		 frame < 0 || frame > framemanager.modes[mode].max_frame ||
+		 job < 0 || job >= framemanager.modes[mode].frames[frame].n_jobs )
+	{
+		return 0;
+	}
+
+	framemanager.modes[mode].frames[frame].jobs[job].budget = us;
+	return 1;
+}
+
+/* fm_RequestBudget() - request a change to a job's budget (see fm_SetJobBudget())
+ *
+ * Called from background (idle) level. The change is applied with the other requests (FM_REQ_BUDGET),
+ * so a round never sees a budget change part-way through. The admission check is then repeated from the
+ * idle loop (fm_Poll()).
+ * Returns 1 if the change is queued, 0 if the job doesn't exist, -1 if too many changes are waiting.
+*/
+int fm_RequestBudget(dv_id_t mode, dv_id_t frame, dv_id_t job, dv_u32_t us)
+{
+	if ( !fm_schedule.allocated )
+		return fm_SetJobBudget(mode, frame, job, us);
+
+	if ( mode < 0 || mode >= framemanager.n_modes ||
+		 frame < 0 || frame > framemanager.modes[mode].max_frame ||
+		 job < 0 || job >= framemanager.modes[mode].frames[frame].n_jobs )
+	{
+		return 0;
+	}
+
+	dv_intstatus_t is = dv_disable();
+
+	if ( framemanager.n_pending_budgets >= FM_MAXBUDGETREQS )
+	{
+		dv_restore(is);
+		return -1;
+	}
+
+	struct budgetreq_s *b = &framemanager.pending_budgets[framemanager.n_pending_budgets];
+	framemanager.n_pending_budgets++;
+	b->mode = mode;
+	b->frame = frame;
+	b->job = job;
+	b->us = us;
+
+	fm_Request(FM_REQ_BUDGET, 0);
+
+	dv_restore(is);
+	return 1;
+}
+
+/* fm_SetTaskWcet() - set the worst-case execution time of a task in microseconds, for the admission check
+ *
+ * The estimate applies to all the task's jobs. Returns 0 if the task ID is out of range.
+*/
+int fm_SetTaskWcet(dv_id_t task, dv_u32_t us)
+{
+	if ( task < 0 || task >= DV_CFG_MAXEXE )
+		return 0;
+
+	fm_taskWcet[task] = us * hw_TicksPerMicrosecond;
+	return 1;
+}
+
+/* fm_StartTicker() - start the timer that activates the frames
+ *
+ * The first interrupt comes after the length of frame 0. That interrupt starts frame 0.
+*/
+void fm_StartTicker(void)
+{
+	dv_u32_t length = framemanager.mode->frames[0].length;
+
+	hw_InitialiseTicker(length);
+	hw_SetTimerReload(length);
+}
+
+/* fm_NextTick() - the time when the next tick is due, or 0 if the frames aren't running
+ *
+ * Estimated from the time of the last tick (taken in the timer ISR) and the length of the frame that it
+ * started, so it is late by the interrupt latency.
+*/
+dv_u64_t fm_NextTick(void)
+{
+	if ( framemanager.stopped || framemanager.prev_activation_time == 0 )
+		return 0;
+
+	return framemanager.prev_activation_time + framemanager.prev_length;
+}
+
+/* fm_StatsRecording() - returns nonzero if the statistics are being recorded (running and warmed up)
+ *
+ * For modules that keep their own statistics, so that they follow the warm-up rounds.
+*/
+int fm_StatsRecording(void)
+{
+	return !framemanager.stopped && framemanager.rounds >= framemanager.warmup_end;
+}
+
+/* fm_Stopped() - returns nonzero if the frame manager is stopped (no frames are being activated)
+*/
+int fm_Stopped(void)
+{
+	return framemanager.stopped;
+}
+
+/* fm_StatsResets() - the number of times the statistics have been reset (by a start or a reset)
+ *
+ * A module that keeps its own statistics resets them when this changes.
+*/
+dv_u32_t fm_StatsResets(void)
+{
+	return framemanager.n_resets;
+}
+
+/* fm_IdleStrategy() - the idle strategy of the current configuration
+ *
+ * A requested strategy is only used when the configuration is applied at the round boundary,
+ * so that every round runs with the strategy that its "Config:" line shows.
+*/
+enum fm_idle_e fm_IdleStrategy(void)
+{
+	return framemanager.config.idle;
+}
+
+/* fm_RequestMode() - request a switch to a different mode
+ *
+ * The switch takes place at the next round boundary, when main_FrameEnd() wraps next_frame to 0.
+ * The timer has to know the length of frame 0 of the new mode when the last frame of the old mode starts,
+ * so a request that arrives during the last frame of a round is held over until the following round.
+ * If the frame manager is stopped the switch is immediate.
+ * The time of the request is recorded for measuring the mode change latency.
+*/
+void fm_RequestMode(dv_id_t mode)
+{
+	if ( mode < 0 || mode >= framemanager.n_modes )
+	{
+		/* Report error here */
+		return;
+	}
+
+	struct mode_s *md = &framemanager.modes[mode];
+
+	/* Prepare the new table: no intervals should be computed across the time that it was inactive
+	*/
+	if ( md != framemanager.mode )
+	{
+		for ( int f = 0; f <= md->max_frame; f++ )
+		{
+			md->frames[f].prev_activation_time = 0;
+			md->frames[f].prev_start_time = 0;
+
+			for ( int j = 0; j < md->frames[f].n_jobs; j++ )
+			{
+				md->frames[f].jobs[j].prev_start_time = 0;
+			}
+		}
+	}
+
+	dv_intstatus_t is = dv_disable();
+
+	framemanager.mode_request_time = dv_readtime();
+	framemanager.next_mode = md;
+
+	if ( framemanager.stopped )
+	{
+		framemanager.mode = md;
+		framemanager.latched_mode = md;
+	}
+
+	dv_restore(is);
+}
+
+/* fm_FindMode() - return the ID of the mode with the given name, or -1
+*/
+dv_id_t fm_FindMode(const char *name)
+{
+	for ( dv_id_t m = 0; m < framemanager.n_modes; m++ )
+	{
+		const char *a = framemanager.modes[m].name;
+		const char *b = name;
+
+		while ( *a != '\0' && *a == *b )
+		{
+			a++;
+			b++;
+		}
+
+		if ( *a == *b )
+			return m;
+	}
+	return -1;
+}
+
+/* fm_FindJob() - return the index of a task's job in a frame, or -1 if the task doesn't run in the frame
+*/
+dv_id_t fm_FindJob(dv_id_t mode, dv_id_t frame, dv_id_t task)
+{
+	if ( !fm_schedule.allocated || mode < 0 || mode >= framemanager.n_modes ||
+		 frame < 0 || frame > framemanager.modes[mode].max_frame )
+	{
+		return -1;
+	}
+
+	struct frame_s *fr = &framemanager.modes[mode].frames[frame];
+
+	for ( dv_id_t j = 0; j < fr->n_jobs; j++ )
+	{
+		if ( fr->jobs[j].task == task )
+			return j;
+	}
+	return -1;
+}
+
+/* fm_StartFrame() - called by interrupt to start a new frame
+ *
+ * Record the activation time
+ * Check the length of the previous frame
+ * Program the timer with the length of the frame after this one
+ * Check for deadline violation
+ * Activates the fm_FrameStart task
+ *
+ * The timer reloads itself when it expires, so by the time this function runs the timer is
+ * already counting the length of the frame that's starting. The reload register is therefore
+ * loaded with the length of the following frame.
+ *
+ * The frame that the tick starts is tracked here (tick_frame, in the latched mode), not taken
+ * from next_frame: after an overrun FrameEnd hasn't advanced next_frame yet, and after a lost
+ * tick it lags behind the timer. FrameStart catches up (see main_FrameStart()).
+*/
+FM_HOT_TEXT void fm_StartFrame(void)
+{
+	/* For timing tests: stop activating after configured number of rounds, or on request
+	*/
+	if ( framemanager.stopped )
+		return;
+
+	dv_u64_t now = dv_readtime();
+	struct mode_s *md = framemanager.latched_mode;
+	dv_id_t f = framemanager.tick_frame;
+	struct frame_s *following;
+
+	fm_Trace(FM_EV_TICK, now, f, 0, -1);
+
+	if ( f < md->max_frame )
+	{
+		following = &md->frames[f+1];
+		framemanager.tick_frame = f + 1;
+	}
+	else
+	{
+		framemanager.latched_mode = framemanager.next_mode;
+		following = &framemanager.latched_mode->frames[0];
+		framemanager.tick_frame = 0;
+	}
+	hw_SetTimerReload(following->length);
+
+	if ( framemanager.prev_activation_time != 0 )
+	{
+		dv_u64_t actual = now - framemanager.prev_activation_time;
+		dv_u64_t expected = framemanager.prev_length;
+		fm_StoreSValue(&md->frames[f].act_error, (dv_i64_t)actual - (dv_i64_t)expected);
+	}
+	framemanager.prev_activation_time = now;
+	framemanager.prev_length = md->frames[f].length;
+
+	/* Deadline violation: the previous frame is still running. FrameStart has the same priority
+	 * as the jobs, so the new frame starts when the old one has finished.
+	 * If FrameStart is still waiting from the previous tick, activating it again would exceed its
+	 * activation limit; the tick is lost.
+	*/
+	if ( framemanager.running )
+	{
+		fm_TraceOverrun(now, framemanager.current_frame);
+		fm_FlightFlag(FM_FL_OVERRUN, framemanager.current_job);
+		framemanager.n_overruns++;
+		md->frames[framemanager.current_frame].n_overruns++;
+	}
+
+	if ( framemanager.start_pending )
+	{
+		framemanager.n_lost++;
+		return;
+	}
+
+	framemanager.activation_time = now;
+	framemanager.start_frame = f;
+	framemanager.start_pending = 1;
+	dv_activatetask(fm_frameStart);
+}
+
+/* fm_IsrTotal() - the total interference so far
+ *
+ * The total is 64 bits and updated by the ISRs, so it's read with interrupts disabled.
+*/
+static inline dv_u64_t fm_IsrTotal(void)
+{
+	dv_intstatus_t is = dv_disable();
+	dv_u64_t total = fm_isrTable.total;
+	dv_restore(is);
+	return total;
+}
+
+/* fm_TaskStart() - called at the start of every task
+ *
+ * Records the start time
+ * Clears the abort request of the previous job
+ * Arms the budget timer if the job has a budget
+*/
+FM_HOT_TEXT void fm_TaskStart(void)
+{
+	dv_id_t f = framemanager.current_frame;
+	dv_id_t j = framemanager.current_job;
+	struct job_s *job = &framemanager.mode->frames[f].jobs[j];
+
+	job->start_time = dv_readtime();
+	job->isr_mark = fm_IsrTotal();
+	fm_Trace(FM_EV_JOBSTART, job->start_time, f, j, job->task);
+	framemanager.abort_job = 0;
+
+	if ( job->budget != 0 )
+	{
+		framemanager.budget_job = job;
+		hw_SetBudgetTimer(job->budget);
+	}
+}
+
+/* fm_TaskEnd() - called at the end of every task
+ *
+ * Records the end time;
+ * Cancels the budget timer and clears the abort request
+ * Chains the next task in the frame, or FrameEnd if the budget ISR asked for the frame to be skipped
+*/
+FM_HOT_TEXT void fm_TaskEnd(void)
+{
+	struct frame_s *fr = &framemanager.mode->frames[framemanager.current_frame];
+	struct job_s *job = &fr->jobs[framemanager.current_job];
+
+	job->end_time = dv_readtime();
+	job->interference = fm_IsrTotal() - job->isr_mark;
+
+	if ( framemanager.budget_job != 0 )
+	{
+		framemanager.budget_job = 0;
+		hw_CancelBudgetTimer();
+	}
+	framemanager.abort_job = 0;
+
+	fm_Trace(FM_EV_JOBEND, job->end_time, framemanager.current_frame, framemanager.current_job, job->task);
+	framemanager.current_job++;
+	framemanager.jobs_done = framemanager.current_job;
+
+	if ( framemanager.skip_frame )
+	{
+		fr->n_skips++;
+		framemanager.current_job = fr->n_jobs;
+	}
+	dv_chaintask(fr->jobs[framemanager.current_job].task);
+}
+
+/* fm_BudgetExpired() - called by the budget timer's interrupt when a job has used up its budget
+ *
+ * Measures the detection latency: the time from the expiry of the budget to here.
+ * Then reacts as configured (see enum fm_budgetReaction_e).
+*/
+void fm_BudgetExpired(void)
+{
+	dv_u64_t now = dv_readtime();
+	struct job_s *job = framemanager.budget_job;
+
+	/* The job might have ended between the expiry and the interrupt
+	*/
+	if ( job == 0 )
+		return;
+
+	framemanager.budget_job = 0;
+
+	dv_u64_t expiry = job->start_time + (dv_u64_t)job->budget * hw_TicksPerMicrosecond;
+	dv_u64_t latency = (now > expiry) ? (now - expiry) : 0;
+
+	job->n_budget_overruns++;
+	framemanager.n_budget_overruns++;
+	fm_StoreValue(&job->detection, latency);
+	fm_StoreValue(&framemanager.detection, latency);
+	fm_Trace(FM_EV_BUDGET, now, framemanager.current_frame, framemanager.current_job, job->task);
+	fm_FlightFlag(FM_FL_BUDGET, framemanager.current_job);
+
+	if ( framemanager.config.budget != fm_budgetLog )
+		framemanager.abort_job = 1;
+
+	if ( framemanager.config.budget == fm_budgetSkip )
+		framemanager.skip_frame = 1;
+}
+
+/* fm_JobAborted() - returns nonzero if the running job has exceeded its budget and should stop
+ *
+ * For jobs that can run for a long time: poll this and call fm_TaskEnd() when it's true.
+*/
+FM_HOT_TEXT int fm_JobAborted(void)
+{
+	return framemanager.abort_job;
+}
+
+/* fm_ScratchAlloc() - allocate working memory for a job from the scratch arena
+ *
+ * The memory can be used until the end of the frame; the arena is emptied when the next frame starts,
+ * so nothing is freed. An allocation takes the same few instructions whatever has been allocated
+ * before. The size is rounded up to a multiple of 8 bytes.
+ * Returns 0 if the arena is full (the failure is counted for the frame). For jobs only, not for ISRs.
+*/
+FM_HOT_TEXT void *fm_ScratchAlloc(dv_u32_t size)
+{
+#ifdef FM_SCRATCHSIZE
+	size = (size + sizeof(dv_u64_t) - 1) & ~(sizeof(dv_u64_t) - 1);
+
+	if ( size > (FM_SCRATCHSIZE - fm_scratch.used) )
+	{
+		framemanager.mode->frames[framemanager.current_frame].n_scratch_failed++;
+		return 0;
+	}
+
+	void *p = (char *)fm_scratch.mem + fm_scratch.used;
+	fm_scratch.used += size;
+	return p;
+#else
+	return 0;
+#endif
+}
+
+/* fm_AddWork() - add a resumable job that is executed in n_slices slices
+ *
+ * Returns the ID to pass to fm_WorkSlice() and fm_WorkDone(), or -1 if there's no room.
+ * The job's task is placed in the frames with fm_AddModeTask() like any other; each execution runs one slice.
+*/
+dv_id_t fm_AddWork(const char *name, dv_u32_t n_slices)
+{
+	if ( fm_workTable.n_work >= FM_MAXWORK || n_slices == 0 )
+		return -1;
+
+	dv_id_t i = fm_workTable.n_work++;
+	struct work_s *w = &fm_workTable.work[i];
+
+	w->name = name;
+	w->n_slices = n_slices;
+	w->slice = 0;
+	w->begin_time = 0;
+	w->n_completed = 0;
+	fm_InitTime(&w->completion);
+	fm_InitTime(&w->frames);
+	fm_InitTime(&w->slice_time);
+	return i;
+}
+
+/* fm_WorkSlice() - called by a resumable job after fm_TaskStart(). Returns the slice to execute.
+ *
+ * Slice 0 starts a new piece of work: the job should initialise its state.
+*/
+FM_HOT_TEXT dv_u32_t fm_WorkSlice(dv_id_t work)
+{
+	struct work_s *w = &fm_workTable.work[work];
+
+	w->slice_start = dv_readtime();
+
+	if ( w->slice == 0 )
+	{
+		w->begin_time = w->slice_start;
+		w->begin_frame = framemanager.frame_count;
+	}
+	return w->slice;
+}
+
+/* fm_WorkDone() - called by a resumable job when it has executed the slice that fm_WorkSlice() returned
+ *
+ * After the last slice the completion latency and the number of frames are recorded and the work restarts.
+ * If the job was aborted (fm_JobAborted()) it should not call this; the slice is repeated next time.
+*/
+FM_HOT_TEXT void fm_WorkDone(dv_id_t work)
+{
+	struct work_s *w = &fm_workTable.work[work];
+	dv_u64_t now = dv_readtime();
+	int warm = (framemanager.rounds >= framemanager.warmup_end);
+
+	if ( warm )
+		fm_StoreValue(&w->slice_time, now - w->slice_start);
+
+	w->slice++;
+
+	if ( w->slice >= w->n_slices )
+	{
+		if ( warm && w->begin_time != 0 )
+		{
+			fm_StoreTime(&w->completion, w->begin_time, now);
+			fm_StoreValue(&w->frames, framemanager.frame_count - w->begin_frame + 1);
+		}
+		w->n_completed++;
+		w->slice = 0;
+	}
+}
+
+/* fm_AddChannel() - add a LET channel with two buffers of size bytes
+ *
+ * The buffers are allocated from the arena, each on a cache line. The channel is swapped at the start of
+ * every frame (where == fm_atFrameStart) or at the start of every round (fm_atRoundStart).
+ * Returns the ID to pass to the other fm_Channel functions, or -1 if there's no room.
+ * Use the FM_ADDCHANNEL(), FM_CHANNELWRITE() and FM_CHANNELREAD() macros for typed access.
+*/
+dv_id_t fm_AddChannel(const char *name, dv_u32_t size, enum fm_frameLocation_e where)
+{
+	if ( fm_channelTable.n_channels >= FM_MAXCHANNELS || size == 0 ||
+		 (where != fm_atFrameStart && where != fm_atRoundStart) )
+		return -1;
+
+	size = (size + FM_HOT_ALIGN - 1) & ~(FM_HOT_ALIGN - 1);
+
+	char *p = fm_Alloc(2 * size + FM_HOT_ALIGN);
+
+	if ( p == 0 )
+		return -1;
+
+	p = (char *)(((unsigned long)p + FM_HOT_ALIGN - 1) & ~(unsigned long)(FM_HOT_ALIGN - 1));
+
+	for ( dv_u32_t k = 0; k < 2 * size; k++ )
+		p[k] = 0;
+
+	dv_id_t i = fm_channelTable.n_channels++;
+	struct channel_s *c = &fm_channelTable.channels[i];
+
+	c->name = name;
+	c->buf[0] = p;
+	c->buf[1] = p + size;
+	c->size = size;
+	c->front = 0;
+	c->written = 0;
+	c->where = where;
+	c->write_time[0] = 0;
+	c->write_time[1] = 0;
+	c->n_swaps = 0;
+	c->n_mismatches = 0;
+	fm_InitTime(&c->age);
+	return i;
+}
+
+/* fm_ChannelWrite() - returns the back buffer of a channel, for the writer to fill
+ *
+ * The writer calls fm_ChannelWritten() when the buffer is complete. The buffer isn't cleared and
+ * contains the data from two swaps ago, so the writer should fill all of it.
+*/
+FM_HOT_TEXT void *fm_ChannelWrite(dv_id_t ch)
+{
+	struct channel_s *c = &fm_channelTable.channels[ch];
+
+	return c->buf[c->front ^ 1];
+}
+
+/* fm_ChannelWritten() - the back buffer is complete. It is published at the next swap.
+*/
+FM_HOT_TEXT void fm_ChannelWritten(dv_id_t ch)
+{
+	struct channel_s *c = &fm_channelTable.channels[ch];
+
+	c->write_time[c->front ^ 1] = dv_readtime();
+	c->written = 1;
+}
+
+/* fm_ChannelRead() - returns the front buffer of a channel and records the age of its data
+ *
+ * The buffer doesn't change until the next swap. Before the first swap it contains zeros.
+*/
+FM_HOT_TEXT const void *fm_ChannelRead(dv_id_t ch)
+{
+	struct channel_s *c = &fm_channelTable.channels[ch];
+
+	if ( framemanager.rounds >= framemanager.warmup_end )
+		fm_StoreTime(&c->age, c->write_time[c->front], dv_readtime());
+
+	return c->buf[c->front];
+}
+
+/* fm_ChannelMismatch() - the reader found the data of a channel inconsistent
+ *
+ * Counted for the results instead of printed, because the reader is a measured job.
+*/
+FM_HOT_TEXT void fm_ChannelMismatch(dv_id_t ch)
+{
+	fm_channelTable.channels[ch].n_mismatches++;
+}
+
+/* fm_SwapChannels() - swap the buffers of the channels that were written and are due at this location
+ *
+ * Only the front index changes; nothing is copied.
+*/
+static FM_HOT_TEXT void fm_SwapChannels(enum fm_frameLocation_e where)
+{
+	for ( int i = 0; i < fm_channelTable.n_channels; i++ )
+	{
+		struct channel_s *c = &fm_channelTable.channels[i];
+
+		if ( c->written && (c->where == fm_atFrameStart || c->where == where) )
+		{
+			c->front ^= 1;
+			c->written = 0;
+			c->n_swaps++;
+		}
+	}
+}
+
+/* fm_AddIsr() - register an ISR for execution time accounting
+ *
+ * Returns the index to pass to fm_IsrStart() and fm_IsrEnd(), or -1 if there's no room.
+*/
+dv_id_t fm_AddIsr(const char *name)
+{
+	if ( fm_isrTable.n_isrs >= FM_MAXISRS )
+		return -1;
+
+	dv_id_t i = fm_isrTable.n_isrs++;
+	fm_isrTable.isrs[i].name = name;
+	fm_InitTime(&fm_isrTable.isrs[i].exectime);
+	return i;
+}
+
+/* fm_IsrStart() - called at the start of an instrumented ISR
+ *
+ * The time between the interrupt and this call (the kernel's entry code) isn't measured.
+ * The ISRs nest, so the accounting is done with interrupts disabled.
+*/
+FM_HOT_TEXT void fm_IsrStart(dv_id_t isr)
+{
+	dv_intstatus_t is = dv_disable();
+	dv_u64_t now = dv_readtime();
+
+	if ( fm_isrTable.depth < FM_MAXISRNEST )
+	{
+		struct isrlevel_s *l = &fm_isrTable.stack[fm_isrTable.depth];
+		l->start_time = now;
+		l->nested = 0;
+	}
+	fm_isrTable.depth++;
+	dv_restore(is);
+
+	fm_Trace(FM_EV_ISRSTART, now, framemanager.current_frame, isr, -1);
+}
+
+/* fm_IsrEnd() - called at the end of an instrumented ISR
+ *
+ * Records the ISR's own execution time and adds the whole time (including nested ISRs) to
+ * the enclosing ISR or, for the outermost ISR, to the total interference. As in fm_IsrStart(),
+ * with interrupts disabled.
+*/
+FM_HOT_TEXT void fm_IsrEnd(dv_id_t isr)
+{
+	dv_intstatus_t is = dv_disable();
+	dv_u64_t now = dv_readtime();
+
+	fm_isrTable.depth--;
+
+	if ( fm_isrTable.depth < FM_MAXISRNEST && isr >= 0 && isr < fm_isrTable.n_isrs )
+	{
+		struct isrlevel_s *l = &fm_isrTable.stack[fm_isrTable.depth];
+		dv_u64_t gross = now - l->start_time;
+
+		fm_StoreValue(&fm_isrTable.isrs[isr].exectime, gross - l->nested);
+
+		if ( fm_isrTable.depth > 0 )
+			fm_isrTable.stack[fm_isrTable.depth-1].nested += gross;
+		else
+			fm_isrTable.total += gross;
+	}
+	dv_restore(is);
+
+	fm_Trace(FM_EV_ISREND, now, framemanager.current_frame, isr, -1);
+}
+
+/* main_FrameStart() - main function for the FrameStart task
+ *
+ * Note the start time
+ * Catch up with the timer if ticks were lost; terminate if that ends the run
+ * Move to the next frame and initialise it for a new run (this empties the scratch arena)
+ * Record the activation time and start time for the frame
+*/
+FM_HOT_TEXT void main_FrameStart(void)
+{
+	dv_u64_t start_time = dv_readtime();
+
+	/* Resynchronise with the timer: the frames between next_frame and the frame that this activation
+	 * is for lost their ticks, so they are skipped (at most a round's worth).
+	 * Skipping past a round boundary can reach the configured number of rounds or apply a stop
+	 * request. Then there is no frame to start.
+	*/
+	for ( int n = 0; framemanager.next_frame != framemanager.start_frame && n <= FM_ARENAFRAMES; n++ )
+	{
+		framemanager.mode->frames[framemanager.next_frame].n_missed++;
+		fm_NextFrame();
+
+		if ( framemanager.stopped )
+		{
+			framemanager.start_pending = 0;
+			dv_terminatetask();
+			return;
+		}
+	}
+
+	fm_Trace(FM_EV_FRAMESTART, start_time, framemanager.next_frame, 0, -1);
+
+	if ( framemanager.next_frame == 0 )
+	{
+		fm_CacheMaintenance(fm_atRoundStart);
+	}
+	fm_CacheMaintenance(fm_atFrameStart);
+
+	/* Publish the data that the jobs wrote to the channels in the previous frame (or round)
+	*/
+	if ( fm_channelTable.n_channels != 0 )
+	{
+		dv_u64_t t0 = dv_readtime();
+
+		fm_SwapChannels((framemanager.next_frame == 0) ? fm_atRoundStart : fm_atFrameStart);
+
+		if ( framemanager.rounds >= framemanager.warmup_end )
+			fm_StoreTime(&fm_channelTable.swap_time, t0, dv_readtime());
+	}
+
+	/* Go to next frame
+	*/
+	framemanager.current_frame = framemanager.next_frame;
+	framemanager.current_job = 0;
+	framemanager.jobs_done = 0;
+	framemanager.frame_count++;
+	framemanager.skip_frame = 0;
+	framemanager.abort_job = 0;
+	framemanager.start_pending = 0;
+	framemanager.running = 1;
+#ifdef FM_SCRATCHSIZE
+	fm_scratch.used = 0;
+#endif
+
+	struct frame_s *fr = &framemanager.mode->frames[framemanager.current_frame];
+	fr->activation_time = framemanager.activation_time;
+	fr->start_time = start_time;
+
+	if ( framemanager.mode_switched )
+	{
+		fm_StoreTime(&framemanager.mode->switch_latency, framemanager.mode_request_time, start_time);
+		fm_StoreTime(&framemanager.mode->first_latency, fr->activation_time, start_time);
+	}
+
+	fr->icache_start = hw_ReadICacheMisses();
+	dv_chaintask(fr->jobs[0].task);
+}
+
+/* main_FrameEnd() - main function for the FrameEnd task
+ *
+ * Compute the times for the frame that has just finished
+ * Calculate the next frame
+ * Clear the running flag
+ * Terminate (return to background processing)
+*/
+FM_HOT_TEXT void main_FrameEnd(void)
+{
+	fm_TraceNow(FM_EV_FRAMEEND, framemanager.current_frame, framemanager.current_job, -1);
+	fm_ComputeTimes();
+	fm_NextFrame();
+
+	framemanager.running = 0;
+
+	/* Configured cache maintenance
+	*/
+	fm_CacheMaintenance(fm_atFrameEnd);
+	fm_TraceNow(FM_EV_FRAMEDONE, framemanager.current_frame, framemanager.current_job, -1);
+
+	/* Fall back to idle loop
+	*/
+	dv_terminatetask();
+}
+
+/* fm_NextFrame() - advance next_frame, with the round boundary processing when it wraps
+ *
+ * Called by FrameEnd, and by FrameStart for the frames that are skipped after a lost tick.
+*/
+static FM_HOT_TEXT void fm_NextFrame(void)
+{
+	if ( framemanager.next_frame < framemanager.mode->max_frame )
+	{
+		framemanager.next_frame++;
+	}
+	else
+	{
+		/* Round boundary
+		*/
+		framemanager.next_frame = 0;
+		framemanager.rounds++;
+		framemanager.mode->rounds++;
+
+		if ( trendbuffer.n_rounds < FM_TRENDROUNDS )
+		{
+			trendbuffer.rounds[trendbuffer.n_rounds].total = fm_Clip32(framemanager.round_total);
+			trendbuffer.rounds[trendbuffer.n_rounds].max = fm_Clip32(framemanager.round_max);
+			trendbuffer.n_rounds++;
+		}
+		framemanager.round_total = 0;
+		framemanager.round_max = 0;
+
+		/* Mode switch: the new schedule table takes effect from frame 0
+		*/
+		if ( framemanager.latched_mode != framemanager.mode )
+		{
+			framemanager.mode = framemanager.latched_mode;
+			framemanager.mode->n_switches++;
+			framemanager.mode_switched = 1;
+			framemanager.epoch++;
+			fm_TraceNow(FM_EV_MODESWITCH, 0, 0, -1);
+		}
+
+		/* For timing tests: stop after configured number of rounds
+		*/
+		if ( (framemanager.config.nrounds != 0) && (framemanager.rounds == framemanager.config.nrounds) )
+		{
+			framemanager.stopped = 1;
+			framemanager.print = 1;
+		}
+
+		if ( framemanager.requests != 0 )
+		{
+			fm_ApplyRequests();
+		}
+	}
+}
+
+/* fm_GetConfig() - get a copy of the current configuration
+ *
+ * If a new configuration has been requested but not yet applied, that's the one that gets copied.
+*/
+void fm_GetConfig(struct fm_config_s *cfg)
+{
+	dv_intstatus_t is = dv_disable();
+
+	if ( framemanager.requests & FM_REQ_CONFIG )
+		*cfg = framemanager.pending_config;
+	else
+		*cfg = framemanager.config;
+
+	dv_restore(is);
+}
+
+/* fm_Request() - request a change to the experiment
+ *
+ * Called from background (idle) level. The request is merged with any that are still pending.
+ * The requests are applied together at the next round boundary in main_FrameEnd(), so that
+ * a round always runs with a consistent configuration.
+ * If the frame manager is stopped there's no round boundary to wait for, so the requests are applied immediately.
+*/
+void fm_Request(dv_u32_t req, const struct fm_config_s *cfg)
+{
+	/* Without a complete schedule there's nothing to start
+	*/
+	if ( (req & FM_REQ_START) && !fm_schedule.allocated )
+	{
+		dv_printf("fm_Request: the schedule hasn't been built - can't start\n");
+		req &= ~FM_REQ_START;
+	}
+
+	dv_intstatus_t is = dv_disable();
+
+	if ( req & FM_REQ_CONFIG )
+		framemanager.pending_config = *cfg;
+
+	/* The most recent of start/stop wins
+	*/
+	if ( req & (FM_REQ_START | FM_REQ_STOP) )
+		framemanager.requests &= ~(FM_REQ_START | FM_REQ_STOP);
+
+	framemanager.requests |= req;
+
+	if ( framemanager.stopped )
+		fm_ApplyRequests();
+
+	dv_restore(is);
+}
+
+/* fm_ApplyRequests() - apply the pending requests
+ *
+ * Called at a round boundary, or with interrupts disabled when stopped.
+*/
+void fm_ApplyRequests(void)
+{
+	dv_u32_t req = framemanager.requests;
+	framemanager.requests = 0;
+
+	if ( req & FM_REQ_CONFIG )
+	{
+		if ( framemanager.pending_config.trace != framemanager.config.trace )
+			fm_TraceSet(framemanager.pending_config.trace);
+
+		framemanager.config = framemanager.pending_config;
+	}
+
+	if ( req & FM_REQ_BUDGET )
+	{
+		for ( dv_qty_t i = 0; i < framemanager.n_pending_budgets; i++ )
+		{
+			struct budgetreq_s *b = &framemanager.pending_budgets[i];
+
+			framemanager.modes[b->mode].frames[b->frame].jobs[b->job].budget = b->us;
+		}
+		framemanager.n_pending_budgets = 0;
+		framemanager.admit = 1;
+	}
+
+	if ( req & FM_REQ_RESET )
+	{
+		fm_ResetStats();
+	}
+
+	if ( req & FM_REQ_STOP )
+	{
+		framemanager.stopped = 1;
+	}
+
+	if ( req & FM_REQ_START )
+	{
+		/* When running, this is a round boundary and the timer is already in the new round
+		*/
+		if ( framemanager.stopped )
+		{
+			framemanager.tick_frame = 0;
+			framemanager.start_frame = 0;
+			framemanager.latched_mode = framemanager.mode;
+		}
+		framemanager.rounds = 0;
+		fm_ResetStats();
+		framemanager.next_frame = 0;
+		framemanager.mode_switched = 0;
+		framemanager.stopped = 0;
+	}
+}
+
+/* fm_CacheMaintenance() - performs the configured cache/TLB maintenance
+*/
+FM_HOT_TEXT void fm_CacheMaintenance(enum fm_frameLocation_e where)
+{
+	struct cacheop_s *op = &framemanager.config.cacheop;
+
+	if ( framemanager.config.whereCacheMaintenance == where )
+	{
+		fm_TraceNow(FM_EV_CACHESTART, framemanager.next_frame, where, -1);
+
+		if ( op->icache || op->dcache || op->prefetch || op->branchpredict || op->tlb || op->scratchclean )
+			framemanager.epoch++;
+
+		if ( op->icache )
+		{
+			dv_invalidate_entire_instruction_cache();
+		}
+
+		if ( op->dcache )
+		{
+			dv_clean_entire_data_cache();
+		}
+
+		if ( op->prefetch )
+		{
+			dv_flush_prefetch_buffer();
+		}
+
+		if ( op->branchpredict )
+		{
+			dv_flush_entire_branch_target_cache();
+		}
+
+		if ( op->tlb )
+		{
+			hw_InvalidateTlb();
+		}
+
+		/* The scratch arena: clean first, so that both together warm it from memory
+		*/
+		if ( op->scratchclean )
+		{
+			fm_ScratchClean();
+		}
+
+		if ( op->scratchwarm )
+		{
+			fm_ScratchWarm();
+		}
+
+		fm_TraceNow(FM_EV_CACHEEND, framemanager.next_frame, where, -1);
+	}
+}
+
+/* fm_ComputeTimes() - computes the timing for the current frame.
+ *
+ * Called at the end of each frame
+ * Calculates:
+ *	- for frame:
+ *		- act_interval		- time from previous activation to current activation
+ *		- start_interval	- time from previous start to current start
+ *		- latency			- time from activation to start
+ *		- exectime			- time from start to end of the last job
+ *	- for the first frame after a mode switch:
+ *		- first_exectime	- as exectime, but kept separately to show the disturbance
+ *	- for frames and jobs, separated into the first execution after cache maintenance, reset or
+ *	  mode switch (cold) and the others (steady):
+ *		- exectime_cold, exectime_steady, runtime_cold, runtime_steady
+ *
+ * Apart from the cold statistics, nothing is recorded during the warm-up rounds.
+ *	- for each job that ran (the rest of the frame can be skipped after a budget overrun):
+ *		- latency			- time from end of previous job to start of job
+ *		- runtime			- time from start to end
+ *		- net_runtime		- runtime without the time spent in the instrumented ISRs
+ *		- isr_time			- the time spent in the instrumented ISRs (interference)
+ *		- interval			- time from previous start to current start
+ *	- the bytes of scratch memory that the jobs allocated, whether warm or not
+ *
+ * Finally the frame is passed to the flight recorder.
+*/
+FM_HOT_TEXT void fm_ComputeTimes(void)
+{
+	dv_id_t f = framemanager.current_frame;
+	struct frame_s *fr = &framemanager.mode->frames[f];
+	dv_u32_t icache_misses = hw_ReadICacheMisses() - fr->icache_start;
+	dv_id_t n_done = framemanager.jobs_done;
+	dv_u64_t end_time = (n_done > 0) ? fr->jobs[n_done-1].end_time : fr->start_time;
+	dv_u64_t exectime = end_time - fr->start_time;
+	int warm = (framemanager.rounds >= framemanager.warmup_end);
+	int cold = (fr->epoch != framemanager.epoch);
+
+	framemanager.round_total += exectime;
+	if ( framemanager.round_max < exectime )
+		framemanager.round_max = exectime;
+
+	/* Cold executions are always recorded in the cold statistics.
+	 * Everything else is ignored until the warm-up rounds have passed.
+	*/
+	if ( cold )
+		fm_StoreValue(&fr->exectime_cold, exectime);
+	else
+	if ( warm )
+		fm_StoreValue(&fr->exectime_steady, exectime);
+	fr->epoch = framemanager.epoch;
+
+	if ( framemanager.mode_switched )
+	{
+		fm_StoreValue(&framemanager.mode->first_exectime, exectime);
+		framemanager.mode_switched = 0;
+	}
+
+	if ( warm )
+	{
+		fm_StoreTime(&fr->act_interval, fr->prev_activation_time, fr->activation_time);
+		fm_StoreTime(&fr->start_interval, fr->prev_start_time, fr->start_time);
+		fm_StoreTime(&fr->latency, fr->activation_time, fr->start_time);
+		fm_StoreValue(&fr->exectime, exectime);
+		fm_StoreValue(&fr->icache_misses, icache_misses);
+	}
+
+	fr->prev_activation_time = fr->activation_time;
+	fr->prev_start_time = fr->start_time;
+
+	for ( dv_id_t j = 0; j < n_done; j++)
+	{
+		struct job_s *job = &fr->jobs[j];
+		dv_u64_t runtime = job->end_time - job->start_time;
+
+		/* For the first job, the latency is the time from the frame start
+		*/
+		dv_u64_t t_prev = (j == 0) ? fr->start_time : fr->jobs[j-1].end_time;
+
+		if ( job->epoch != framemanager.epoch )
+			fm_StoreValue(&job->runtime_cold, runtime);
+		else
+		if ( warm )
+			fm_StoreValue(&job->runtime_steady, runtime);
+		job->epoch = framemanager.epoch;
+
+		if ( warm )
+		{
+			fm_StoreTime(&job->latency, t_prev, job->start_time);
+#ifdef FM_NSAMPLES
+			fm_StoreSample((dv_u32_t)framemanager.rounds, f, j, job, fr->activation_time);
+#endif
+			fm_StoreValue(&job->runtime, runtime);
+			fm_StoreValue(&job->net_runtime, runtime - job->interference);
+			fm_StoreValue(&job->isr_time, job->interference);
+			fm_StoreTime(&job->interval, job->prev_start_time, job->start_time);
+		}
+
+		job->prev_start_time = job->start_time;
+	}
+
+	/* No intervals across a skipped job
+	*/
+	for ( dv_id_t j = n_done; j < fr->n_jobs; j++ )
+	{
+		fr->jobs[j].prev_start_time = 0;
+	}
+
+#ifdef FM_SCRATCHSIZE
+	fm_StoreValue(&fr->scratch, fm_scratch.used);
+	if ( fm_scratch.max_used < fm_scratch.used )
+		fm_scratch.max_used = fm_scratch.used;
+#endif
+
+	fm_FlightRecord(f, fr, n_done, end_time, warm, cold);
+}
+
+/* fm_U64String() - convert a 64-bit value to decimal in buf (at least 21 characters). Returns buf.
+ *
+ * For times that can exceed 32 bits; dv_printf() has no 64-bit conversion.
+*/
+static char *fm_U64String(dv_u64_t v, char *buf)
+{
+	char tmp[20];
+	int n = 0;
+	int i = 0;
+
+	do {
+		tmp[n++] = '0' + (v % 10);
+		v /= 10;
+	} while ( v != 0 );
+
+	while ( n > 0 )
+		buf[i++] = tmp[--n];
+	buf[i] = '\0';
+
+	return buf;
+}
+
+/* fm_PrintTimes() - print the contents of a timing structure
+ *
+ * Waits for room in the uart buffer first, so that long results aren't truncated.
+ *
+*/
+void fm_PrintTimes(struct timing_s *t, char *descr, char *obj, dv_id_t id)
+{
+	if ( t->n <= 0 )
 		return;
 
 	dv_u64_t mean = (t->t_sum + (t->n/2)) / t->n;
 
-	dv_u32_t mean32 = (mean > 0xffffffff) ? 0xffffffff : mean;
-	dv_u32_t min32 = (t->t_min > 0xffffffff) ? 0xffffffff : t->t_min;
-	dv_u32_t max32 = (t->t_max > 0xffffffff) ? 0xffffffff : t->t_max;
+	dv_u32_t mean32 = fm_Clip32(mean);
+	dv_u32_t min32 = fm_Clip32(t->t_min);
+	dv_u32_t max32 = fm_Clip32(t->t_max);
 
+	ub_WaitSpace(128);
 	dv_printf("%s times for %s %d: min %u, mean %u, max %u\n", descr, obj, id, min32, mean32, max32);
 }
 
+/* fm_PrintSTimes() - print the contents of a signed timing structure
+*/
+void fm_PrintSTimes(struct stiming_s *t, char *descr, char *obj, dv_id_t id)
+{
+	if ( t->n <= 0 )
+		return;
+
+	ub_WaitSpace(128);
+	dv_printf("%s times for %s %d: min %d, mean %d, max %d\n", descr, obj, id,
+				fm_ClipS32(t->s_min), fm_ClipS32(t->s_sum / (dv_i64_t)t->n), fm_ClipS32(t->s_max));
+}
+
+/* fm_PrintConfig() - print the current configuration
+ *
+ * The format is also used by the host-side tools to tag the results of a run.
+*/
+void fm_PrintConfig(void)
+{
+	struct cacheop_s *op = &framemanager.config.cacheop;
+	char ops[8];
+	int n = 0;
+
+	if ( op->icache )			ops[n++] = 'i';
+	if ( op->dcache )			ops[n++] = 'd';
+	if ( op->prefetch )			ops[n++] = 'p';
+	if ( op->branchpredict )	ops[n++] = 'b';
+	if ( op->tlb )				ops[n++] = 't';
+	if ( op->scratchclean )		ops[n++] = 'c';
+	if ( op->scratchwarm )		ops[n++] = 'w';
+	if ( n == 0 )				ops[n++] = '-';
+	ops[n] = '\0';
+
+	dv_printf("Config: mode %s where %s ops %s rounds %u ignore %u trace %s budget %s idle %s\n", framemanager.mode->name,
+		fm_whereNames[framemanager.config.whereCacheMaintenance], ops, framemanager.config.nrounds,
+		framemanager.config.ignorerounds, fm_traceNames[framemanager.config.trace],
+		fm_budgetNames[framemanager.config.budget], fm_idleNames[framemanager.config.idle]);
+}
+
+/* fm_Poll() - print the results when a run has finished, and repeat the admission check after a budget change
+ *
+ * Called from the idle loop, so the frame that ended the run has finished and no job is held up
+ * while the output waits for the uart.
+*/
+void fm_Poll(void)
+{
+	if ( framemanager.print )
+	{
+		framemanager.print = 0;
+		fm_PrintResults();
+	}
+
+	if ( framemanager.admit )
+	{
+		framemanager.admit = 0;
+		fm_CheckSchedule(0);
+	}
+}
+
 /* fm_PrintResults() - print all the timing at the end of the run
  *
+ * The output goes into the uart buffer. Each line waits for room in the buffer (ub_WaitSpace()), so
+ * nothing is dropped but the caller is held up while the uart catches up. That's why the end of a run
+ * only sets a flag and the results are printed by fm_Poll() from the idle loop.
 */
 void fm_PrintResults(void)
 {
 	dv_id_t f, j;
 
-	/* First the frame timings
+	if ( !fm_schedule.allocated )
+	{
+		dv_printf("fm_PrintResults: the schedule hasn't been built\n");
+		return;
+	}
+
+	fm_PrintConfig();
+	dv_printf("Rounds %u, overruns %d, lost ticks %d, budget overruns %d\n", (dv_u32_t)framemanager.rounds,
+				framemanager.n_overruns, framemanager.n_lost, framemanager.n_budget_overruns);
+	fm_PrintTimes(&framemanager.detection, "Budget detection", "mode", framemanager.mode - framemanager.modes);
+
+	for ( dv_id_t m = 0; m < framemanager.n_modes; m++ )
+	{
+		struct mode_s *md = &framemanager.modes[m];
+
+		if ( md->rounds == 0 && md != framemanager.mode )
+			continue;
+
+		ub_WaitSpace(64);
+		dv_printf("Mode %d (%s): %u rounds, %d switches to this mode\n", m, md->name, (dv_u32_t)md->rounds, md->n_switches);
+		fm_PrintTimes(&md->switch_latency, "Mode switch latency", "mode", m);
+		fm_PrintTimes(&md->first_latency, "First frame latency", "mode", m);
+		fm_PrintTimes(&md->first_exectime, "First frame exec", "mode", m);
+
+		/* First the frame timings
+		*/
+		for ( f = 0; f <= md->max_frame; f++ )
+		{
+			fm_PrintTimes(&md->frames[f].act_interval, "Activation interval", "frame", f); 
+			fm_PrintSTimes(&md->frames[f].act_error, "Activation error", "frame", f);
+			fm_PrintTimes(&md->frames[f].start_interval, "Start interval", "frame", f); 
+			fm_PrintTimes(&md->frames[f].latency, "Latency", "frame", f); 
+			fm_PrintTimes(&md->frames[f].exectime, "Execution", "frame", f); 
+			fm_PrintTimes(&md->frames[f].exectime_cold, "Execution (cold)", "frame", f);
+			fm_PrintTimes(&md->frames[f].icache_misses, "I-cache misses", "frame", f);
+			fm_PrintTimes(&md->frames[f].exectime_steady, "Execution (steady)", "frame", f);
+			ub_WaitSpace(192);
+			if ( md->frames[f].n_overruns != 0 || md->frames[f].n_skips != 0 || md->frames[f].n_missed != 0 )
+				dv_printf("Overruns for frame %d: %d, skipped %d, missed %d\n", f, md->frames[f].n_overruns,
+							md->frames[f].n_skips, md->frames[f].n_missed);
+#ifdef FM_SCRATCHSIZE
+			if ( md->frames[f].scratch.t_max != 0 || md->frames[f].n_scratch_failed != 0 )
+				dv_printf("Scratch for frame %d: high-water %u bytes, mean %u, %d failed allocations\n", f,
+							fm_Clip32(md->frames[f].scratch.t_max),
+							fm_Clip32(md->frames[f].scratch.t_sum / md->frames[f].scratch.n), md->frames[f].n_scratch_failed);
+#endif
+		}
+
+		/* The frame release over all the frames, for comparing the idle strategies
+		*/
+		struct timing_s release_latency;
+		struct stiming_s release_error;
+
+		fm_InitTime(&release_latency);
+		fm_InitSTime(&release_error);
+		for ( f = 0; f <= md->max_frame; f++ )
+		{
+			fm_MergeTimes(&release_latency, &md->frames[f].latency);
+			fm_MergeSTimes(&release_error, &md->frames[f].act_error);
+		}
+		fm_PrintTimes(&release_latency, "Release latency", "mode", m);
+		fm_PrintSTimes(&release_error, "Release error", "mode", m);
+
+		/* Then the individual job timings
+		*/
+		for ( f = 0; f <= md->max_frame; f++ )
+		{
+			ub_WaitSpace(64);
+			dv_printf("Job timings for frame %d:\n", f);
+			for ( j = 0; j < md->frames[f].n_jobs; j++)
+			{
+				fm_PrintTimes(&md->frames[f].jobs[j].interval, "  Interval", "job", j);
+				fm_PrintTimes(&md->frames[f].jobs[j].runtime,  "  Runtime", "job", j);
+				fm_PrintTimes(&md->frames[f].jobs[j].net_runtime,  "  Net runtime", "job", j);
+				fm_PrintTimes(&md->frames[f].jobs[j].isr_time,  "  Interference", "job", j);
+				fm_PrintTimes(&md->frames[f].jobs[j].runtime_cold,  "  Runtime (cold)", "job", j);
+				fm_PrintTimes(&md->frames[f].jobs[j].runtime_steady,  "  Runtime (steady)", "job", j);
+				fm_PrintTimes(&md->frames[f].jobs[j].latency,  "  Latency", "job", j);
+				if ( md->frames[f].jobs[j].budget != 0 )
+				{
+					ub_WaitSpace(64);
+					dv_printf("  Budget for job %d: %u us, %d overruns\n", j,
+								md->frames[f].jobs[j].budget, md->frames[f].jobs[j].n_budget_overruns);
+					fm_PrintTimes(&md->frames[f].jobs[j].detection,  "  Budget detection", "job", j);
+				}
+			}
+			dv_printf("\n");
+		}
+	}
+
+	for ( int i = 0; i < fm_isrTable.n_isrs; i++ )
+	{
+		ub_WaitSpace(64);
+		dv_printf("ISR %d: %s\n", i, fm_isrTable.isrs[i].name);
+		fm_PrintTimes(&fm_isrTable.isrs[i].exectime, "Execution", "isr", i);
+	}
+	dv_printf("\n");
+
+	for ( int i = 0; i < fm_workTable.n_work; i++ )
+	{
+		struct work_s *w = &fm_workTable.work[i];
+
+		ub_WaitSpace(128);
+		dv_printf("Work %d (%s): %u slices, %d completed, next slice %u\n", i, w->name,
+					w->n_slices, w->n_completed, w->slice);
+		fm_PrintTimes(&w->slice_time, "Slice", "work", i);
+		fm_PrintTimes(&w->completion, "Completion", "work", i);
+		fm_PrintTimes(&w->frames, "Frames spanned", "work", i);
+	}
+	if ( fm_workTable.n_work != 0 )
+		dv_printf("\n");
+
+	for ( int i = 0; i < fm_channelTable.n_channels; i++ )
+	{
+		struct channel_s *c = &fm_channelTable.channels[i];
+
+		ub_WaitSpace(128);
+		dv_printf("Channel %d (%s): %u bytes, swapped every %s, %d swaps, %d mismatches\n", i, c->name,
+					c->size, (c->where == fm_atRoundStart) ? "round" : "frame", c->n_swaps, c->n_mismatches);
+		fm_PrintTimes(&c->age, "Data age", "channel", i);
+	}
+	if ( fm_channelTable.n_channels != 0 )
+	{
+		fm_PrintTimes(&fm_channelTable.swap_time, "Swap", "channels", fm_channelTable.n_channels);
+		dv_printf("\n");
+	}
+
+	fm_PrintTrend();
+
+#ifdef FM_NSAMPLES
+	fm_PrintSamples();
+#endif
+
+	ub_PrintStats();
+}
+
+#ifdef FM_NSAMPLES
+/* fm_PrintSamples() - print the sample buffer
+ *
+ * One line per job execution: "S round mode frame job latency runtime"
+ * The latency is from the job's release to its start (see fm_StoreSample()), unlike the job latency
+ * in the results. The format is parsed by the host-side tools in the tools directory.
+*/
+void fm_PrintSamples(void)
+{
+	dv_printf("Samples: %d (%d dropped)\n", samplebuffer.n_samples, samplebuffer.n_dropped);
+
+	for ( int i = 0; i < samplebuffer.n_samples; i++ )
+	{
+		struct sample_s *s = &samplebuffer.samples[i];
+
+		ub_WaitSpace(64);
+		dv_printf("S %u %d %d %d %u %u\n", s->round, s->mode, s->frame, s->job, s->latency, s->runtime);
+	}
+	dv_printf("\n");
+}
+#endif
+
+/* fm_PrintTrend() - print the per-round trend and the round at which the steady state was reached
+ *
+ * One line per round: "R round total max" (ticks).
+*/
+void fm_PrintTrend(void)
+{
+	dv_qty_t n = trendbuffer.n_rounds;
+	dv_u32_t sorted[FM_TRENDROUNDS/2 + 1];
+	dv_qty_t ns = 0;
+
+	dv_printf("Trend: %d rounds (warm-up %u)\n", n, framemanager.config.ignorerounds);
+
+	for ( dv_qty_t r = 0; r < n; r++ )
+	{
+		ub_WaitSpace(64);
+		dv_printf("R %d %u %u\n", r, trendbuffer.rounds[r].total, trendbuffer.rounds[r].max);
+	}
+
+	if ( n < 4 )
+		return;
+
+	/* Reference: median of the second half (insertion sort; there aren't many)
 	*/
-	for ( f = 0; f <= framemanager.max_frame; f++ )
+	for ( dv_qty_t r = n/2; r < n; r++ )
 	{
-		fm_PrintTimes(&framemanager.frames[f].act_interval, "Activation interval", "frame", f); 
-		fm_PrintTimes(&framemanager.frames[f].start_interval, "Start interval", "frame", f); 
-		fm_PrintTimes(&framemanager.frames[f].latency, "Latency", "frame", f); 
+		dv_u32_t v = trendbuffer.rounds[r].total;
+		dv_qty_t i = ns++;
+
+		while ( i > 0 && sorted[i-1] > v )
+		{
+			sorted[i] = sorted[i-1];
+			i--;
+		}
+		sorted[i] = v;
 	}
 
-	/* Then the individual job timings
+	dv_u32_t ref = sorted[ns/2];
+	dv_u32_t tol = (dv_u32_t)(((dv_u64_t)ref * FM_STEADYPERMILLE) / 1000);
+	dv_qty_t steady = n;
+
+	/* Find the first round from which all rounds are within the tolerance
 	*/
-	for ( f = 0; f <= framemanager.max_frame; f++ )
+	while ( steady > 0 )
+	{
+		dv_u32_t v = trendbuffer.rounds[steady-1].total;
+		if ( ((v > ref) ? (v - ref) : (ref - v)) > tol )
+			break;
+		steady--;
+	}
+
+	dv_printf("Steady state (within %d/1000 of %u) from round %d\n", FM_STEADYPERMILLE, ref, steady);
+	dv_printf("\n");
+}
+
+/* fm_PrintTrace() - print the event trace
+ *
+ * One line per event: "T time core type mode frame job task", oldest first. type is one of the
+ * FM_EV_ letters and time is in ticks from the first event (64 bits, so long traces don't wrap). The format is parsed by tools/trace2json.py.
+ * Called from the idle loop. Recording is suspended during printing. Each line waits for space in
+ * the uart buffer, so nothing is dropped.
+*/
+void fm_PrintTrace(void)
+{
+#ifdef FM_TRACE
+	int was_enabled = tracebuffer.enabled;
+	dv_u32_t first = (tracebuffer.head > FM_TRACE) ? (tracebuffer.head - FM_TRACE) : 0;
+
+	tracebuffer.enabled = 0;
+
+	dv_u64_t t0 = tracebuffer.events[first % FM_TRACE].time;
+
+	dv_printf("Trace: %u events (%u lost)\n", tracebuffer.head - first, first);
+
+	for ( dv_u32_t i = first; i < tracebuffer.head; i++ )
+	{
+		struct trace_s *e = &tracebuffer.events[i % FM_TRACE];
+
+		char t[24];
+
+		ub_WaitSpace(64);
+		dv_printf("T %s %d %c %d %d %d %d\n", fm_U64String(e->time - t0, t),
+					e->core, e->type, e->mode, e->frame, e->job, e->task);
+	}
+	dv_printf("\n");
+
+	tracebuffer.enabled = was_enabled;
+#else
+	dv_printf("Trace not configured (FM_TRACE)\n");
+#endif
+}
+
+#ifdef FM_FLIGHT
+/* fm_PrintFlightFlags() - print the names of the flags, separated by commas
+*/
+static void fm_PrintFlightFlags(dv_u8_t flags)
+{
+	const char *sep = "";
+
+	for ( int i = 0; i < FM_NFLIGHTFLAGS; i++ )
 	{
-		dv_printf("Job timings for frame %d:\n", f);
-		for ( j = 0; j < framemanager.frames[f].n_jobs; j++)
+		if ( flags & (1u << i) )
 		{
-			fm_PrintTimes(&framemanager.frames[f].jobs[j].interval, "  Interval", "job", j);
-			fm_PrintTimes(&framemanager.frames[f].jobs[j].runtime,  "  Runtime", "job", j);
-			fm_PrintTimes(&framemanager.frames[f].jobs[j].latency,  "  Latency", "job", j);
+			dv_printf("%s%s", sep, fm_flightFlagNames[i]);
+			sep = ",";
 		}
+	}
+	if ( flags == 0 )
+		dv_printf("-");
+}
+#endif
+
+/* fm_FlightArm() - arm (on) or stop (off) the flight recorder
+ *
+ * Arming discards the history and waits for the next trip.
+*/
+void fm_FlightArm(int on)
+{
+#ifdef FM_FLIGHT
+	dv_intstatus_t is = dv_disable();
+
+	flightrecorder.state = FM_FLIGHT_OFF;
+
+	if ( on )
+	{
+		flightrecorder.head = 0;
+		flightrecorder.stop_at = 0;
+		flightrecorder.n_trips = 0;
+		flightrecorder.pending = 0;
+		flightrecorder.state = FM_FLIGHT_ARMED;
+	}
+
+	dv_restore(is);
+#else
+	dv_printf("Flight recorder not configured (FM_FLIGHT)\n");
+#endif
+}
+
+/* fm_FlightMargin() - set the margin above the p99 estimates, in microseconds
+*/
+void fm_FlightMargin(dv_u32_t us)
+{
+#ifdef FM_FLIGHT
+	flightrecorder.margin = us * hw_TicksPerMicrosecond;
+#else
+	dv_printf("Flight recorder not configured (FM_FLIGHT)\n");
+#endif
+}
+
+/* fm_FlightPoll() - print the history when the recorder has frozen. Called from the idle loop.
+*/
+void fm_FlightPoll(void)
+{
+#ifdef FM_FLIGHT
+	if ( flightrecorder.state == FM_FLIGHT_FROZEN )
+	{
+		fm_PrintFlight();
+		flightrecorder.state = FM_FLIGHT_PRINTED;
+	}
+#endif
+}
+
+/* fm_PrintFlight() - print the flight recorder's history
+ *
+ * One line per frame, oldest first:
+ *	"H count mode frame flags activation start end n_jobs start0 end0 start1 end1 ..."
+ * activation is the time of the frame's activation in ticks from the activation of the frame that
+ * tripped the recorder (or of the oldest frame); the other times are in ticks from the frame's own
+ * activation. Only the first FM_FLIGHTJOBS jobs are shown. The configuration is printed with the
+ * history, so that a trip caused by the cache maintenance can be recognised.
+ * Recording is suspended during printing. Each line waits for space in the uart buffer.
+*/
+void fm_PrintFlight(void)
+{
+#ifdef FM_FLIGHT
+	struct flightrecorder_s *fl = &flightrecorder;
+	static const char * const stateNames[] = { "off", "armed", "tripped", "frozen", "printed" };
+	int state = fl->state;
+	dv_u32_t first = (fl->head > FM_FLIGHT) ? (fl->head - FM_FLIGHT) : 0;
+
+	fl->state = FM_FLIGHT_OFF;
+
+	dv_printf("Flight recorder: %s, margin %u us, %u trips\n", stateNames[state],
+				fl->margin / hw_TicksPerMicrosecond, fl->n_trips);
+
+	if ( fl->head == first )
+	{
+		fl->state = state;
+		return;
+	}
+
+	dv_u64_t t0 = fl->frames[first % FM_FLIGHT].activation_time;
+
+	if ( state == FM_FLIGHT_TRIPPED || state == FM_FLIGHT_FROZEN || state == FM_FLIGHT_PRINTED )
+	{
+		struct flightframe_s *t = &fl->frames[fl->trip_at % FM_FLIGHT];
+
+		t0 = t->activation_time;
+		dv_printf("Trip: ");
+		fm_PrintFlightFlags(fl->trip_flags);
+		dv_printf(" in frame %u (mode %s frame %d job %d): %u ticks, p99 estimate %u\n", t->count,
+					framemanager.modes[t->mode].name, t->frame, fl->trip_job, fl->trip_value, fl->trip_p99);
+	}
+	fm_PrintConfig();
+
+	dv_printf("Flight: %u frames (%u lost)\n", fl->head - first, first);
+
+	for ( dv_u32_t i = first; i < fl->head; i++ )
+	{
+		struct flightframe_s *r = &fl->frames[i % FM_FLIGHT];
+
+		ub_WaitSpace(64 + 24 * FM_FLIGHTJOBS);
+		dv_printf("H %u %d %d 0x%02x %d %u %u %d", r->count, r->mode, r->frame, r->flags,
+					(dv_i32_t)(dv_i64_t)(r->activation_time - t0), r->start, r->end, r->n_jobs);
+
+		for ( int j = 0; j < r->n_jobs && j < FM_FLIGHTJOBS; j++ )
+			dv_printf(" %u %u", r->job_start[j], r->job_end[j]);
 		dv_printf("\n");
 	}
+	dv_printf("\n");
+
+	fl->state = state;
+#else
+	dv_printf("Flight recorder not configured (FM_FLIGHT)\n");
+#endif
 }
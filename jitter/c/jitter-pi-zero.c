@@ -15,6 +15,9 @@
 #include <dv-armv6-mmu.h>
 #include <dv-arm-cp15.h>
 #include <dv-arm-bcm2835-armtimer.h>
+#include <mmu.h>
+
+#include TARGET_HDR
 
 extern int main(int argc, char **argv);
 
@@ -50,7 +53,11 @@ void dv_board_start(void)
 
 	/* Set up the MMU
 	*/
+#if MMU_GRANULE == MMU_DAVROSKA
 	dv_armv6_mmu_setup();
+#else
+	mmu_Setup(1);
+#endif
 
 	/* Caches
 	*/
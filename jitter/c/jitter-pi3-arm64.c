@@ -14,6 +14,10 @@
 #include <dv-arm-bcm2835-interruptcontroller.h>
 #include <dv-armv8-mmu.h>
 #include <dv-arm-bcm2835-armtimer.h>
+#include <mmu.h>
+#include <multicore.h>
+
+#include TARGET_HDR
 
 extern dv_u64_t dv_c1_stack_top, dv_c2_stack_top, dv_c3_stack_top;
 
@@ -50,7 +54,11 @@ void dv_board_start(void)
 
 	/* Set up the MMU
 	*/
+#if MMU_GRANULE == MMU_DAVROSKA
 	dv_armv8_mmu_setup(1);
+#else
+	mmu_Setup(1);
+#endif
 
 	/* Enable four GPIO pins for the LEDs.
     */
@@ -141,39 +149,6 @@ static void dv_init_core(void)
 	}
 }
 
-volatile char core_state[] = "----";
-const char cstatevals[] = "-/|\\";
-
-void run_core(int core, dv_u64_t delay)
-{
-	dv_u64_t then = dv_readtime();
-
-	delay = delay/500;
-
-	dv_printf("run_core(%d) reached\n", core);
-	for (;;)
-	{
-		for ( int i = 0; i < 4; i++ )
-		{
-			core_state[core] = cstatevals[i];
-#if 0
-			dv_printf("\nrun_core(%d) --- %c %lu\n", core, core_state[core], then);
-#endif
-
-			dv_u64_t now;
-
-			do {
-				now = dv_readtime();
-#if 0
-				dv_printf(" now = %lu\n", now);
-#endif
-			} while ( (now - then) < delay );
-
-			then = now;
-		}
-	}
-}
-
 /* dv_core1_start() - core 1 starts here
 */
 void dv_core1_start(void)
@@ -189,9 +164,13 @@ void dv_core1_start(void)
 	dv_printf("pi-3-arm64 starting core 1 ...\n");
 
 	dv_init_core();
+#if MMU_GRANULE == MMU_DAVROSKA
 	dv_armv8_mmu_setup(0);
+#else
+	mmu_Setup(0);
+#endif
 
-	run_core(1, 200000000);
+	mc_Worker(1);
 
 	for (;;)
 	{
@@ -213,9 +192,13 @@ void dv_core2_start(void)
 	dv_printf("pi-3-arm64 starting core 2 ...\n");
 
 	dv_init_core();
+#if MMU_GRANULE == MMU_DAVROSKA
 	dv_armv8_mmu_setup(0);
+#else
+	mmu_Setup(0);
+#endif
 
-	run_core(2, 250000000);
+	mc_Worker(2);
 
 	for (;;)
 	{
@@ -237,9 +220,13 @@ void dv_core3_start(void)
 	dv_printf("pi-3-arm64 starting core 3 ...\n");
 
 	dv_init_core();
+#if MMU_GRANULE == MMU_DAVROSKA
 	dv_armv8_mmu_setup(0);
+#else
+	mmu_Setup(0);
+#endif
 
-	run_core(3, 300000000);
+	mc_Worker(3);
 
 	for (;;)
 	{
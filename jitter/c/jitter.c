@@ -12,6 +12,12 @@
 #include <dv-stdio.h>
 #include <dv-string.h>
 #include <frame-manager.h>
+#include <rm-manager.h>
+#include <uart-buffer.h>
+#include <command.h>
+#include <mmu.h>
+#include <osbench.h>
+#include <event-server.h>
 
 /* This include file selects the hardware type
 */
@@ -38,98 +44,312 @@
  * These messages are sent as a somewhat irregular rate that is generated by changing the return value
  * of the alarm trigger function that sends the event.
 */
+/* The tasks are the same for both schedulers (make SCHED=frame|rm). TaskStart() and TaskEnd() are the
+ * selected scheduler's instrumentation; with the frame manager, TaskEnd() chains the next job in the frame.
+ * With rate-monotonic scheduling the priorities follow the periods.
+*/
+#if SCHED_RM
+#define TaskStart(t)	rm_TaskStart(t)
+#define TaskEnd(t)		rm_TaskEnd(t)
+#define StatsRecording()	rm_StatsRecording()
+#define StatsResets()		rm_StatsResets()
+#define JobAborted()	0
+#define PRIO_T5			4
+#define PRIO_T10		3
+#define PRIO_T20		2
+#define PRIO_TLONG		1
+#define PRIO_TEVENT		3
+#else
+#define TaskStart(t)	fm_TaskStart()
+#define TaskEnd(t)		fm_TaskEnd()
+#define StatsRecording()	fm_StatsRecording()
+#define StatsResets()		fm_StatsResets()
+#define JobAborted()	fm_JobAborted()
+#define PRIO_T5			4
+#define PRIO_T10		4
+#define PRIO_T20		4
+#define PRIO_TLONG		4
+#define PRIO_TEVENT		4
+#endif
+
 /* Object identifiers
 */
-dv_id_t T5a, T5b, T10a, T10b, T20a, T20b, T20c, T20d;	/* Tasks */
-dv_id_t Timer;			/* ISRs */
+dv_id_t T5a, T5b, T10a, T10b, T20a, T20b, T20c, T20d, TLong, TEvent;	/* Tasks */
+dv_id_t LongWork;	/* Resumable job (fm_AddWork()) */
+dv_id_t LongResult;	/* LET channel (fm_AddChannel()) */
+dv_id_t Timer, Uart, Budget, Event;	/* ISRs */
+dv_id_t TimerAcct, UartAcct, BudgetAcct, EventAcct;	/* ISR accounting (fm_AddIsr()) */
+dv_id_t SynthEvents, UartEvents;	/* Event sources (es_AddSource()) */
+
+/* For the experiment: bytes of working memory that each 20ms task takes from the frame manager's scratch
+ * arena (fm_ScratchAlloc()) and fills, so that the scratch cache operations ("ops c", "ops w") have
+ * something to act on. 0 = none; the tasks are empty. Frame scheduler only: with SCHED=rm nothing
+ * empties the arena.
+*/
+#define JOB_SCRATCH		0
+
+#if JOB_SCRATCH && !SCHED_RM
+static inline void job_Scratch(dv_u32_t seed)
+{
+	dv_u32_t *buf = fm_ScratchAlloc(JOB_SCRATCH);
+
+	if ( buf != 0 )
+	{
+		for ( dv_u32_t i = 0; i < JOB_SCRATCH/sizeof(dv_u32_t); i++ )
+			buf[i] = seed + i;
+	}
+}
+#else
+#define job_Scratch(seed)	do { } while (0)
+#endif
 
 /* main_T5a() - task body function for the 5ms 'a' task (start of every frame)
 */
-void main_T5a(void)
+FM_HOT_TEXT void main_T5a(void)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	TaskStart(T5a);
+	TaskEnd(T5a);
 }
 
 /* main_T5b() - task body function for the 5ms 'b' task (end of every frame)
 */
-void main_T5b(void)
+FM_HOT_TEXT void main_T5b(void)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	TaskStart(T5b);
+	TaskEnd(T5b);
 }
 
 /* main_T10a() - task body function for the 10ms 'a' task (even frames)
 */
-void main_T10a(void)
+FM_HOT_TEXT void main_T10a(void)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	TaskStart(T10a);
+	TaskEnd(T10a);
 }
 
 /* main_T10b() - task body function for the 10ms 'b' task (odd frames)
 */
-void main_T10b(void)
+FM_HOT_TEXT void main_T10b(void)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	TaskStart(T10b);
+	TaskEnd(T10b);
 }
 
 /* main_T20a() - task body function for the 10ms 'a' task (frame 0)
 */
-void main_T20a(void)
+FM_HOT_TEXT void main_T20a(void)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	TaskStart(T20a);
+	job_Scratch(0);
+	TaskEnd(T20a);
 }
 
 /* main_T20b() - task body function for the 10ms 'b' task (frame 1)
 */
-void main_T20b(void)
+FM_HOT_TEXT void main_T20b(void)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	TaskStart(T20b);
+	job_Scratch(1);
+	TaskEnd(T20b);
 }
 
 /* main_T20c() - task body function for the 10ms 'c' task (frame 2)
 */
-void main_T20c(void)
+FM_HOT_TEXT void main_T20c(void)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	TaskStart(T20c);
+	job_Scratch(2);
+	TaskEnd(T20c);
 }
 
 /* main_T20d() - task body function for the 10ms 'd' task (frame 3)
 */
-void main_T20d(void)
+FM_HOT_TEXT void main_T20d(void)
+{
+	TaskStart(T20d);
+	job_Scratch(3);
+	TaskEnd(T20d);
+}
+
+/* The long computation: a checksum over LONG_SIZE words, LONG_SLICES slices of LONG_SIZE/LONG_SLICES words
+*/
+#define LONG_SIZE		16384
+#define LONG_SLICES		4
+#define LONG_POLL		256				/* Words between two polls of JobAborted() */
+
+struct longwork_s
+{
+	dv_u32_t data[LONG_SIZE];
+	dv_u32_t sum;						/* Running checksum */
+	dv_u32_t result;					/* Checksum of the last completed run */
+	dv_u32_t runs;						/* Number of completed runs */
+};
+
+struct longwork_s longwork;
+
+/* The result of the long computation, published on a LET channel that is swapped every round
+*/
+struct longresult_s
+{
+	dv_u32_t sum;
+	dv_u32_t run;						/* Number of the run that computed it */
+};
+
+/* main_TLong() - task body function for the long computation ("long" mode)
+ *
+ * Each execution does one slice of the checksum and keeps the running sum for the next slice.
+ * The job polls JobAborted() every LONG_POLL words. An aborted slice ends at once without storing
+ * its partial sum or calling fm_WorkDone(), so the next execution repeats it.
+*/
+FM_HOT_TEXT void main_TLong(void)
+{
+	TaskStart(TLong);
+
+	dv_u32_t slice = fm_WorkSlice(LongWork);
+	dv_u32_t *p = &longwork.data[slice * (LONG_SIZE/LONG_SLICES)];
+
+	if ( slice == 0 )
+	{
+		/* The channel must deliver the result of the run that completed in the previous round.
+		 * A mismatch is counted and shown with the channel in the results.
+		*/
+		const struct longresult_s *prev = FM_CHANNELREAD(LongResult, struct longresult_s);
+
+		if ( prev->run != longwork.runs || prev->sum != longwork.result )
+			fm_ChannelMismatch(LongResult);
+
+		longwork.sum = 0;
+	}
+
+	dv_u32_t sum = longwork.sum;
+
+	for ( int i = 0; i < LONG_SIZE/LONG_SLICES; i++ )
+	{
+		if ( (i % LONG_POLL) == 0 && JobAborted() )
+		{
+			TaskEnd(TLong);
+			return;
+		}
+		sum = (sum << 1 | sum >> 31) ^ p[i];
+	}
+
+	longwork.sum = sum;
+
+	if ( slice == LONG_SLICES - 1 )
+	{
+		struct longresult_s *out = FM_CHANNELWRITE(LongResult, struct longresult_s);
+
+		longwork.result = longwork.sum;
+		longwork.runs++;
+		out->sum = longwork.sum;
+		out->run = longwork.runs;
+		fm_ChannelWritten(LongResult);
+	}
+
+	fm_WorkDone(LongWork);
+
+	TaskEnd(TLong);
+}
+
+/* The handlers of the sporadic events. The synthetic events fold their data into a checksum;
+ * the uart characters are only counted (the command interpreter gets them directly from the ISR).
+*/
+dv_u32_t synth_sum;
+dv_u32_t uart_chars;
+
+static void ev_Synth(dv_u32_t data)
 {
-	fm_TaskStart();
-	fm_TaskEnd();
+	synth_sum = (synth_sum << 1 | synth_sum >> 31) ^ data;
+}
+
+static void ev_Uart(dv_u32_t data)
+{
+	uart_chars++;
+}
+
+/* main_TEvent() - task body function for the event server ("events" mode). Its jobs are the server's
+ * reserved slots. The server's statistics follow the scheduler's warm-up and resets.
+*/
+FM_HOT_TEXT void main_TEvent(void)
+{
+	TaskStart(TEvent);
+	es_SetRecording(StatsRecording(), StatsResets());
+	es_Serve(ES_BUDGET);
+	TaskEnd(TEvent);
 }
 
 /* main_Timer() - body of ISR to handle interval timer interrupt
 */
-void main_Timer(void)
+FM_HOT_TEXT void main_Timer(void)
 {
+	fm_IsrStart(TimerAcct);
 	hw_ClearTimer();
 
+#if SCHED_RM
+	rm_Tick();
+#else
 	fm_StartFrame();
+#endif
+	fm_IsrEnd(TimerAcct);
+}
+
+/* main_Budget() - body of ISR to handle the budget timer interrupt
+*/
+void main_Budget(void)
+{
+	fm_IsrStart(BudgetAcct);
+	hw_ClearBudgetTimer();
+
+	if ( !ob_BudgetIsr() )
+		fm_BudgetExpired();
+	fm_IsrEnd(BudgetAcct);
+}
+
+/* main_Event() - body of ISR to handle the event timer interrupt (synthetic sporadic events)
+*/
+void main_Event(void)
+{
+	fm_IsrStart(EventAcct);
+	hw_ClearEventTimer();
+	es_GeneratorIsr();
+	fm_IsrEnd(EventAcct);
+}
+
+/* main_Uart() - body of ISR to handle uart interrupt
+*/
+void main_Uart(void)
+{
+	fm_IsrStart(UartAcct);
+
+	while ( dv_arm_bcm2835_uart_isrx() )
+	{
+		int c = dv_arm_bcm2835_uart_getc();
+
+		cmd_Rx(c);
+		es_Post(UartEvents, c);
+	}
+
+	ub_UartIsr();
+	fm_IsrEnd(UartAcct);
 }
 
 /* callout_addtasks() - configure the tasks
 */
 void callout_addtasks(dv_id_t mode)
 {
-	T5a = dv_addtask("T5a", &main_T5a, 4, 1);
-	T5b = dv_addtask("T5b", &main_T5b, 4, 1);
-	T10a = dv_addtask("T10a", &main_T10a, 4, 1);
-	T10b = dv_addtask("T10b", &main_T10b, 4, 1);
-	T20a = dv_addtask("T20a", &main_T20a, 4, 1);
-	T20b = dv_addtask("T20b", &main_T20b, 4, 1);
-	T20c = dv_addtask("T20c", &main_T20c, 4, 1);
-	T20d = dv_addtask("T20d", &main_T20d, 4, 1);
+	T5a = dv_addtask("T5a", &main_T5a, PRIO_T5, 1);
+	T5b = dv_addtask("T5b", &main_T5b, PRIO_T5, 1);
+	T10a = dv_addtask("T10a", &main_T10a, PRIO_T10, 1);
+	T10b = dv_addtask("T10b", &main_T10b, PRIO_T10, 1);
+	T20a = dv_addtask("T20a", &main_T20a, PRIO_T20, 1);
+	T20b = dv_addtask("T20b", &main_T20b, PRIO_T20, 1);
+	T20c = dv_addtask("T20c", &main_T20c, PRIO_T20, 1);
+	T20d = dv_addtask("T20d", &main_T20d, PRIO_T20, 1);
+	TLong = dv_addtask("TLong", &main_TLong, PRIO_TLONG, 1);
+	TEvent = dv_addtask("TEvent", &main_TEvent, PRIO_TEVENT, 1);
 
 	fm_CreateTasks();
+	ob_CreateTasks();
 }
 
 /* callout_addisrs() - configure the isrs
@@ -137,6 +357,22 @@ void callout_addtasks(dv_id_t mode)
 void callout_addisrs(dv_id_t mode)
 {
 	Timer = dv_addisr("Timer", &main_Timer, hw_TimerInterruptId, 8);
+	Uart = dv_addisr("Uart", &main_Uart, hw_UartInterruptId, 7);
+
+	/* The budget ISR has the highest priority, so that the other ISRs don't add to the detection latency
+	*/
+	Budget = dv_addisr("Budget", &main_Budget, hw_BudgetInterruptId, 9);
+
+	/* The event timer's ISR only posts an event; the event server does the work
+	*/
+	Event = dv_addisr("Event", &main_Event, hw_EventInterruptId, 7);
+
+	/* The time spent in the ISRs is measured and subtracted from the jobs that they interrupt
+	*/
+	TimerAcct = fm_AddIsr("Timer");
+	UartAcct = fm_AddIsr("Uart");
+	BudgetAcct = fm_AddIsr("Budget");
+	EventAcct = fm_AddIsr("Event");
 }
 
 /* callout_addgroups() - configure the executable groups
@@ -155,20 +391,34 @@ void callout_addmutexes(dv_id_t mode)
 */
 void callout_addcounters(dv_id_t mode)
 {
+#if SCHED_RM
+	rm_CreateCounter();
+#endif
 }
 
 /* callout_addalarms() - configure the alarms
 */
 void callout_addalarms(dv_id_t mode)
 {
+#if SCHED_RM
+	/* The same task set as the default mode of the frame-based schedule, with 5 ms frames
+	*/
+	rm_AddTask("T5a", T5a, 5000, 0);
+	rm_AddTask("T5b", T5b, 5000, 0);
+	rm_AddTask("T10a", T10a, 10000, 0);
+	rm_AddTask("T10b", T10b, 10000, 5000);
+	rm_AddTask("T20a", T20a, 20000, 0);
+	rm_AddTask("T20b", T20b, 20000, 5000);
+	rm_AddTask("T20c", T20c, 20000, 10000);
+	rm_AddTask("T20d", T20d, 20000, 15000);
+	rm_AddTask("TEvent", TEvent, 10000, 0);
+#endif
 }
 
 /* callout_autostart() - start the objects that need to be running after dv_startos()
 */
 void callout_autostart(dv_id_t mode)
 {
-	fm_Init();
-
 	/* This sequuence defines the tasks in each frame as well as the order
 	*/
 	fm_AddTask(0, T5a);		/* Frame 0 */
@@ -191,10 +441,122 @@ void callout_autostart(dv_id_t mode)
 	fm_AddTask(3, T20d);
 	fm_AddTask(3, T5b);
 
+	/* A second mode without the 20 ms tasks. It can be selected with the "mode" command
+	*/
+	dv_id_t m = fm_AddMode("short");
+
+	fm_AddModeTask(m, 0, T5a);	/* Frame 0 */
+	fm_AddModeTask(m, 0, T10a);
+	fm_AddModeTask(m, 0, T5b);
+
+	fm_AddModeTask(m, 1, T5a);	/* Frame 1 */
+	fm_AddModeTask(m, 1, T10b);
+	fm_AddModeTask(m, 1, T5b);
+
+	/* The frames don't have to be the same length
+	*/
+	fm_SetFrameLength(m, 0, 6000);
+	fm_SetFrameLength(m, 1, 4000);
+
+	/* A third mode with a long computation that is spread over the four frames, one slice in each
+	*/
+	LongWork = fm_AddWork("checksum", LONG_SLICES);
+	LongResult = FM_ADDCHANNEL("checksum", struct longresult_s, fm_atRoundStart);
+	m = fm_AddMode("long");
+
+	for ( int f = 0; f < 4; f++ )
+	{
+		fm_AddModeTask(m, f, T5a);
+		fm_AddModeTask(m, f, ((f & 1) == 0) ? T10a : T10b);
+		fm_AddModeTask(m, f, TLong);
+		fm_AddModeTask(m, f, T5b);
+	}
+
+	/* A fourth mode: the default schedule with slots for the event server in frames 0 and 2
+	*/
+	m = fm_AddMode("events");
+
+	fm_AddModeTask(m, 0, T5a);	/* Frame 0 */
+	fm_AddModeTask(m, 0, T10a);
+	fm_AddModeTask(m, 0, T20a);
+	fm_AddModeTask(m, 0, T5b);
+	fm_AddModeTask(m, 0, TEvent);
+
+	fm_AddModeTask(m, 1, T5a);	/* Frame 1 */
+	fm_AddModeTask(m, 1, T10b);
+	fm_AddModeTask(m, 1, T20b);
+	fm_AddModeTask(m, 1, T5b);
+
+	fm_AddModeTask(m, 2, T5a);	/* Frame 2 */
+	fm_AddModeTask(m, 2, T10a);
+	fm_AddModeTask(m, 2, T20c);
+	fm_AddModeTask(m, 2, T5b);
+	fm_AddModeTask(m, 2, TEvent);
+
+	fm_AddModeTask(m, 3, T5a);	/* Frame 3 */
+	fm_AddModeTask(m, 3, T10b);
+	fm_AddModeTask(m, 3, T20d);
+	fm_AddModeTask(m, 3, T5b);
+
+	/* Execution-time estimate of a checksum slice for the admission check in fm_Init(). The other
+	 * tasks hardly do anything, so the dispatch overhead covers them.
+	*/
+	fm_SetTaskWcet(TLong, 50);
+	fm_SetTaskWcet(TEvent, ES_WCET);
+
+	/* Sources of sporadic events for the event server
+	*/
+	SynthEvents = es_AddGenerator("synthetic", &ev_Synth);
+	UartEvents = es_AddSource("uart", &ev_Uart);
+	es_ResetStats();
+
+	/* Build the schedule tables from the declarations above
+	*/
+	fm_Init();
+
+	/* The code and data that is used in every frame, for the TLB report
+	*/
+	fm_AddHotSet();
+	mmu_AddHot("main_Timer", main_Timer, MMU_HOTCODE);
+	mmu_AddHot("main_T5a", main_T5a, MMU_HOTCODE);
+	mmu_AddHot("main_T5b", main_T5b, MMU_HOTCODE);
+	mmu_AddHot("main_T10a", main_T10a, MMU_HOTCODE);
+	mmu_AddHot("main_T10b", main_T10b, MMU_HOTCODE);
+	mmu_AddHot("main_T20a", main_T20a, MMU_HOTCODE);
+	mmu_AddHot("main_T20b", main_T20b, MMU_HOTCODE);
+	mmu_AddHot("main_T20c", main_T20c, MMU_HOTCODE);
+	mmu_AddHot("main_T20d", main_T20d, MMU_HOTCODE);
+	mmu_AddHot("main_TLong", main_TLong, MMU_HOTCODE);
+	mmu_AddHot("main_TEvent", main_TEvent, MMU_HOTCODE);
+
 	dv_arm_bcm2835_armtimer_set_frc_prescale(1);
 	dv_arm_bcm2835_armtimer_enable_frc();
 
-	hw_InitialiseMillisecondTicker(5);
+	/* The I-cache miss counter for the frame statistics
+	*/
+	hw_InitPmu();
+
+	/* From here on, console output goes through the uart buffer
+	*/
+	ub_Init();
+	hw_EnableUartRxInterrupt();
+	dv_enable_irq(hw_UartInterruptId);
+
+	/* Job budgets are declared with fm_SetJobBudget() before fm_Init(), or set with the "budget" command
+	*/
+	hw_CancelBudgetTimer();
+	dv_enable_irq(hw_BudgetInterruptId);
+
+	/* The synthetic events are switched on with the "events" command
+	*/
+	hw_CancelEventTimer();
+	dv_enable_irq(hw_EventInterruptId);
+
+#if SCHED_RM
+	rm_Start();
+#else
+	fm_StartTicker();
+#endif
 	dv_enable_irq(hw_TimerInterruptId);
 }
 
@@ -202,6 +564,7 @@ void callout_autostart(dv_id_t mode)
 */
 dv_statustype_t callout_reporterror(dv_sid_t sid, dv_statustype_t e, dv_qty_t nparam, dv_param_t *param)
 {
+	ub_Flush();
 	dv_printf("callout_reporterror(%d, %d, %d, ...) called.\n", sid, e, nparam);
 	for (int i = 0; i < nparam; i++ )
 	{
@@ -221,18 +584,83 @@ void callout_shutdown(dv_statustype_t e)
 	dv_printf("callout_shutdown: %d\n", e);
 }
 
+/* For the experiment: with the hybrid idle strategy, the idle loop stops polling and waits for an
+ * interrupt when the next tick is due in less than this many microseconds
+*/
+#define IDLE_WINDOW		100
+
+#if SCHED_RM
+#define NextTick()		rm_NextTick()
+#else
+#define NextTick()		fm_NextTick()
+#endif
+
+/* idle_Wait() - what the idle loop does after each poll, as selected with the "idle" command
+ *
+ * A change of strategy is signalled with SEV, so that the other cores (pi3) see it even if they are
+ * waiting in WFE.
+*/
+static void idle_Wait(void)
+{
+	static enum fm_idle_e prev = fm_idleSpin;
+	enum fm_idle_e idle = fm_IdleStrategy();
+	dv_u64_t next;
+
+	if ( idle != prev )
+	{
+		prev = idle;
+		hw_SendEvent();
+	}
+
+	switch ( idle )
+	{
+	case fm_idleWfi:
+		hw_WaitForInterrupt();
+		break;
+
+	case fm_idleWfe:
+		hw_WaitForEvent();
+		break;
+
+	case fm_idleHybrid:
+		next = NextTick();
+		if ( next != 0 && (dv_readtime() + IDLE_WINDOW * hw_TicksPerMicrosecond) >= next )
+			hw_WaitForInterrupt();
+		break;
+
+	default:
+		break;
+	}
+}
+
 /* callout_idle() - called in idle loop
 */
 void callout_idle(void)
 {
 	dv_printf("Idle loop reached\n");
-	for (;;) {}
+	mmu_Report();
+	dv_printf("Type help for a list of commands\n> ");
+	for (;;)
+	{
+		/* The results of a finished run are printed before the next command can start a new one
+		*/
+#if SCHED_RM
+		rm_Poll();
+#else
+		fm_Poll();
+#endif
+		cmd_Poll();
+		fm_FlightPoll();
+		ub_Poll();
+		idle_Wait();
+	}
 }
 
 /* callout_panic() - called from dv_panic
 */
 void callout_panic(dv_panic_t p, dv_sid_t sid, char *fault)
 {
+	ub_Flush();
 	dv_printf("Panic %d in %d : %s\n", p, sid, fault);
 }
 
@@ -0,0 +1,308 @@
+/* membench.c - memory hierarchy benchmark (the "membench" command)
+ *
+ * Measures the numbers that the cache maintenance results depend on:
+ *
+ *	- load latency by pointer chasing over working sets from 1 KB to MB_MAXSIZE. The lines of the working
+ *	  set are linked in a random cycle, so the prefetcher can't help and each load waits for the previous one.
+ *	- streaming bandwidth (read, write and copy) for working sets that fit in L1, in L2 and in neither.
+ *	- TLB reach: pointer chasing with one line per page over an increasing number of pages. The lines are in
+ *	  different cache sets, so the rise in latency comes from the TLB. Compare builds with different
+ *	  MMU_GRANULE values to see the effect of large mappings.
+ *	- the time taken by each of the cache operations that fm_CacheMaintenance() uses, after writing to
+ *	  a data-cache-sized block ("dirty") and immediately after the same operation ("clean").
+ *
+ * The times are printed in nanoseconds. The latency and bandwidth tests run with interrupts enabled and
+ * keep the best of MB_REPEAT runs. The "membench" command refuses to run unless the experiment is stopped,
+ * so that the frames don't disturb the benchmark and the benchmark doesn't pollute the job timings.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <frame-manager.h>
+#include <uart-buffer.h>
+#include <membench.h>
+#include <mmu.h>
+
+#include TARGET_HDR
+
+#include <dv-arm-cache.h>
+
+#define MB_LINE		FM_HOT_ALIGN				/* Stride of the latency test: a cache line on both targets */
+#define MB_PAGE		4096
+#define MB_DIRTY	(32*1024)					/* Written before each "dirty" cache operation */
+
+dv_u32_t mb_buffer[MB_MAXSIZE/sizeof(dv_u32_t)] __attribute__((aligned(MB_PAGE)));
+void * volatile mb_sink;
+volatile dv_u32_t mb_sum;
+
+static dv_u32_t mb_seed = 2463534242u;
+
+/* mb_Random() - xorshift32
+*/
+static dv_u32_t mb_Random(void)
+{
+	mb_seed ^= mb_seed << 13;
+	mb_seed ^= mb_seed >> 17;
+	mb_seed ^= mb_seed << 5;
+	return mb_seed;
+}
+
+/* mb_BuildChain() - link n nodes, stride bytes apart, into a single random cycle (Sattolo's algorithm)
+ *
+ * Each node holds a pointer to the next. The permutation is built in place: node i starts by pointing to
+ * itself and the pointers are shuffled.
+*/
+static void *mb_BuildChain(dv_u32_t n, dv_u32_t stride)
+{
+	char *base = (char *)mb_buffer;
+
+	for ( dv_u32_t i = 0; i < n; i++ )
+		*(void **)(base + i * stride) = base + i * stride;
+
+	for ( dv_u32_t i = n - 1; i > 0; i-- )
+	{
+		dv_u32_t j = mb_Random() % i;
+		void **pi = (void **)(base + i * stride);
+		void **pj = (void **)(base + j * stride);
+		void *t = *pi;
+
+		*pi = *pj;
+		*pj = t;
+	}
+	return base;
+}
+
+/* mb_Chase() - follow the chain for MB_STEPS loads. Returns the best time of MB_REPEAT runs.
+*/
+static dv_u64_t mb_Chase(void *start)
+{
+	dv_u64_t best = 0xffffffffffffffff;
+
+	for ( int r = 0; r < MB_REPEAT; r++ )
+	{
+		void **p = start;
+		dv_u64_t t0 = dv_readtime();
+
+		for ( dv_u32_t i = 0; i < MB_STEPS; i += 8 )
+		{
+			p = *p; p = *p; p = *p; p = *p;
+			p = *p; p = *p; p = *p; p = *p;
+		}
+
+		dv_u64_t t = dv_readtime() - t0;
+
+		mb_sink = p;
+		if ( best > t )
+			best = t;
+	}
+	return best;
+}
+
+/* mb_PrintNs() - print ticks/n as nanoseconds with one decimal place
+*/
+static void mb_PrintNs(dv_u64_t ticks, dv_u32_t n)
+{
+	dv_u64_t tenths = (ticks * 10000 + (dv_u64_t)n * hw_TicksPerMicrosecond / 2) / ((dv_u64_t)n * hw_TicksPerMicrosecond);
+
+	dv_printf(" %6u.%u", (dv_u32_t)(tenths / 10), (dv_u32_t)(tenths % 10));
+}
+
+/* mb_Latency() - load latency over increasing working sets
+*/
+static void mb_Latency(void)
+{
+	dv_printf("Load latency (ns), %d-byte stride, random order\n", MB_LINE);
+	dv_printf("  %8s %8s\n", "KB", "ns");
+
+	for ( dv_u32_t size = 1024; size <= MB_MAXSIZE; size *= 2 )
+	{
+		void *start = mb_BuildChain(size / MB_LINE, MB_LINE);
+
+		ub_WaitSpace(64);
+		dv_printf("  %8u", size / 1024);
+		mb_PrintNs(mb_Chase(start), MB_STEPS);
+		dv_printf("\n");
+	}
+}
+
+/* mb_Tlb() - load latency with one line per page over an increasing number of pages
+ *
+ * The line moves along by one cache line in each page so that the lines don't all fall in the same set.
+*/
+static void mb_Tlb(void)
+{
+	dv_u32_t stride = MB_PAGE + MB_LINE;
+	dv_u32_t m = mmu_MappingSize((dv_address_t)mb_buffer);
+
+	dv_printf("TLB reach: one line per page, MMU layout %s, buffer mapped in %u-byte units%s\n",
+				mmu_granuleNames[MMU_GRANULE], m, (m == 0) ? " (not known)" : "");
+	dv_printf("  %8s %8s %8s\n", "pages", "KB", "ns");
+
+	for ( dv_u32_t n = 8; n * stride <= MB_MAXSIZE; n *= 2 )
+	{
+		void *start = mb_BuildChain(n, stride);
+
+		ub_WaitSpace(64);
+		dv_printf("  %8u %8u", n, n * (MB_PAGE / 1024));
+		mb_PrintNs(mb_Chase(start), MB_STEPS);
+		dv_printf("\n");
+	}
+}
+
+/* mb_Read(), mb_Write(), mb_Copy() - one pass over size bytes of the buffer
+*/
+static void mb_Read(dv_u32_t size)
+{
+	dv_u32_t *p = mb_buffer;
+	dv_u32_t n = size / sizeof(dv_u32_t);
+	dv_u32_t s = 0;
+
+	for ( dv_u32_t i = 0; i < n; i += 4 )
+		s += p[i] + p[i+1] + p[i+2] + p[i+3];
+	mb_sum = s;
+}
+
+static void mb_Write(dv_u32_t size)
+{
+	dv_u32_t *p = mb_buffer;
+	dv_u32_t n = size / sizeof(dv_u32_t);
+
+	for ( dv_u32_t i = 0; i < n; i += 4 )
+	{
+		p[i] = i; p[i+1] = i; p[i+2] = i; p[i+3] = i;
+	}
+}
+
+static void mb_Copy(dv_u32_t size)
+{
+	dv_u32_t *d = mb_buffer;
+	dv_u32_t *s = mb_buffer + (size / 2) / sizeof(dv_u32_t);
+	dv_u32_t n = (size / 2) / sizeof(dv_u32_t);
+
+	for ( dv_u32_t i = 0; i < n; i += 4 )
+	{
+		d[i] = s[i]; d[i+1] = s[i+1]; d[i+2] = s[i+2]; d[i+3] = s[i+3];
+	}
+}
+
+/* mb_Stream() - bandwidth of fn over size bytes in MB/s (bytes per microsecond). Best of MB_REPEAT.
+ *
+ * The copy moves size/2 bytes per pass; its bandwidth counts the bytes copied.
+*/
+static dv_u32_t mb_Stream(void (*fn)(dv_u32_t), dv_u32_t size, dv_u32_t bytes_per_pass)
+{
+	dv_u32_t passes = MB_STREAMBYTES / size;
+	dv_u64_t best = 0xffffffffffffffff;
+
+	fn(size);									/* Warm up */
+
+	for ( int r = 0; r < MB_REPEAT; r++ )
+	{
+		dv_u64_t t0 = dv_readtime();
+
+		for ( dv_u32_t i = 0; i < passes; i++ )
+			fn(size);
+
+		dv_u64_t t = dv_readtime() - t0;
+
+		if ( best > t )
+			best = t;
+	}
+
+	if ( best == 0 )
+		return 0;
+	return (dv_u32_t)((dv_u64_t)passes * bytes_per_pass * hw_TicksPerMicrosecond / best);
+}
+
+static void mb_Bandwidth(void)
+{
+	static const dv_u32_t sizes[3] = { 8*1024, 128*1024, 4*1024*1024 };
+
+	dv_printf("Bandwidth (MB/s)\n");
+	dv_printf("  %8s %8s %8s %8s\n", "KB", "read", "write", "copy");
+
+	for ( int i = 0; i < 3; i++ )
+	{
+		dv_u32_t s = sizes[i];
+
+		ub_WaitSpace(64);
+		dv_printf("  %8u %8u %8u %8u\n", s / 1024, mb_Stream(mb_Read, s, s), mb_Stream(mb_Write, s, s),
+					mb_Stream(mb_Copy, s, s / 2));
+	}
+}
+
+/* mb_CacheOp() - execute a cache operation as in fm_CacheMaintenance()
+*/
+static void mb_CacheOp(char op)
+{
+	switch ( op )
+	{
+	case 'i':	dv_invalidate_entire_instruction_cache();	break;
+	case 'd':	dv_clean_entire_data_cache();				break;
+	case 'p':	dv_flush_prefetch_buffer();					break;
+	case 'b':	dv_flush_entire_branch_target_cache();		break;
+	case 't':	hw_InvalidateTlb();							break;
+	}
+}
+
+static void mb_PrintOpTimes(struct timing_s *t)
+{
+	mb_PrintNs(t->t_min, 1);
+	mb_PrintNs(t->t_sum, t->n);
+	mb_PrintNs(t->t_max, 1);
+}
+
+/* mb_CacheOps() - the time taken by each cache operation, after dirtying the data cache and back to back
+*/
+static void mb_CacheOps(void)
+{
+	static const char ops[] = "idpbt";
+	struct timing_s dirty, clean;
+
+	dv_printf("Cache operations (ns), %d executions, dirty = after writing %u KB\n", MB_OPREPEAT, MB_DIRTY / 1024);
+	dv_printf("  %4s %26s %26s\n", "", "---------- dirty ---------", "---------- clean ---------");
+	dv_printf("  %4s %8s %8s %8s %8s %8s %8s\n", "op", "min", "mean", "max", "min", "mean", "max");
+
+	for ( int k = 0; ops[k] != '\0'; k++ )
+	{
+		fm_InitTime(&dirty);
+		fm_InitTime(&clean);
+
+		for ( int r = 0; r < MB_OPREPEAT; r++ )
+		{
+			mb_Write(MB_DIRTY);
+
+			dv_intstatus_t is = dv_disable();
+			dv_u64_t t0 = dv_readtime();
+			mb_CacheOp(ops[k]);
+			dv_u64_t t1 = dv_readtime();
+			mb_CacheOp(ops[k]);
+			dv_u64_t t2 = dv_readtime();
+			dv_restore(is);
+
+			fm_StoreValue(&dirty, t1 - t0);
+			fm_StoreValue(&clean, t2 - t1);
+		}
+
+		ub_WaitSpace(80);
+		dv_printf("  %4c", ops[k]);
+		mb_PrintOpTimes(&dirty);
+		mb_PrintOpTimes(&clean);
+		dv_printf("\n");
+	}
+}
+
+/* mb_Bench() - run the whole suite
+*/
+void mb_Bench(void)
+{
+	dv_printf("Memory benchmark: buffer %u KB at 0x%08lx\n", MB_MAXSIZE / 1024, (unsigned long)mb_buffer);
+	mb_Latency();
+	mb_Bandwidth();
+	mb_Tlb();
+	mb_CacheOps();
+	dv_printf("\n");
+}
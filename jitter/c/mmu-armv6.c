@@ -0,0 +1,230 @@
+/* mmu-armv6.c - MMU setup with configurable mapping granularity for the pi zero (ARM1176)
+ *
+ * The page tables use the ARMv6 format (CP15 control XP = 1, no subpages). All regions are identity-mapped.
+ *
+ * MMU_LARGE uses 16 MB supersections where the region allows it. A supersection is 16 identical
+ * consecutive level 1 entries but occupies a single TLB entry.
+ * MMU_MEDIUM uses 1 MB sections.
+ * MMU_SMALL uses 4 KB pages (via level 2 tables) for the first region.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <mmu.h>
+
+#include TARGET_HDR
+
+/* The regions of the pi zero's address space. ARM RAM size depends on the gpu_mem setting.
+*/
+const struct mmu_region_s mmu_regions[] =
+{
+	{	"program",		0x00000000,	0x01000000,	mmu_code	},
+	{	"ram",			0x01000000,	0x1f000000,	mmu_data	},
+	{	"peripherals",	0x20000000,	0x01000000,	mmu_device	}
+};
+
+const int mmu_nregions = sizeof(mmu_regions)/sizeof(mmu_regions[0]);
+
+/* Level 1 descriptor bits
+*/
+#define L1_COARSE		0x00000001
+#define L1_SECTION		0x00000002
+#define L1_B			0x00000004
+#define L1_C			0x00000008
+#define L1_XN			0x00000010
+#define L1_AP_RW		0x00000c00
+#define L1_TEX(x)		((x)<<12)
+#define L1_S			0x00010000
+#define L1_SUPER		0x00040000
+
+/* Level 2 (small page) descriptor bits
+*/
+#define L2_XN			0x00000001
+#define L2_SMALL		0x00000002
+#define L2_B			0x00000004
+#define L2_C			0x00000008
+#define L2_AP_RW		0x00000030
+#define L2_TEX(x)		((x)<<6)
+
+#define CP15_CTRL_M		0x00000001
+#define CP15_CTRL_XP	0x00800000
+
+#define MMU_SECTION		0x00100000
+#define MMU_SUPER		0x01000000
+#define MMU_PAGE		0x00001000
+
+/* Number of level 2 tables: enough to map the first region with pages
+*/
+#define MMU_NL2			16
+
+#if MMU_GRANULE != MMU_DAVROSKA
+
+struct mmutables_s
+{
+	dv_u32_t l1[4096];
+	dv_u32_t l2[MMU_NL2][256];
+};
+
+/* The tables are in .bss. The pi zero has one core, so mmu_Setup() runs once, from main(), after
+ * the start-up code has cleared .bss. (A section of its own would be an uninitialised PROGBITS
+ * section that adds 32 KB of zeros to the image.)
+*/
+struct mmutables_s mmutables __attribute__((aligned(16384)));
+
+static int mmu_nl2used;
+
+static inline void mmu_WriteTtbr0(dv_u32_t v)
+{
+	__asm__ volatile("mcr p15, 0, %0, c2, c0, 0" : : "r"(v));
+}
+
+static inline void mmu_WriteTtbcr(dv_u32_t v)
+{
+	__asm__ volatile("mcr p15, 0, %0, c2, c0, 2" : : "r"(v));
+}
+
+static inline void mmu_WriteDacr(dv_u32_t v)
+{
+	__asm__ volatile("mcr p15, 0, %0, c3, c0, 0" : : "r"(v));
+}
+
+/* mmu_L1Attr() - level 1 attributes for a region
+*/
+static dv_u32_t mmu_L1Attr(enum mmu_attr_e attr)
+{
+	switch ( attr )
+	{
+	case mmu_code:		return L1_TEX(1) | L1_C | L1_B | L1_AP_RW;				/* Normal, WB WA */
+	case mmu_data:		return L1_TEX(1) | L1_C | L1_B | L1_AP_RW | L1_XN;
+	default:			return L1_TEX(0) | L1_B | L1_AP_RW | L1_XN;				/* Shared device */
+	}
+}
+
+/* mmu_L2Attr() - level 2 attributes for a region
+*/
+static dv_u32_t mmu_L2Attr(enum mmu_attr_e attr)
+{
+	switch ( attr )
+	{
+	case mmu_code:		return L2_TEX(1) | L2_C | L2_B | L2_AP_RW;
+	case mmu_data:		return L2_TEX(1) | L2_C | L2_B | L2_AP_RW | L2_XN;
+	default:			return L2_TEX(0) | L2_B | L2_AP_RW | L2_XN;
+	}
+}
+
+/* mmu_MapRegion() - create the level 1 (and level 2) entries for a region
+*/
+static void mmu_MapRegion(const struct mmu_region_s *r, int granule)
+{
+	dv_address_t a = r->base;
+	dv_address_t end = r->base + r->size;
+
+	while ( a < end )
+	{
+		if ( granule == MMU_LARGE && (a % MMU_SUPER) == 0 && (end - a) >= MMU_SUPER )
+		{
+			for ( int i = 0; i < 16; i++ )
+			{
+				mmutables.l1[(a >> 20) + i] = (a & 0xff000000) | L1_SUPER | mmu_L1Attr(r->attr) | L1_SECTION;
+			}
+			a += MMU_SUPER;
+		}
+		else
+		if ( granule == MMU_SMALL && mmu_nl2used < MMU_NL2 )
+		{
+			dv_u32_t *l2 = mmutables.l2[mmu_nl2used++];
+
+			for ( int i = 0; i < 256; i++ )
+			{
+				l2[i] = (a + i * MMU_PAGE) | mmu_L2Attr(r->attr) | L2_SMALL;
+			}
+			mmutables.l1[a >> 20] = (dv_address_t)l2 | L1_COARSE;
+			a += MMU_SECTION;
+		}
+		else
+		{
+			mmutables.l1[a >> 20] = a | mmu_L1Attr(r->attr) | L1_SECTION;
+			a += MMU_SECTION;
+		}
+	}
+}
+
+/* mmu_Setup() - create the page tables and enable the MMU
+ *
+ * Must be called before the caches are enabled.
+*/
+void mmu_Setup(int create)
+{
+	if ( create )
+	{
+		mmu_nl2used = 0;
+
+		for ( int i = 0; i < 4096; i++ )
+		{
+			mmutables.l1[i] = 0;		/* Fault */
+		}
+
+		for ( int r = 0; r < mmu_nregions; r++ )
+		{
+			/* Only the first region gets small pages
+			*/
+			int granule = MMU_GRANULE;
+			if ( granule == MMU_SMALL && r != 0 )
+				granule = MMU_MEDIUM;
+
+			mmu_MapRegion(&mmu_regions[r], granule);
+		}
+	}
+
+	mmu_WriteTtbcr(0);								/* Use TTBR0 for everything */
+	mmu_WriteTtbr0((dv_address_t)mmutables.l1);		/* Table walks not cached */
+	mmu_WriteDacr(0x00000001);						/* Domain 0: client */
+	hw_InvalidateTlb();
+
+	dv_write_cp15_control(dv_read_cp15_control() | CP15_CTRL_XP | CP15_CTRL_M);
+}
+
+#endif
+
+static inline dv_u32_t mmu_ReadTtbr0(void)
+{
+	dv_u32_t v;
+	__asm__ volatile("mrc p15, 0, %0, c2, c0, 0" : "=r"(v));
+	return v;
+}
+
+/* mmu_MappingSize() - return the size of the mapping that contains an address, or 0 if not mapped
+ *
+ * Walks the active page tables, so it works with davroska's tables too.
+*/
+dv_u32_t mmu_MappingSize(dv_address_t addr)
+{
+	dv_u32_t *l1 = (dv_u32_t *)(mmu_ReadTtbr0() & 0xffffc000);
+	dv_u32_t d = l1[addr >> 20];
+
+	switch ( d & 0x3 )
+	{
+	case 1:		/* Coarse table */
+		{
+			dv_u32_t *l2 = (dv_u32_t *)(d & 0xfffffc00);
+			dv_u32_t d2 = l2[(addr >> 12) & 0xff];
+
+			if ( (d2 & 0x3) == 0 )	return 0;
+			if ( (d2 & 0x3) == 1 )	return 0x10000;			/* Large page */
+			return MMU_PAGE;
+		}
+
+	case 2:		/* Section or supersection */
+		return (d & L1_SUPER) ? MMU_SUPER : MMU_SECTION;
+
+	default:
+		return 0;
+	}
+}
+
+/* Names of the layouts, indexed by MMU_GRANULE
+*/
+const char * const mmu_granuleNames[4] = { "davroska", "4k pages", "1M sections", "16M supersections" };
@@ -0,0 +1,214 @@
+/* mmu-armv8.c - MMU setup with configurable mapping granularity for the pi3 (Cortex-A53, aarch64)
+ *
+ * 4 KB translation granule, 32-bit virtual address space (T0SZ = 32), so the table walk starts at level 1.
+ * All regions are identity-mapped.
+ *
+ * MMU_LARGE uses 1 GB level 1 blocks where the region allows it.
+ * MMU_MEDIUM uses 2 MB level 2 blocks.
+ * MMU_SMALL uses 4 KB level 3 pages for the first region.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <mmu.h>
+
+#include TARGET_HDR
+
+/* The regions of the pi3's address space. ARM RAM size depends on the gpu_mem setting.
+ * The local peripherals (core timers, mailboxes) occupy only the start of the second gigabyte
+ * but the region is made 1 GB long so that it can use a 1 GB block.
+*/
+const struct mmu_region_s mmu_regions[] =
+{
+	{	"program",		0x00000000,	0x01000000,	mmu_code	},
+	{	"ram",			0x01000000,	0x3e000000,	mmu_data	},
+	{	"peripherals",	0x3f000000,	0x01000000,	mmu_device	},
+	{	"local",		0x40000000,	0x40000000,	mmu_device	}
+};
+
+const int mmu_nregions = sizeof(mmu_regions)/sizeof(mmu_regions[0]);
+
+/* Descriptor bits
+*/
+#define D_BLOCK			0x001uL
+#define D_TABLE			0x003uL
+#define D_PAGE			0x003uL
+#define D_ATTR(i)		((dv_u64_t)(i)<<2)		/* Index into MAIR_EL1 */
+#define D_SH_INNER		0x300uL
+#define D_AF			0x400uL
+#define D_PXN			(1uL<<53)
+#define D_UXN			(1uL<<54)
+#define D_ADDR			0x0000fffffffff000uL
+
+/* MAIR_EL1: attr 0 = normal WB RW-allocate, attr 1 = device nGnRnE
+*/
+#define MAIR_VALUE		0x00ffuL
+
+/* TCR_EL1: T0SZ = 32, IRGN0 = ORGN0 = WB WA, SH0 = inner, TG0 = 4 KB, EPD1 = 1 (no TTBR1 walks), IPS = 32 bits
+*/
+#define TCR_VALUE		(32uL | (1uL<<8) | (1uL<<10) | (3uL<<12) | (1uL<<23))
+
+#define SCTLR_M			0x0001uL
+#define SCTLR_C			0x0004uL
+#define SCTLR_I			0x1000uL
+
+#define MMU_GIGA		0x40000000uL
+#define MMU_BLOCK		0x00200000uL
+#define MMU_PAGE		0x00001000uL
+
+/* Number of level 3 tables: enough to map the first region with pages
+*/
+#define MMU_NL3			8
+
+#if MMU_GRANULE != MMU_DAVROSKA
+
+struct mmutables_s
+{
+	dv_u64_t l1[512];
+	dv_u64_t l2[4][512];
+	dv_u64_t l3[MMU_NL3][512];
+};
+
+/* The tables are not in .bss because the start-up code clears .bss (on every core).
+*/
+struct mmutables_s mmutables __attribute__((aligned(4096), section(".mmu_tables")));
+
+static int mmu_nl3used;
+
+/* mmu_Attr() - descriptor attributes for a region
+*/
+static dv_u64_t mmu_Attr(enum mmu_attr_e attr)
+{
+	switch ( attr )
+	{
+	case mmu_code:		return D_ATTR(0) | D_SH_INNER | D_AF;
+	case mmu_data:		return D_ATTR(0) | D_SH_INNER | D_AF | D_PXN | D_UXN;
+	default:			return D_ATTR(1) | D_AF | D_PXN | D_UXN;
+	}
+}
+
+/* mmu_L2Table() - return the level 2 table for an address, creating the level 1 table descriptor
+*/
+static dv_u64_t *mmu_L2Table(dv_address_t a)
+{
+	dv_u64_t *l2 = mmutables.l2[a / MMU_GIGA];
+	mmutables.l1[a / MMU_GIGA] = (dv_address_t)l2 | D_TABLE;
+	return l2;
+}
+
+/* mmu_MapRegion() - create the descriptors for a region
+*/
+static void mmu_MapRegion(const struct mmu_region_s *r, int granule)
+{
+	dv_address_t a = r->base;
+	dv_address_t end = r->base + r->size;
+
+	while ( a < end )
+	{
+		if ( granule == MMU_LARGE && (a % MMU_GIGA) == 0 && (end - a) >= MMU_GIGA )
+		{
+			mmutables.l1[a / MMU_GIGA] = a | mmu_Attr(r->attr) | D_BLOCK;
+			a += MMU_GIGA;
+		}
+		else
+		if ( granule == MMU_SMALL && mmu_nl3used < MMU_NL3 )
+		{
+			dv_u64_t *l3 = mmutables.l3[mmu_nl3used++];
+
+			for ( int i = 0; i < 512; i++ )
+			{
+				l3[i] = (a + i * MMU_PAGE) | mmu_Attr(r->attr) | D_PAGE;
+			}
+			mmu_L2Table(a)[(a / MMU_BLOCK) % 512] = (dv_address_t)l3 | D_TABLE;
+			a += MMU_BLOCK;
+		}
+		else
+		{
+			mmu_L2Table(a)[(a / MMU_BLOCK) % 512] = a | mmu_Attr(r->attr) | D_BLOCK;
+			a += MMU_BLOCK;
+		}
+	}
+}
+
+/* mmu_Setup() - create the page tables (if create is nonzero) and enable the MMU and caches
+ *
+ * Core 0 creates the tables; the other cores use the same tables.
+*/
+void mmu_Setup(int create)
+{
+	if ( create )
+	{
+		mmu_nl3used = 0;
+
+		for ( int i = 0; i < 512; i++ )
+		{
+			mmutables.l1[i] = 0;		/* Fault */
+			for ( int j = 0; j < 4; j++ )
+				mmutables.l2[j][i] = 0;
+		}
+
+		for ( int r = 0; r < mmu_nregions; r++ )
+		{
+			/* Only the first region gets small pages
+			*/
+			int granule = MMU_GRANULE;
+			if ( granule == MMU_SMALL && r != 0 )
+				granule = MMU_MEDIUM;
+
+			mmu_MapRegion(&mmu_regions[r], granule);
+		}
+
+		__asm__ volatile("dsb sy");
+	}
+
+	dv_arm64_msr(MAIR_EL1, MAIR_VALUE);
+	dv_arm64_msr(TCR_EL1, TCR_VALUE);
+	dv_arm64_msr(TTBR0_EL1, (dv_address_t)mmutables.l1);
+	__asm__ volatile("isb");
+	hw_InvalidateTlb();
+
+	dv_arm64_msr(SCTLR_EL1, dv_arm64_mrs(SCTLR_EL1) | SCTLR_M | SCTLR_C | SCTLR_I);
+	__asm__ volatile("isb");
+}
+
+#endif
+
+/* mmu_MappingSize() - return the size of the mapping that contains an address, or 0 if not mapped
+ *
+ * Walks the active page tables, so it works with davroska's tables too.
+ * Only the 4 KB granule is supported.
+*/
+dv_u32_t mmu_MappingSize(dv_address_t addr)
+{
+	dv_u64_t tcr = dv_arm64_mrs(TCR_EL1);
+	dv_u64_t *tbl = (dv_u64_t *)(dv_arm64_mrs(TTBR0_EL1) & D_ADDR);
+	int t0sz = tcr & 0x3f;
+	int level;
+
+	if ( ((tcr >> 14) & 0x3) != 0 )
+		return 0;					/* Not 4 KB granule */
+
+	level = (t0sz < 25) ? 0 : (t0sz < 34) ? 1 : 2;
+
+	for (;;)
+	{
+		int shift = 39 - 9 * level;
+		dv_u64_t d = tbl[(addr >> shift) & 0x1ff];
+
+		if ( (d & 0x1) == 0 )
+			return 0;				/* Fault */
+
+		if ( level == 3 || (d & 0x2) == 0 )
+			return (level == 0) ? 0 : (1uL << shift);	/* Page or block */
+
+		tbl = (dv_u64_t *)(d & D_ADDR);
+		level++;
+	}
+}
+
+/* Names of the layouts, indexed by MMU_GRANULE
+*/
+const char * const mmu_granuleNames[4] = { "davroska", "4k pages", "2M blocks", "1G blocks" };
@@ -0,0 +1,144 @@
+/* mmu-report.c - report the MMU layout and the TLB entries needed by the experiment's hot set
+ *
+ * The hot set is the code and data that is used in every frame: the frame manager, the task bodies
+ * and their data. The application registers the hot ranges with mmu_AddHot(). The report shows how many
+ * TLB entries are needed to cover them with the active layout. If that is more than the micro-TLBs hold
+ * (ARM1176: 10 instruction, 10 data; Cortex-A53: 10 instruction, 10 data), every frame pays for TLB refills.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <mmu.h>
+
+#define MMU_UNIT	0x1000		/* Smallest mapping unit */
+
+struct mmu_hot_s
+{
+	const char *name;
+	dv_address_t start;
+	dv_u32_t size;
+};
+
+struct mmu_hotset_s
+{
+	struct mmu_hot_s ranges[MMU_MAXHOT];
+	int n_ranges;
+	int n_lost;
+};
+
+struct mmu_hotset_s mmu_hotset;
+
+/* mmu_AddHot() - add a range of addresses to the hot set
+*/
+void mmu_AddHot(const char *name, const void *start, dv_u32_t size)
+{
+	if ( mmu_hotset.n_ranges >= MMU_MAXHOT )
+	{
+		mmu_hotset.n_lost++;
+		return;
+	}
+
+	struct mmu_hot_s *h = &mmu_hotset.ranges[mmu_hotset.n_ranges++];
+	h->name = name;
+	h->start = (dv_address_t)start;
+	h->size = (size == 0) ? 1 : size;
+}
+
+/* mmu_EntriesFor() - return the number of TLB entries needed to cover an address range
+*/
+dv_u32_t mmu_EntriesFor(dv_address_t start, dv_u32_t size)
+{
+	dv_address_t a = start;
+	dv_address_t end = start + size;
+	dv_u32_t n = 0;
+
+	while ( a < end )
+	{
+		dv_address_t m = mmu_MappingSize(a);
+
+		if ( m == 0 )
+			m = MMU_UNIT;
+		else
+			n++;
+
+		a = (a & ~(m - 1)) + m;
+	}
+
+	return n;
+}
+
+/* mmu_HotEntries() - return the number of distinct TLB entries needed to cover the whole hot set
+ *
+ * Ranges that share a page/section/block share the entry.
+*/
+static dv_u32_t mmu_HotEntries(void)
+{
+	dv_address_t seen[MMU_MAXHOTENTRIES];
+	dv_u32_t n = 0;
+
+	for ( int i = 0; i < mmu_hotset.n_ranges; i++ )
+	{
+		dv_address_t a = mmu_hotset.ranges[i].start;
+		dv_address_t end = a + mmu_hotset.ranges[i].size;
+
+		while ( a < end )
+		{
+			dv_address_t m = mmu_MappingSize(a);
+
+			if ( m == 0 )
+				m = MMU_UNIT;
+			else
+			{
+				dv_address_t base = a & ~(m - 1);
+				dv_u32_t j;
+
+				for ( j = 0; j < n && seen[j] != base; j++ )
+				{
+				}
+
+				if ( j == n && n < MMU_MAXHOTENTRIES )
+					seen[n++] = base;
+			}
+
+			a = (a & ~(m - 1)) + m;
+		}
+	}
+
+	return n;
+}
+
+/* mmu_Report() - print the active layout and the TLB entries needed for the hot set
+*/
+void mmu_Report(void)
+{
+	static const char * const attr_names[] = { "code", "data", "device" };
+
+	dv_printf("MMU layout: %s\n", mmu_granuleNames[MMU_GRANULE]);
+
+	for ( int r = 0; r < mmu_nregions; r++ )
+	{
+		const struct mmu_region_s *rg = &mmu_regions[r];
+
+		dv_printf("  %s: 0x%08x size 0x%08x %s, mapped in units of 0x%08x, %u entries\n",
+			rg->name, (dv_u32_t)rg->base, rg->size, attr_names[rg->attr],
+			mmu_MappingSize(rg->base), mmu_EntriesFor(rg->base, rg->size));
+	}
+
+	dv_printf("Hot set:\n");
+
+	for ( int i = 0; i < mmu_hotset.n_ranges; i++ )
+	{
+		const struct mmu_hot_s *h = &mmu_hotset.ranges[i];
+
+		dv_printf("  %s: 0x%08x size 0x%08x, %u entries\n",
+			h->name, (dv_u32_t)h->start, h->size, mmu_EntriesFor(h->start, h->size));
+	}
+
+	dv_printf("  total: %u TLB entries\n", mmu_HotEntries());
+
+	if ( mmu_hotset.n_lost != 0 )
+		dv_printf("  (%d ranges not recorded - increase MMU_MAXHOT)\n", mmu_hotset.n_lost);
+}
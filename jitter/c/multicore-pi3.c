@@ -0,0 +1,362 @@
+/* multicore-pi3.c - core-to-core latency and timestamp skew on the pi3
+ *
+ * Cores 1 to 3 don't run davroska. They run mc_Worker(), which polls the core's mailbox for requests
+ * from core 0. mc_Bench() runs on core 0 (the "multicore" command) and measures, for each of the other cores:
+ *
+ *	- mailbox latency: from writing the other core's mailbox to the other core seeing the message (one way),
+ *	  and to core 0 seeing the reply (round trip). The mailbox interrupts are not used, so the times
+ *	  don't include interrupt entry.
+ *	- timestamp skew: the difference between the other core's timestamp and the midpoint of core 0's
+ *	  timestamps before and after the round trip, for the shared counter (dv_readtime()) and for
+ *	  each core's own generic timer counter. With a shared counter the skew only shows the asymmetry of
+ *	  the two directions; the local counters can also have an offset.
+ *	- cache line transfer: a counter in a cache line that the two cores increment in turn. Each round
+ *	  trip moves the line to the other core and back, so half of it is the transfer time.
+ *
+ * The times are in ticks of the shared counter (hw_TicksPerMicrosecond). Core 0's interrupts are disabled
+ * during each measurement, so the frames are delayed by a few microseconds at a time.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <frame-manager.h>
+#include <multicore.h>
+
+#include TARGET_HDR
+
+/* Requests in the mailbox of cores 1..3. Replies to core 0 are the bit (1 << core).
+*/
+#define MC_MSG_PING		0x01
+#define MC_MSG_LINE		0x02
+
+#define MC_LINE_ABORT	0xffffffff
+#define MC_FASTPOLLS	1000				/* Polls with interrupts disabled (about 100 us) */
+#define MC_TIMEOUT		1000000				/* Further polls, with interrupts enabled, before core 0 gives up */
+
+struct mc_core_s
+{
+	volatile dv_u32_t alive;
+	volatile dv_u64_t t_rx;					/* Shared counter when the request was seen */
+	volatile dv_u64_t c_rx;					/* Local counter when the request was seen */
+} __attribute__((aligned(FM_HOT_ALIGN)));
+
+struct mc_line_s
+{
+	volatile dv_u32_t seq;
+	volatile dv_u32_t n;
+} __attribute__((aligned(FM_HOT_ALIGN)));
+
+struct mc_stats_s
+{
+	struct timing_s t;
+	dv_u32_t histo[MC_HISTSIZE];
+	dv_u32_t n_over;						/* Samples beyond the histogram */
+};
+
+struct mc_skew_s
+{
+	dv_i64_t s_min;
+	dv_i64_t s_max;
+	dv_i64_t s_sum;
+	dv_u32_t n;
+};
+
+struct mc_core_s mc_cores[hw_NCores];
+struct mc_line_s mc_line;
+struct mc_stats_s mc_stats[2];
+
+static inline void mc_Barrier(void)
+{
+	__asm__ volatile("dsb sy" : : : "memory");
+}
+
+static void mc_InitStats(struct mc_stats_s *s)
+{
+	fm_InitTime(&s->t);
+	for ( int i = 0; i < MC_HISTSIZE; i++ )
+		s->histo[i] = 0;
+	s->n_over = 0;
+}
+
+static void mc_Store(struct mc_stats_s *s, dv_u64_t v)
+{
+	fm_StoreValue(&s->t, v);
+	if ( v < MC_HISTSIZE )
+		s->histo[v]++;
+	else
+		s->n_over++;
+}
+
+/* mc_Percentile() - the smallest value that at least q per mille of the samples don't exceed
+ *
+ * Returns MC_HISTSIZE if the value is beyond the histogram.
+*/
+static dv_u32_t mc_Percentile(struct mc_stats_s *s, dv_u32_t q)
+{
+	dv_u64_t need = ((dv_u64_t)s->t.n * q + 999) / 1000;
+	dv_u64_t sum = 0;
+
+	for ( dv_u32_t i = 0; i < MC_HISTSIZE; i++ )
+	{
+		sum += s->histo[i];
+		if ( sum >= need )
+			return i;
+	}
+	return MC_HISTSIZE;
+}
+
+static void mc_PrintStats(struct mc_stats_s *s, char *descr, int core)
+{
+	fm_PrintTimes(&s->t, descr, "core", core);
+	if ( s->t.n > 0 )
+		dv_printf("%s percentiles for core %d: p50 %u, p90 %u, p99 %u, p99.9 %u (%u beyond %u)\n", descr, core,
+					mc_Percentile(s, 500), mc_Percentile(s, 900), mc_Percentile(s, 990), mc_Percentile(s, 999),
+					s->n_over, MC_HISTSIZE);
+}
+
+static void mc_InitSkew(struct mc_skew_s *k)
+{
+	k->s_min = 0x7fffffffffffffff;
+	k->s_max = -k->s_min;
+	k->s_sum = 0;
+	k->n = 0;
+}
+
+static void mc_StoreSkew(struct mc_skew_s *k, dv_i64_t v)
+{
+	if ( k->s_min > v )	k->s_min = v;
+	if ( k->s_max < v )	k->s_max = v;
+	k->s_sum += v;
+	k->n++;
+}
+
+static void mc_PrintSkew(struct mc_skew_s *k, char *descr, int core)
+{
+	if ( k->n == 0 )
+		return;
+	dv_printf("%s for core %d: min %d, mean %d, max %d\n", descr, core,
+				(dv_i32_t)k->s_min, (dv_i32_t)(k->s_sum / (dv_i64_t)k->n), (dv_i32_t)k->s_max);
+}
+
+/* mc_WaitReply() - poll core 0's mailbox for the reply from core, at most n times. Returns 0 on timeout.
+*/
+static int mc_WaitReply(int core, int n)
+{
+	for ( int i = 0; i < n; i++ )
+	{
+		if ( (hw_MailboxRead(0, MC_MBOX) & (1u << core)) != 0 )
+		{
+			hw_MailboxClear(0, MC_MBOX, 1u << core);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* mc_LineWorker() - the other core's half of the cache line ping-pong
+*/
+static void mc_LineWorker(void)
+{
+	dv_u32_t n = mc_line.n;
+
+	for ( dv_u32_t i = 0; i < n; i++ )
+	{
+		dv_u32_t s;
+
+		while ( (s = mc_line.seq) != 2 * i + 1 )
+		{
+			if ( s == MC_LINE_ABORT )
+				return;
+		}
+		mc_line.seq = 2 * i + 2;
+	}
+}
+
+/* mc_Worker() - main loop of cores 1 to 3
+ *
+ * Unless the idle strategy is "spin", the core waits in WFE between polls of its mailbox.
+ * hw_MailboxWrite() wakes it with SEV.
+*/
+void mc_Worker(int core)
+{
+	struct mc_core_s *w = &mc_cores[core];
+
+	hw_MailboxClear(core, MC_MBOX, 0xffffffff);
+	w->alive = 1;
+
+	for (;;)
+	{
+		dv_u32_t m = hw_MailboxRead(core, MC_MBOX);
+
+		if ( m == 0 )
+		{
+			if ( fm_IdleStrategy() != fm_idleSpin )
+				hw_WaitForEvent();
+			continue;
+		}
+
+		dv_u64_t t = dv_readtime();
+		dv_u64_t c = hw_ReadLocalCounter();
+
+		hw_MailboxClear(core, MC_MBOX, m);
+
+		if ( m & MC_MSG_PING )
+		{
+			w->t_rx = t;
+			w->c_rx = c;
+			mc_Barrier();
+			hw_MailboxWrite(0, MC_MBOX, 1u << core);
+		}
+
+		if ( m & MC_MSG_LINE )
+		{
+			mc_LineWorker();
+		}
+	}
+}
+
+/* mc_WaitLine() - poll the cache line for the other core's reply to transfer i, at most n times.
+ * Returns 0 on timeout.
+*/
+static int mc_WaitLine(dv_u32_t i, int n)
+{
+	for ( int k = 0; k < n; k++ )
+	{
+		if ( mc_line.seq == 2 * i + 2 )
+			return 1;
+	}
+	return 0;
+}
+
+/* mc_Ping() - mailbox latency and timestamp skew for one core
+ *
+ * Core 0's interrupts are disabled for MC_FASTPOLLS polls at most. A reply that takes longer is
+ * waited for with interrupts enabled and counted as late instead of measured.
+*/
+static void mc_Ping(int core, dv_u32_t n)
+{
+	struct mc_core_s *w = &mc_cores[core];
+	struct mc_stats_s *oneway = &mc_stats[0];
+	struct mc_stats_s *rtt = &mc_stats[1];
+	struct mc_skew_s skew, lskew;
+	dv_u32_t n_timeouts = 0;
+	dv_u32_t n_late = 0;
+
+	mc_InitStats(oneway);
+	mc_InitStats(rtt);
+	mc_InitSkew(&skew);
+	mc_InitSkew(&lskew);
+
+	for ( dv_u32_t i = 0; i < n && n_timeouts < 10; i++ )
+	{
+		dv_intstatus_t is = dv_disable();
+
+		dv_u64_t c0 = hw_ReadLocalCounter();
+		dv_u64_t t0 = dv_readtime();
+		hw_MailboxWrite(core, MC_MBOX, MC_MSG_PING);
+		int ok = mc_WaitReply(core, MC_FASTPOLLS);
+		dv_u64_t t1 = dv_readtime();
+		dv_u64_t c1 = hw_ReadLocalCounter();
+
+		dv_restore(is);
+
+		if ( !ok )
+		{
+			if ( mc_WaitReply(core, MC_TIMEOUT) )
+				n_late++;
+			else
+				n_timeouts++;
+			continue;
+		}
+
+		mc_Store(oneway, w->t_rx - t0);
+		mc_Store(rtt, t1 - t0);
+		mc_StoreSkew(&skew, (dv_i64_t)(w->t_rx - t0) - (dv_i64_t)(t1 - t0) / 2);
+		mc_StoreSkew(&lskew, (dv_i64_t)(w->c_rx - c0) - (dv_i64_t)(c1 - c0) / 2);
+	}
+
+	mc_PrintStats(oneway, "Mailbox one-way", core);
+	mc_PrintStats(rtt, "Mailbox round trip", core);
+	mc_PrintSkew(&skew, "Shared counter skew (ticks)", core);
+	mc_PrintSkew(&lskew, "Local counter skew (local ticks)", core);
+	if ( n_late != 0 )
+		dv_printf("Mailbox late replies for core %d: %u\n", core, n_late);
+	if ( n_timeouts != 0 )
+		dv_printf("Mailbox timeouts for core %d: %u\n", core, n_timeouts);
+}
+
+/* mc_Line() - cache line transfer time for one core
+ *
+ * As in mc_Ping(), a transfer that takes longer than MC_FASTPOLLS polls is finished with interrupts
+ * enabled and counted as late.
+*/
+static void mc_Line(int core, dv_u32_t n)
+{
+	struct mc_stats_s *xfer = &mc_stats[0];
+	dv_u32_t i;
+	dv_u32_t n_late = 0;
+
+	mc_InitStats(xfer);
+	mc_line.seq = 0;
+	mc_line.n = n;
+	mc_Barrier();
+	hw_MailboxWrite(core, MC_MBOX, MC_MSG_LINE);
+
+	for ( i = 0; i < n; i++ )
+	{
+		dv_intstatus_t is = dv_disable();
+
+		dv_u64_t t0 = dv_readtime();
+		mc_line.seq = 2 * i + 1;
+		int ok = mc_WaitLine(i, MC_FASTPOLLS);
+		dv_u64_t t1 = dv_readtime();
+
+		dv_restore(is);
+
+		if ( ok )
+			mc_Store(xfer, (t1 - t0) / 2);
+		else
+		if ( mc_WaitLine(i, MC_TIMEOUT) )
+			n_late++;
+		else
+			break;
+	}
+
+	if ( i < n )
+	{
+		mc_line.seq = MC_LINE_ABORT;
+		dv_printf("Cache line transfer for core %d: no reply after %u transfers\n", core, i);
+	}
+	if ( n_late != 0 )
+		dv_printf("Cache line transfer late replies for core %d: %u\n", core, n_late);
+
+	mc_PrintStats(xfer, "Cache line transfer", core);
+}
+
+/* mc_Bench() - run the benchmark with n measurements per test on each of the other cores
+*/
+void mc_Bench(dv_u32_t n)
+{
+	if ( n == 0 )
+		n = MC_NSAMPLES;
+
+	dv_printf("Multicore: %u samples, shared counter %u ticks/us, local counter %u Hz\n",
+				n, hw_TicksPerMicrosecond, hw_LocalCounterFrequency());
+
+	hw_MailboxClear(0, MC_MBOX, 0xffffffff);
+
+	for ( int core = 1; core < hw_NCores; core++ )
+	{
+		if ( !mc_cores[core].alive )
+		{
+			dv_printf("Core %d isn't running mc_Worker()\n", core);
+			continue;
+		}
+		mc_Ping(core, n);
+		mc_Line(core, n);
+	}
+	dv_printf("\n");
+}
@@ -0,0 +1,373 @@
+/* osbench.c - cost of the davroska primitives (the "osbench" command)
+ *
+ * Three tasks pass control to each other with the primitives that the frame manager and the
+ * rate-monotonic manager use, and take a timestamp on each side of every transition:
+ *
+ *	ObA		activates ObHi, which has a higher priority and runs at once: "activate (preempt)" is the time from
+ *			the call to the start of ObHi. ObHi terminates: "terminate (resume)" is the time to the return to ObA.
+ *			ObA then arms the budget timer and waits. The budget ISR activates ObHi: "ISR activate" is the
+ *			call in the ISR, and "ISR -> task" the time from the ISR to the start of ObHi (the rest of the ISR,
+ *			the kernel's interrupt exit and the dispatch). The kernel's interrupt entry is only measured
+ *			with the 1 MHz system timer ("ISR entry", from the compare match to the ISR).
+ *			ObA activates ObB, which has the same priority: "activate (queued)" is the call on its own.
+ *			ObA terminates: "terminate (dispatch)" is the time to the start of ObB.
+ *	ObB		chains ObA for the next iteration: "chain" is the time from the call to the start of ObA.
+ *
+ * After a warm-up iteration, n iterations run with warm caches and n with cold caches. In the cold
+ * iterations the cache operations that are selected with "ops" (all of them if none are) are executed
+ * just before each measured primitive, so the primitive runs as it would at the start of a frame after
+ * cache maintenance.
+ *
+ * The times are in ticks of the shared counter (hw_TicksPerMicrosecond). They include one call to
+ * dv_readtime(), whose own cost is measured first. The benchmark's tasks have a higher priority than
+ * the frames and it uses the budget timer, so the "osbench" command refuses to run unless the
+ * experiment is stopped. The timer and uart ISRs can still interrupt it.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <frame-manager.h>
+#include <osbench.h>
+
+#include TARGET_HDR
+
+#include <dv-arm-cache.h>
+
+#define OB_TIMEOUT		(hw_TicksPerMicrosecond * 10000)	/* Wait for the budget ISR before giving up */
+
+/* The measurements
+*/
+#define OB_READTIME		0
+#define OB_ACTPREEMPT	1
+#define OB_TERMRESUME	2
+#define OB_ISRACT		3
+#define OB_ISRTASK		4
+#define OB_ACTQUEUE		5
+#define OB_TERMDISPATCH	6
+#define OB_CHAIN		7
+#define OB_NPRIM		8
+
+static const char * const ob_primNames[OB_NPRIM] =
+{	"dv_readtime",
+	"activate (preempt)",
+	"terminate (resume)",
+	"ISR activate",
+	"ISR -> task",
+	"activate (queued)",
+	"terminate (dispatch)",
+	"chain"
+};
+
+/* What ObHi has been activated for
+*/
+#define OB_PH_TASK		0
+#define OB_PH_ISR		1
+
+struct ob_stats_s
+{
+	struct timing_s t;
+	dv_u32_t histo[OB_HISTSIZE];
+	dv_u32_t n_over;						/* Samples beyond the histogram */
+};
+
+struct ob_state_s
+{
+	dv_u32_t n;								/* Iterations of each variant */
+	dv_u32_t iter;							/* 0 = warm-up, 1..n warm, n+1..2n cold */
+	int cold;
+	volatile int active;
+	volatile int phase;
+	volatile int isr_done;
+	dv_u32_t n_timeouts;
+	dv_u64_t t_mark;						/* Timestamp just before a primitive that switches tasks */
+	struct cacheop_s ops;
+	struct timing_s entry[2];				/* ISR entry latency in microseconds */
+};
+
+static dv_id_t ObA, ObB, ObHi;
+static struct ob_state_s ob;
+static struct ob_stats_s ob_stats[2][OB_NPRIM];
+
+/* ob_Record() - store a measurement of the current variant. The warm-up iteration isn't recorded.
+*/
+static void ob_Record(int prim, dv_u64_t v)
+{
+	if ( ob.iter == 0 )
+		return;
+
+	struct ob_stats_s *s = &ob_stats[ob.cold][prim];
+
+	fm_StoreValue(&s->t, v);
+	if ( (v >> OB_HISTSHIFT) < OB_HISTSIZE )
+		s->histo[v >> OB_HISTSHIFT]++;
+	else
+		s->n_over++;
+}
+
+/* ob_Prepare() - in the cold iterations, execute the cache operations as in fm_CacheMaintenance()
+*/
+static void ob_Prepare(void)
+{
+	if ( !ob.cold )
+		return;
+
+	if ( ob.ops.icache )		dv_invalidate_entire_instruction_cache();
+	if ( ob.ops.dcache )		dv_clean_entire_data_cache();
+	if ( ob.ops.prefetch )		dv_flush_prefetch_buffer();
+	if ( ob.ops.branchpredict )	dv_flush_entire_branch_target_cache();
+	if ( ob.ops.tlb )			hw_InvalidateTlb();
+}
+
+/* main_ObA() - task body: activate a higher priority task, wait for an ISR, activate and dispatch ObB
+*/
+void main_ObA(void)
+{
+	dv_u64_t t = dv_readtime();
+
+	ob_Record(OB_CHAIN, t - ob.t_mark);
+
+	/* Back to back
+	*/
+	ob_Prepare();
+	t = dv_readtime();
+	ob_Record(OB_READTIME, dv_readtime() - t);
+
+	/* ObHi preempts at once and measures the activation. It sets t_mark just before it terminates.
+	*/
+	ob.phase = OB_PH_TASK;
+	ob_Prepare();
+	ob.t_mark = dv_readtime();
+	dv_activatetask(ObHi);
+	ob_Record(OB_TERMRESUME, dv_readtime() - ob.t_mark);
+
+	/* The budget ISR activates ObHi, which measures the time from the ISR
+	*/
+	ob.phase = OB_PH_ISR;
+	ob.isr_done = 0;
+	ob_Prepare();
+	hw_SetBudgetTimer(OB_ISRDELAY);
+
+	t = dv_readtime();
+	while ( !ob.isr_done )
+	{
+		if ( (dv_readtime() - t) > OB_TIMEOUT )
+		{
+			ob.n_timeouts++;
+			break;
+		}
+	}
+
+	/* Same priority: no task switch
+	*/
+	ob_Prepare();
+	t = dv_readtime();
+	dv_activatetask(ObB);
+	ob_Record(OB_ACTQUEUE, dv_readtime() - t);
+
+	ob_Prepare();
+	ob.t_mark = dv_readtime();
+	dv_terminatetask();
+}
+
+/* main_ObB() - task body: measure the dispatch after ObA terminates, then chain the next iteration
+*/
+void main_ObB(void)
+{
+	dv_u64_t t = dv_readtime();
+
+	ob_Record(OB_TERMDISPATCH, t - ob.t_mark);
+
+	ob.iter++;
+	if ( ob.iter > 2 * ob.n )
+	{
+		ob.active = 0;
+		return;
+	}
+
+	ob.cold = (ob.iter > ob.n);
+	ob_Prepare();
+	ob.t_mark = dv_readtime();
+	dv_chaintask(ObA);
+}
+
+/* main_ObHi() - task body: measure the activation, from ObA or from the budget ISR
+*/
+void main_ObHi(void)
+{
+	dv_u64_t t = dv_readtime();
+
+	if ( ob.phase == OB_PH_ISR )
+	{
+		ob_Record(OB_ISRTASK, t - ob.t_mark);
+		ob.isr_done = 1;
+		return;
+	}
+
+	ob_Record(OB_ACTPREEMPT, t - ob.t_mark);
+
+	ob_Prepare();
+	ob.t_mark = dv_readtime();
+	dv_terminatetask();
+}
+
+/* ob_BudgetIsr() - called by the budget ISR. Returns 0 if the benchmark isn't running.
+ *
+ * The interrupt has already been cleared.
+*/
+int ob_BudgetIsr(void)
+{
+	if ( !ob.active )
+		return 0;
+
+	if ( ob.phase != OB_PH_ISR )
+		return 1;
+
+	dv_u32_t late = hw_systimer.clo - hw_systimer.c[HW_BUDGETCHANNEL];
+
+	if ( ob.iter > 0 )
+		fm_StoreValue(&ob.entry[ob.cold], late);
+
+	dv_u64_t t = dv_readtime();
+	dv_activatetask(ObHi);
+	ob.t_mark = dv_readtime();
+	ob_Record(OB_ISRACT, ob.t_mark - t);
+
+	return 1;
+}
+
+/* ob_CreateTasks() - create the benchmark's tasks
+*/
+void ob_CreateTasks(void)
+{
+	ObA = dv_addtask("ObA", &main_ObA, OB_PRIO, 1);
+	ObB = dv_addtask("ObB", &main_ObB, OB_PRIO, 1);
+	ObHi = dv_addtask("ObHi", &main_ObHi, OB_PRIO_HI, 1);
+}
+
+/* ob_Percentile() - the upper edge of the bucket of the smallest value that at least q per mille
+ * of the samples don't exceed
+ *
+ * Returns the end of the histogram if the value is beyond it.
+*/
+static dv_u32_t ob_Percentile(struct ob_stats_s *s, dv_u32_t q)
+{
+	dv_u64_t need = ((dv_u64_t)s->t.n * q + 999) / 1000;
+	dv_u64_t sum = 0;
+
+	for ( dv_u32_t i = 0; i < OB_HISTSIZE; i++ )
+	{
+		sum += s->histo[i];
+		if ( sum >= need )
+			return ((i + 1) << OB_HISTSHIFT) - 1;
+	}
+	return OB_HISTSIZE << OB_HISTSHIFT;
+}
+
+/* ob_Print() - print the results as a table
+*/
+static void ob_Print(void)
+{
+	static const char * const variant[2] = { "warm", "cold" };
+	char ops[6];
+	int n = 0;
+
+	if ( ob.ops.icache )		ops[n++] = 'i';
+	if ( ob.ops.dcache )		ops[n++] = 'd';
+	if ( ob.ops.prefetch )		ops[n++] = 'p';
+	if ( ob.ops.branchpredict )	ops[n++] = 'b';
+	if ( ob.ops.tlb )			ops[n++] = 't';
+	ops[n] = '\0';
+
+	dv_printf("OS primitives (ticks, %u per us): %u iterations warm and %u cold (ops %s before each primitive)\n",
+				hw_TicksPerMicrosecond, ob.n, ob.n, ops);
+	dv_printf("  %-20s %4s %8s %8s %8s %8s %8s %8s %6s\n",
+				"primitive", "", "min", "mean", "p50", "p90", "p99", "max", "over");
+
+	for ( int p = 0; p < OB_NPRIM; p++ )
+	{
+		for ( int c = 0; c < 2; c++ )
+		{
+			struct ob_stats_s *s = &ob_stats[c][p];
+
+			if ( s->t.n == 0 )
+				continue;
+
+			dv_printf("  %-20s %4s %8u %8u %8u %8u %8u %8u %6u\n", ob_primNames[p], variant[c],
+						fm_Clip32(s->t.t_min), fm_Clip32(s->t.t_sum / s->t.n),
+						ob_Percentile(s, 500), ob_Percentile(s, 900), ob_Percentile(s, 990),
+						fm_Clip32(s->t.t_max), s->n_over);
+		}
+	}
+
+	for ( int c = 0; c < 2; c++ )
+	{
+		struct timing_s *e = &ob.entry[c];
+
+		if ( e->n > 0 )
+			dv_printf("  ISR entry (us) %s: min %u, mean %u, max %u\n", variant[c],
+						fm_Clip32(e->t_min), fm_Clip32(e->t_sum / e->n), fm_Clip32(e->t_max));
+	}
+
+	dv_printf("Percentiles to within %u ticks. Budget ISR timeouts %u\n\n", 1 << OB_HISTSHIFT, ob.n_timeouts);
+}
+
+/* ob_Bench() - run the benchmark with n iterations of each variant
+ *
+ * The benchmark's tasks have a higher priority than the caller (the idle loop), so they have run
+ * all the iterations when dv_activatetask() returns.
+*/
+void ob_Bench(dv_u32_t n)
+{
+	struct fm_config_s cfg;
+
+	if ( n == 0 )
+		n = OB_NITERATIONS;
+
+	for ( int c = 0; c < 2; c++ )
+	{
+		for ( int p = 0; p < OB_NPRIM; p++ )
+		{
+			struct ob_stats_s *s = &ob_stats[c][p];
+
+			fm_InitTime(&s->t);
+			for ( int i = 0; i < OB_HISTSIZE; i++ )
+				s->histo[i] = 0;
+			s->n_over = 0;
+		}
+		fm_InitTime(&ob.entry[c]);
+	}
+
+	fm_GetConfig(&cfg);
+	ob.ops = cfg.cacheop;
+	if ( !(ob.ops.icache || ob.ops.dcache || ob.ops.prefetch || ob.ops.branchpredict || ob.ops.tlb) )
+	{
+		ob.ops.icache = 1;
+		ob.ops.dcache = 1;
+		ob.ops.prefetch = 1;
+		ob.ops.branchpredict = 1;
+		ob.ops.tlb = 1;
+	}
+
+	ob.n = n;
+	ob.iter = 0;
+	ob.cold = 0;
+	ob.n_timeouts = 0;
+	ob.t_mark = 0;
+	ob.active = 1;
+
+	dv_activatetask(ObA);
+
+	hw_CancelBudgetTimer();
+
+	if ( ob.active )
+	{
+		ob.active = 0;
+		dv_printf("osbench: the benchmark didn't complete (%u iterations)\n", ob.iter);
+		return;
+	}
+
+	ob_Print();
+}
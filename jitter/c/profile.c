@@ -0,0 +1,159 @@
+/* profile.c - function profile of the frame path (make PROFILE=1)
+ *
+ * The program is compiled with -finstrument-functions, so the compiler inserts a call to
+ * __cyg_profile_func_enter() at the start of every function. This file is compiled without
+ * the instrumentation.
+ *
+ * A frame starts when main_FrameStart() is entered. For each function the profile records the
+ * number of calls, the number of frames in which it was called and the sum of its positions in the
+ * frames' sequences of functions (the first function of a frame has position 0, the next new one 1
+ * and so on). tools/hotlayout.py reads the "P" lines of pf_Print() and lays out the functions that run
+ * in most frames in the order of their mean position.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <profile.h>
+#include <uart-buffer.h>
+
+struct pf_func_s
+{
+	void *fn;
+	dv_u32_t calls;
+	dv_u32_t frames;					/* No. of frames in which the function was called */
+	dv_u32_t last_frame;				/* The last frame in which the function was called */
+	dv_u32_t position_sum;				/* Sum of the positions in the frames */
+};
+
+struct pf_profile_s
+{
+	struct pf_func_s funcs[PF_NFUNCS];
+	dv_u32_t n_funcs;
+	dv_u32_t n_lost;					/* Calls that didn't fit in the table */
+	dv_u32_t frame;						/* No. of frames since the reset */
+	dv_u32_t position;					/* Next position in the current frame */
+	volatile int enabled;
+};
+
+struct pf_profile_s pf_profile;
+
+extern void main_FrameStart(void);
+
+void __cyg_profile_func_enter(void *fn, void *caller) __attribute__((no_instrument_function));
+void __cyg_profile_func_exit(void *fn, void *caller) __attribute__((no_instrument_function));
+
+/* __cyg_profile_func_enter() - called on entry to every instrumented function
+ *
+ * Functions are found by open addressing on their address. Calls from interrupts that arrive
+ * during the lookup can be lost or counted twice; the counts are only used for ordering.
+*/
+void __cyg_profile_func_enter(void *fn, void *caller)
+{
+	if ( !pf_profile.enabled )
+		return;
+
+	if ( fn == (void *)main_FrameStart )
+	{
+		pf_profile.frame++;
+		pf_profile.position = 0;
+	}
+	else
+	if ( pf_profile.frame == 0 )
+		return;								/* Nothing is recorded until the first frame starts */
+
+	dv_u32_t h = ((unsigned long)fn >> 2) & (PF_NFUNCS - 1);
+
+	for ( int i = 0; i < PF_NFUNCS; i++ )
+	{
+		struct pf_func_s *f = &pf_profile.funcs[h];
+
+		if ( f->fn == fn )
+		{
+			f->calls++;
+			if ( f->last_frame != pf_profile.frame )
+			{
+				f->last_frame = pf_profile.frame;
+				f->frames++;
+				f->position_sum += pf_profile.position++;
+			}
+			return;
+		}
+
+		if ( f->fn == 0 )
+		{
+			f->fn = fn;
+			f->calls = 1;
+			f->frames = 1;
+			f->last_frame = pf_profile.frame;
+			f->position_sum = pf_profile.position++;
+			pf_profile.n_funcs++;
+			return;
+		}
+
+		h = (h + 1) & (PF_NFUNCS - 1);
+	}
+
+	pf_profile.n_lost++;
+}
+
+void __cyg_profile_func_exit(void *fn, void *caller)
+{
+}
+
+/* pf_Enable() - start or stop recording
+*/
+void pf_Enable(int on)
+{
+	pf_profile.enabled = on;
+}
+
+/* pf_Reset() - clear the profile
+*/
+void pf_Reset(void)
+{
+	int was_enabled = pf_profile.enabled;
+
+	pf_profile.enabled = 0;
+
+	for ( int i = 0; i < PF_NFUNCS; i++ )
+	{
+		pf_profile.funcs[i].fn = 0;
+	}
+	pf_profile.n_funcs = 0;
+	pf_profile.n_lost = 0;
+	pf_profile.frame = 0;
+	pf_profile.position = 0;
+
+	pf_profile.enabled = was_enabled;
+}
+
+/* pf_Print() - print the profile
+ *
+ * One line per function: "P address calls frames position_sum"
+ * The addresses are mapped to names by tools/hotlayout.py using the symbol table of the ELF file.
+*/
+void pf_Print(void)
+{
+	int was_enabled = pf_profile.enabled;
+
+	pf_profile.enabled = 0;
+
+	dv_printf("Profile: %u frames, %u functions, %u calls lost\n", pf_profile.frame, pf_profile.n_funcs, pf_profile.n_lost);
+
+	for ( int i = 0; i < PF_NFUNCS; i++ )
+	{
+		struct pf_func_s *f = &pf_profile.funcs[i];
+
+		if ( f->fn != 0 )
+		{
+			ub_WaitSpace(64);
+			dv_printf("P %lx %u %u %u\n", (unsigned long)f->fn, f->calls, f->frames, f->position_sum);
+		}
+	}
+	dv_printf("\n");
+
+	pf_profile.enabled = was_enabled;
+}
@@ -0,0 +1,461 @@
+/* rm-manager.c - rate-monotonic preemptive scheduling of the experiment's tasks
+ *
+ * This is the alternative to the frame manager (make SCHED=rm). Each task has a period and an offset.
+ * It is activated by its own davroska alarm on a counter that the timer ISR advances every RM_TICK
+ * microseconds. The task priorities are assigned in callout_addtasks(): the shorter the period, the
+ * higher the priority, so a long task can be preempted by a shorter one.
+ *
+ * The tasks call rm_TaskStart() and rm_TaskEnd() where the frame-based build calls fm_TaskStart() and
+ * fm_TaskEnd(). A round is the hyperperiod (the least common multiple of the periods). The results use
+ * the same format as the frame manager's; each activation is reported with the frame and job of the
+ * default mode that it corresponds to, so the two schedulers can be compared with the same tools.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <frame-manager.h>
+#include <rm-manager.h>
+#include <dv-stdio.h>
+#include <uart-buffer.h>
+
+#include TARGET_HDR
+
+/* For the experiment: keep the latency and runtime of every activation in a sample buffer
+ * of this size. Comment out to omit the sample buffer.
+*/
+#define RM_NSAMPLES		8192
+
+struct rmtask_s
+{
+	const char *name;
+	dv_id_t task;
+	dv_id_t alarm;
+	dv_u32_t period;				/* Counter ticks */
+	dv_u32_t offset;				/* Counter ticks */
+	dv_u32_t next_phase;			/* Position of the next activation in the round (ticks) */
+	dv_u32_t phase;					/* Position of the current activation in the round (ticks) */
+	dv_u64_t activation_time;
+	dv_u64_t start_time;
+	dv_u64_t prev_start_time;
+	volatile int active;			/* Activated and not yet ended */
+	int record;						/* The current activation is recorded */
+	dv_qty_t n_missed;				/* Activations that found the previous one still running */
+	struct timing_s latency;		/* From activation to start */
+	struct timing_s response;		/* From activation to end */
+	struct timing_s runtime;		/* From start to end, including preemption */
+	struct timing_s interval;		/* From previous start time to new start time */
+};
+
+struct rmmanager_s
+{
+	struct rmtask_s tasks[RM_MAXTASKS];
+	dv_i8_t byTask[DV_CFG_MAXEXE];	/* Index in tasks[] of each davroska task, or -1 */
+	dv_qty_t n_tasks;
+	dv_id_t counter;
+	dv_u32_t hyperperiod;			/* Length of a round (ticks) */
+	dv_u32_t tick;					/* Position in the round (ticks) */
+	dv_u64_t tick_time;				/* Time of the last tick */
+	dv_u64_t rounds;				/* Completed rounds */
+	dv_u64_t warmup_end;			/* Results are ignored until rounds reaches this value */
+	dv_u32_t nrounds;
+	dv_u32_t ignorerounds;
+	int in_round;					/* A complete round has started since the start */
+	int recording;
+	dv_u32_t n_resets;				/* No. of times the statistics have been reset */
+	int stopped;
+	volatile int print;				/* Print the results from the idle loop */
+};
+
+struct rmmanager_s rmmanager FM_HOT_DATA;
+
+#ifdef RM_NSAMPLES
+struct rmsample_s
+{
+	dv_u32_t round;
+	dv_u16_t frame;
+	dv_u8_t index;					/* Index in tasks[] */
+	dv_u32_t latency;
+	dv_u32_t runtime;
+};
+
+struct rmsamplebuffer_s
+{
+	struct rmsample_s samples[RM_NSAMPLES];
+	dv_qty_t n_samples;
+	dv_qty_t n_dropped;
+};
+
+struct rmsamplebuffer_s rmsamplebuffer;
+#endif
+
+static dv_u64_t rm_Alarm(dv_id_t a, dv_param_t d);
+static void rm_ResetStats(void);
+
+/* rm_Gcd() - greatest common divisor, for the hyperperiod
+*/
+static dv_u32_t rm_Gcd(dv_u32_t a, dv_u32_t b)
+{
+	while ( b != 0 )
+	{
+		dv_u32_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/* rm_CreateCounter() - create the counter that drives the alarms
+ *
+ * To be called in the davroska callout_addcounters() function
+*/
+void rm_CreateCounter(void)
+{
+	rmmanager.counter = dv_addcounter("RmTicker");
+
+	for ( int i = 0; i < DV_CFG_MAXEXE; i++ )
+		rmmanager.byTask[i] = -1;
+}
+
+/* rm_AddTask() - add a periodic task. The period and offset are in microseconds.
+ *
+ * To be called in the davroska callout_addalarms() function. The task must already exist.
+*/
+void rm_AddTask(const char *name, dv_id_t task, dv_u32_t period, dv_u32_t offset)
+{
+	if ( rmmanager.n_tasks >= RM_MAXTASKS || task < 0 || task >= DV_CFG_MAXEXE || period < RM_TICK )
+	{
+		dv_printf("rm_AddTask: can't add %s\n", name);
+		return;
+	}
+
+	dv_id_t i = rmmanager.n_tasks++;
+	struct rmtask_s *t = &rmmanager.tasks[i];
+
+	t->name = name;
+	t->task = task;
+	t->period = period / RM_TICK;
+	t->offset = (offset / RM_TICK) % t->period;
+	t->next_phase = t->offset;
+	t->alarm = dv_addalarm(name, &rm_Alarm, (dv_param_t)i);
+	rmmanager.byTask[task] = i;
+
+	if ( rmmanager.hyperperiod == 0 )
+		rmmanager.hyperperiod = t->period;
+	else
+		rmmanager.hyperperiod = (rmmanager.hyperperiod / rm_Gcd(rmmanager.hyperperiod, t->period)) * t->period;
+}
+
+/* rm_Start() - start the alarms and the timer
+ *
+ * The counter is advanced at the start of each tick, so a task with offset 0 is activated in the
+ * first tick. The number of rounds and warm-up rounds are taken from the frame manager's configuration.
+*/
+void rm_Start(void)
+{
+	struct fm_config_s cfg;
+
+	fm_GetConfig(&cfg);
+	rmmanager.nrounds = cfg.nrounds;
+	rmmanager.ignorerounds = cfg.ignorerounds;
+	rmmanager.tick = 0;
+	rmmanager.rounds = 0;
+	rm_ResetStats();
+
+	for ( int i = 0; i < rmmanager.n_tasks; i++ )
+	{
+		dv_setalarm_rel(rmmanager.counter, rmmanager.tasks[i].alarm, rmmanager.tasks[i].offset + 1);
+	}
+
+	hw_InitialiseTicker(RM_TICK * hw_TicksPerMicrosecond);
+	hw_SetTimerReload(RM_TICK * hw_TicksPerMicrosecond);
+
+	dv_printf("Rate-monotonic scheduling: %d tasks, tick %d us, round %u ticks\n",
+				rmmanager.n_tasks, RM_TICK, rmmanager.hyperperiod);
+}
+
+/* rm_Tick() - called by the timer ISR every RM_TICK microseconds
+ *
+ * Handles the round boundary, then advances the counter, which activates the tasks that are due.
+*/
+FM_HOT_TEXT void rm_Tick(void)
+{
+	rmmanager.tick_time = dv_readtime();
+
+	if ( rmmanager.tick == 0 && !rmmanager.stopped )
+	{
+		if ( rmmanager.in_round )
+			rmmanager.rounds++;
+		rmmanager.in_round = 1;
+
+		if ( (rmmanager.nrounds != 0) && (rmmanager.rounds >= rmmanager.nrounds) )
+		{
+			rmmanager.stopped = 1;
+			rmmanager.in_round = 0;
+			rmmanager.print = 1;
+		}
+		rmmanager.recording = rmmanager.in_round && (rmmanager.rounds >= rmmanager.warmup_end);
+	}
+
+	dv_advancecounter(rmmanager.counter, 1);
+
+	rmmanager.tick++;
+	if ( rmmanager.tick >= rmmanager.hyperperiod )
+		rmmanager.tick = 0;
+}
+
+/* rm_Alarm() - alarm callback: activate a task
+ *
+ * An activation that finds the previous one still running is counted as missed; activating the task
+ * again would exceed its activation limit.
+*/
+FM_HOT_TEXT static dv_u64_t rm_Alarm(dv_id_t a, dv_param_t d)
+{
+	struct rmtask_s *t = &rmmanager.tasks[d];
+	dv_u32_t phase = t->next_phase;
+
+	t->next_phase += t->period;
+	if ( t->next_phase >= rmmanager.hyperperiod )
+		t->next_phase -= rmmanager.hyperperiod;
+
+	if ( !rmmanager.stopped )
+	{
+		if ( t->active )
+		{
+			t->n_missed++;
+		}
+		else
+		{
+			t->activation_time = dv_readtime();
+			t->phase = phase;
+			t->record = rmmanager.recording;
+			t->active = 1;
+			dv_activatetask(t->task);
+		}
+	}
+
+	return t->period;
+}
+
+/* rm_TaskStart() - called at the start of every task
+ *
+ * A task that wasn't added with rm_AddTask() isn't timed.
+*/
+FM_HOT_TEXT void rm_TaskStart(dv_id_t task)
+{
+	dv_id_t i = rmmanager.byTask[task];
+
+	if ( i < 0 )
+		return;
+
+	rmmanager.tasks[i].start_time = dv_readtime();
+}
+
+/* rm_TaskEnd() - called at the end of every task
+ *
+ * Records the times of the activation, then terminates the task.
+ * A task that wasn't added with rm_AddTask() is only terminated.
+*/
+FM_HOT_TEXT void rm_TaskEnd(dv_id_t task)
+{
+	dv_u64_t end_time = dv_readtime();
+	dv_id_t i = rmmanager.byTask[task];
+
+	if ( i < 0 )
+	{
+		dv_terminatetask();
+		return;
+	}
+
+	struct rmtask_s *t = &rmmanager.tasks[i];
+
+	if ( t->record )
+	{
+		fm_StoreTime(&t->latency, t->activation_time, t->start_time);
+		fm_StoreTime(&t->response, t->activation_time, end_time);
+		fm_StoreTime(&t->runtime, t->start_time, end_time);
+		fm_StoreTime(&t->interval, t->prev_start_time, t->start_time);
+
+#ifdef RM_NSAMPLES
+		if ( rmsamplebuffer.n_samples < RM_NSAMPLES )
+		{
+			struct rmsample_s *s = &rmsamplebuffer.samples[rmsamplebuffer.n_samples++];
+			s->round = (dv_u32_t)rmmanager.rounds;
+			s->frame = (t->phase * RM_TICK) / RM_FRAME;
+			s->index = i;
+			s->latency = fm_Clip32(t->start_time - t->activation_time);
+			s->runtime = fm_Clip32(end_time - t->start_time);
+		}
+		else
+		{
+			rmsamplebuffer.n_dropped++;
+		}
+#endif
+	}
+
+	t->prev_start_time = t->record ? t->start_time : 0;
+	t->active = 0;
+
+	dv_terminatetask();
+}
+
+/* rm_StatsRecording(), rm_StatsResets(), rm_Stopped() - as fm_StatsRecording(), fm_StatsResets()
+ * and fm_Stopped()
+*/
+int rm_StatsRecording(void)
+{
+	return rmmanager.recording;
+}
+
+int rm_Stopped(void)
+{
+	return rmmanager.stopped;
+}
+
+dv_u32_t rm_StatsResets(void)
+{
+	return rmmanager.n_resets;
+}
+
+/* rm_ResetStats() - reset all the statistics
+*/
+static void rm_ResetStats(void)
+{
+	rmmanager.warmup_end = rmmanager.rounds + rmmanager.ignorerounds;
+	rmmanager.recording = 0;
+	rmmanager.n_resets++;
+
+	for ( int i = 0; i < rmmanager.n_tasks; i++ )
+	{
+		struct rmtask_s *t = &rmmanager.tasks[i];
+
+		t->record = 0;
+		t->prev_start_time = 0;
+		t->n_missed = 0;
+		fm_InitTime(&t->latency);
+		fm_InitTime(&t->response);
+		fm_InitTime(&t->runtime);
+		fm_InitTime(&t->interval);
+	}
+
+#ifdef RM_NSAMPLES
+	rmsamplebuffer.n_samples = 0;
+	rmsamplebuffer.n_dropped = 0;
+#endif
+}
+
+/* rm_Request() - apply a request from the command interpreter (FM_REQ_xxx)
+ *
+ * Called from background (idle) level. Unlike the frame manager's requests, these take effect immediately.
+ * A start begins recording at the next round boundary.
+*/
+void rm_Request(dv_u32_t req)
+{
+	struct fm_config_s cfg;
+
+	fm_GetConfig(&cfg);
+
+	dv_intstatus_t is = dv_disable();
+
+	if ( req & FM_REQ_CONFIG )
+	{
+		rmmanager.nrounds = cfg.nrounds;
+		rmmanager.ignorerounds = cfg.ignorerounds;
+	}
+
+	if ( req & FM_REQ_RESET )
+	{
+		rm_ResetStats();
+	}
+
+	if ( req & FM_REQ_STOP )
+	{
+		rmmanager.stopped = 1;
+	}
+
+	if ( req & FM_REQ_START )
+	{
+		rmmanager.rounds = 0;
+		rmmanager.in_round = 0;
+		rm_ResetStats();
+		rmmanager.stopped = 0;
+	}
+
+	dv_restore(is);
+}
+
+/* rm_NextTick() - the time when the next tick is due, or 0 if the timer hasn't ticked yet
+*/
+dv_u64_t rm_NextTick(void)
+{
+	if ( rmmanager.tick_time == 0 )
+		return 0;
+
+	return rmmanager.tick_time + RM_TICK * hw_TicksPerMicrosecond;
+}
+
+/* rm_Poll() - print the results when a run has finished
+ *
+ * Called from the idle loop, so all the tasks of the last round have ended.
+*/
+void rm_Poll(void)
+{
+	if ( rmmanager.print )
+	{
+		rmmanager.print = 0;
+		rm_PrintResults();
+	}
+}
+
+/* rm_PrintResults() - print all the timing at the end of the run
+ *
+ * The "Config:" and "S" lines have the same format as the frame manager's. The mode is called "rm".
+*/
+void rm_PrintResults(void)
+{
+	dv_printf("Config: mode rm rounds %u ignore %u idle %s\n", rmmanager.nrounds, rmmanager.ignorerounds,
+				fm_idleNames[fm_IdleStrategy()]);
+	dv_printf("Rounds %u, round %u us, tick %d us\n", (dv_u32_t)rmmanager.rounds,
+				rmmanager.hyperperiod * RM_TICK, RM_TICK);
+
+	for ( int i = 0; i < rmmanager.n_tasks; i++ )
+	{
+		struct rmtask_s *t = &rmmanager.tasks[i];
+
+		dv_printf("Task %d (%s): period %u us, offset %u us, %d missed activations\n", i, t->name,
+					t->period * RM_TICK, t->offset * RM_TICK, t->n_missed);
+		fm_PrintTimes(&t->interval, "  Interval", "task", i);
+		fm_PrintTimes(&t->latency, "  Latency", "task", i);
+		fm_PrintTimes(&t->runtime, "  Runtime", "task", i);
+		fm_PrintTimes(&t->response, "  Response", "task", i);
+	}
+	dv_printf("\n");
+
+#ifdef RM_NSAMPLES
+	dv_qty_t n_unmapped = 0;
+
+	dv_printf("Samples: %d (%d dropped)\n", rmsamplebuffer.n_samples, rmsamplebuffer.n_dropped);
+
+	for ( int i = 0; i < rmsamplebuffer.n_samples; i++ )
+	{
+		struct rmsample_s *s = &rmsamplebuffer.samples[i];
+		dv_id_t j = fm_FindJob(0, s->frame, rmmanager.tasks[s->index].task);
+
+		if ( j < 0 )
+		{
+			n_unmapped++;
+			continue;
+		}
+
+		ub_WaitSpace(64);
+		dv_printf("S %u %d %d %d %u %u\n", s->round, 0, s->frame, j, s->latency, s->runtime);
+	}
+
+	if ( n_unmapped != 0 )
+		dv_printf("%d samples have no job in the default mode\n", n_unmapped);
+	dv_printf("\n");
+#endif
+
+	ub_PrintStats();
+}
@@ -0,0 +1,170 @@
+/* uart-buffer.c - buffered output for the uart
+ *
+ * dv_printf() normally writes each character to the uart synchronously. At 115200 baud that
+ * takes about 87 us per character, so printing the results from a frame task ruins the timing
+ * of the frames that follow.
+ *
+ * ub_Init() redirects the console output into a ring buffer. Writing a character then costs
+ * only a copy. The buffer is emptied by the uart's transmitter-empty interrupt (UB_TXINTERRUPT = 1)
+ * or by calling ub_Poll() from the idle loop.
+ * If the buffer is full, characters are dropped and counted.
+ *
+ * ub_Flush() empties the buffer synchronously and switches the console back to direct output.
+ * It is intended for error and panic reporting, where the interrupt might never come.
+ *
+ * (c) David Haworth
+*/
+#define DV_ASM	0
+#include <dv-config.h>
+#include <davroska.h>
+#include <dv-stdio.h>
+#include <uart-buffer.h>
+
+#include TARGET_HDR
+
+struct uartbuffer_s
+{
+	char txbuf[UB_TXSIZE];
+	volatile dv_u32_t head;		/* Next position to write */
+	volatile dv_u32_t tail;		/* Next position to send */
+	dv_u32_t n_dropped;
+	dv_u32_t max_used;
+	int (*direct_putc)(int c);
+};
+
+struct uartbuffer_s uartbuffer;
+
+static inline dv_u32_t ub_Used(void)
+{
+	return uartbuffer.head - uartbuffer.tail;
+}
+
+/* ub_Transmit() - move characters from the ring buffer to the uart until one or the other is full/empty
+ *
+ * Must be called with interrupts disabled.
+*/
+static void ub_Transmit(void)
+{
+	while ( (uartbuffer.tail != uartbuffer.head) && dv_arm_bcm2835_uart_istx() )
+	{
+		dv_arm_bcm2835_uart_putc(uartbuffer.txbuf[uartbuffer.tail % UB_TXSIZE]);
+		uartbuffer.tail++;
+	}
+
+#if UB_TXINTERRUPT
+	if ( uartbuffer.tail == uartbuffer.head )
+	{
+		hw_DisableUartTxInterrupt();
+	}
+#endif
+}
+
+/* ub_Init() - initialise the buffer and redirect the console output into it
+ *
+ * The uart must already be initialised and connected to the console.
+*/
+void ub_Init(void)
+{
+	uartbuffer.head = 0;
+	uartbuffer.tail = 0;
+	uartbuffer.n_dropped = 0;
+	uartbuffer.max_used = 0;
+	uartbuffer.direct_putc = dv_consoledriver.putc;
+
+	dv_consoledriver.putc = ub_Putc;
+}
+
+/* ub_Putc() - put a character into the ring buffer
+*/
+int ub_Putc(int c)
+{
+	dv_intstatus_t is = dv_disable();
+
+	dv_u32_t used = ub_Used();
+
+	if ( used >= UB_TXSIZE )
+	{
+		uartbuffer.n_dropped++;
+	}
+	else
+	{
+		uartbuffer.txbuf[uartbuffer.head % UB_TXSIZE] = (char)c;
+		uartbuffer.head++;
+		used++;
+
+		if ( used > uartbuffer.max_used )
+			uartbuffer.max_used = used;
+
+#if UB_TXINTERRUPT
+		hw_EnableUartTxInterrupt();
+#endif
+	}
+
+	dv_restore(is);
+	return c;
+}
+
+/* ub_Poll() - send whatever the uart will accept without waiting
+*/
+void ub_Poll(void)
+{
+	dv_intstatus_t is = dv_disable();
+	ub_Transmit();
+	dv_restore(is);
+}
+
+/* ub_WaitSpace() - wait until there's room for n characters in the buffer
+ *
+ * For printing large amounts of data without dropping characters. It polls the uart, so it works from the
+ * idle loop or a task (holding up the lower-priority tasks while it waits). Must not be called from an ISR.
+*/
+void ub_WaitSpace(dv_u32_t n)
+{
+	if ( dv_consoledriver.putc != ub_Putc )
+		return;
+
+	while ( (UB_TXSIZE - ub_Used()) < n )
+	{
+		ub_Poll();
+	}
+}
+
+/* ub_UartIsr() - handle the uart's transmitter-empty interrupt
+ *
+ * Called from the uart ISR.
+*/
+void ub_UartIsr(void)
+{
+	ub_Transmit();
+}
+
+/* ub_Flush() - empty the buffer synchronously and revert to direct output
+*/
+void ub_Flush(void)
+{
+	dv_intstatus_t is = dv_disable();
+
+	if ( dv_consoledriver.putc == ub_Putc )
+	{
+#if UB_TXINTERRUPT
+		hw_DisableUartTxInterrupt();
+#endif
+		while ( uartbuffer.tail != uartbuffer.head )
+		{
+			uartbuffer.direct_putc(uartbuffer.txbuf[uartbuffer.tail % UB_TXSIZE]);
+			uartbuffer.tail++;
+		}
+
+		dv_consoledriver.putc = uartbuffer.direct_putc;
+	}
+
+	dv_restore(is);
+}
+
+/* ub_PrintStats() - print the usage of the buffer
+*/
+void ub_PrintStats(void)
+{
+	dv_printf("Uart buffer: size %u, max used %u, dropped %u\n",
+				UB_TXSIZE, uartbuffer.max_used, uartbuffer.n_dropped);
+}
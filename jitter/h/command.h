@@ -0,0 +1,18 @@
+/* command.h - header file for the experiment's command interpreter
+ *
+ * (c) David Haworth
+*/
+#ifndef command_h
+#define command_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* Maximum length of a command line
+*/
+#define CMD_LINELEN		64
+
+extern void cmd_Rx(int c);
+extern void cmd_Poll(void);
+
+#endif
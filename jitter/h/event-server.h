@@ -0,0 +1,49 @@
+/* event-server.h - header file for the sporadic event server
+ *
+ * (c) David Haworth
+*/
+#ifndef event_server_h
+#define event_server_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* Number of event sources. Each source has its own queue of ES_QSIZE events (a power of 2).
+*/
+#define ES_MAXSOURCES	4
+#define ES_QSIZE		64
+
+/* For the experiment: time that the server may spend on the events in each of its jobs, in microseconds.
+ * The server stops when the budget is used up, so a job can exceed it by one handler.
+*/
+#define ES_BUDGET		100
+
+/* For the admission check: the longest job of the server. The budget is checked before each event,
+ * so a job can exceed it by one handler, which takes at most ES_MAXHANDLER microseconds.
+*/
+#define ES_MAXHANDLER	10
+#define ES_WCET			(ES_BUDGET + ES_MAXHANDLER)
+
+/* For the experiment: the interval between two events of the synthetic source (es_Generate()) is
+ * chosen at random between these limits (microseconds)
+*/
+#define ES_MININTERVAL	200
+#define ES_MAXINTERVAL	3000
+
+/* Response time histogram: bucket i holds the responses of less than 2^i microseconds
+*/
+#define ES_NBUCKETS		16
+
+typedef void (*es_handler_t)(dv_u32_t data);
+
+extern dv_id_t es_AddSource(const char *name, es_handler_t handler);
+extern dv_id_t es_AddGenerator(const char *name, es_handler_t handler);
+extern int es_Post(dv_id_t src, dv_u32_t data);
+extern void es_Generate(int on);
+extern void es_GeneratorIsr(void);
+extern void es_Serve(dv_u32_t budget);
+extern void es_ResetStats(void);
+extern void es_SetRecording(int recording, dv_u32_t resets);
+extern void es_PrintResults(void);
+
+#endif
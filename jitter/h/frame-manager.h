@@ -18,13 +18,266 @@ enum fm_frameLocation_e
 	fm_atFrameEnd
 };
 
-	
+#define FM_NLOCATIONS	4
+
+/* Placement of the code and data that are used in every frame (the hot set)
+ *
+ *	FM_LAYOUT == 0	- wherever the linker puts them (link order)
+ *	FM_LAYOUT == 1	- in the sections .fm_hot.text and .fm_hot.data. ld/fm-hot.ld places these together,
+ *					  each starting on a page boundary, so the cache sets that the hot set occupies don't
+ *					  change when unrelated code changes.
+ *	FM_LAYOUT == 2	- the hot data as for 1. The hot code is the set of functions that a profiling build
+ *					  (make PROFILE=1) found in most frames, in the order in which they run. The program is
+ *					  compiled with -ffunction-sections and the generated ld/fm-order.ld places the functions
+ *					  (see tools/hotlayout.py). FM_HOT_TEXT has no effect.
+ *
+ * With FM_LAYOUT == 1 each hot function and object starts on a cache line (FM_HOT_ALIGN: the larger
+ * of the two targets' line sizes). Select with make FM_LAYOUT=0|1|2.
+*/
+#ifndef FM_LAYOUT
+#define FM_LAYOUT		0
+#endif
+
+#define FM_HOT_ALIGN	64
+
+#if FM_LAYOUT == 1
+#define FM_HOT_TEXT		__attribute__((section(".fm_hot.text"), aligned(FM_HOT_ALIGN)))
+#else
+#define FM_HOT_TEXT
+#endif
+
+#if FM_LAYOUT
+#define FM_HOT_DATA		__attribute__((section(".fm_hot.data"), aligned(FM_HOT_ALIGN)))
+#else
+#define FM_HOT_DATA
+#endif
+
+extern const char * const fm_whereNames[FM_NLOCATIONS];
+
+/* Min/max/mean of a time or a value
+*/
+struct timing_s
+{
+	dv_u64_t t_min;
+	dv_u64_t t_max;
+	dv_u64_t t_sum;
+	unsigned n;
+};
+
+static inline void fm_InitTime(struct timing_s *ts)
+{
+	ts->t_min = 0xffffffffffffffff;
+	ts->t_max = 0;
+	ts->t_sum = 0;
+	ts->n = 0;
+}
+
+static inline void fm_StoreValue(struct timing_s *ts, dv_u64_t v)
+{
+	if ( ts->t_min > v )	ts->t_min = v;
+	if ( ts->t_max < v )	ts->t_max = v;
+	ts->t_sum += v;
+	ts->n++;
+}
+
+static inline void fm_StoreTime(struct timing_s *ts, dv_u64_t t_from, dv_u64_t t_to)
+{
+	if ( t_from != 0 )
+	{
+		fm_StoreValue(ts, t_to - t_from);
+	}
+}
+
+static inline void fm_MergeTimes(struct timing_s *ts, const struct timing_s *from)
+{
+	if ( from->n == 0 )
+		return;
+	if ( ts->t_min > from->t_min )	ts->t_min = from->t_min;
+	if ( ts->t_max < from->t_max )	ts->t_max = from->t_max;
+	ts->t_sum += from->t_sum;
+	ts->n += from->n;
+}
+
+static inline dv_u32_t fm_Clip32(dv_u64_t t)
+{
+	return (t > 0xffffffff) ? 0xffffffff : t;
+}
+
+/* Signed timing statistics, for errors that can be early or late
+*/
+struct stiming_s
+{
+	dv_i64_t s_min;
+	dv_i64_t s_max;
+	dv_i64_t s_sum;
+	unsigned n;
+};
+
+static inline void fm_InitSTime(struct stiming_s *ts)
+{
+	ts->s_min = 0x7fffffffffffffff;
+	ts->s_max = -ts->s_min;
+	ts->s_sum = 0;
+	ts->n = 0;
+}
+
+static inline void fm_StoreSValue(struct stiming_s *ts, dv_i64_t v)
+{
+	if ( ts->s_min > v )	ts->s_min = v;
+	if ( ts->s_max < v )	ts->s_max = v;
+	ts->s_sum += v;
+	ts->n++;
+}
+
+static inline void fm_MergeSTimes(struct stiming_s *ts, const struct stiming_s *from)
+{
+	if ( from->n == 0 )
+		return;
+	if ( ts->s_min > from->s_min )	ts->s_min = from->s_min;
+	if ( ts->s_max < from->s_max )	ts->s_max = from->s_max;
+	ts->s_sum += from->s_sum;
+	ts->n += from->n;
+}
+
+static inline dv_i32_t fm_ClipS32(dv_i64_t t)
+{
+	return (t > 0x7fffffff) ? 0x7fffffff : (t < -0x7fffffff) ? -0x7fffffff : t;
+}
+
+/* Different types of cache/TLB etc. maintenance
+ * scratchclean and scratchwarm clean or load the data cache lines of the scratch arena (fm_ScratchAlloc()).
+*/
+struct cacheop_s
+{
+	dv_i8_t icache;
+	dv_i8_t dcache;
+	dv_i8_t prefetch;
+	dv_i8_t branchpredict;
+	dv_i8_t tlb;
+	dv_i8_t scratchclean;
+	dv_i8_t scratchwarm;
+};
+
+/* Event trace control (if the frame manager is built with FM_TRACE)
+*/
+enum fm_traceMode_e
+{
+	fm_traceOff,
+	fm_traceOn,							/* Record continuously; the buffer holds the most recent events */
+	fm_traceOverrun						/* Record until half a buffer after the first overrun, then freeze */
+};
+
+#define FM_NTRACEMODES	3
+
+extern const char * const fm_traceNames[FM_NTRACEMODES];
+
+/* Reaction to a job that exceeds its execution-time budget (see fm_SetJobBudget())
+ *
+ * davroska can't terminate a task from an ISR, so "kill" and "skip" are cooperative: the budget ISR
+ * sets a flag that a long-running job polls with fm_JobAborted(); fm_TaskEnd() then decides what runs next.
+ * A job that doesn't poll runs to its end, so for it "kill" only has the effect of "log".
+*/
+enum fm_budgetReaction_e
+{
+	fm_budgetLog,						/* Count the overrun and measure the detection latency */
+	fm_budgetKill,						/* ... and abort the job. The next job in the frame is chained as usual */
+	fm_budgetSkip						/* ... and abort the job and skip the rest of the frame */
+};
+
+#define FM_NBUDGETREACTIONS	3
+
+extern const char * const fm_budgetNames[FM_NBUDGETREACTIONS];
+
+/* What the idle loop does between polls of the console (see callout_idle())
+*/
+enum fm_idle_e
+{
+	fm_idleSpin,						/* Poll continuously */
+	fm_idleWfi,							/* Wait for an interrupt after each poll */
+	fm_idleWfe,							/* Wait for an event (an interrupt or another core's SEV) after each poll */
+	fm_idleHybrid						/* Poll until shortly before the next tick, then wait for an interrupt */
+};
+
+#define FM_NIDLE	4
+
+extern const char * const fm_idleNames[FM_NIDLE];
+
+/* The experiment parameters that can be changed while the system is running
+*/
+struct fm_config_s
+{
+	enum fm_frameLocation_e whereCacheMaintenance;
+	struct cacheop_s cacheop;
+	dv_u32_t nrounds;					/* Stop and print the results after this many rounds. 0 = never */
+	dv_u32_t ignorerounds;				/* Warm-up: ignore the results of this many rounds after start/reset */
+	enum fm_traceMode_e trace;
+	enum fm_budgetReaction_e budget;
+	enum fm_idle_e idle;
+};
+
+/* Requests for fm_Request(). The requests are applied together at the next round boundary,
+ * or immediately if the frame manager is stopped.
+*/
+#define FM_REQ_CONFIG	0x01			/* Use the new configuration */
+#define FM_REQ_RESET	0x02			/* Reset all the statistics */
+#define FM_REQ_STOP		0x04			/* Stop activating frames */
+#define FM_REQ_START	0x08			/* Reset the statistics and start a new run */
+#define FM_REQ_BUDGET	0x10			/* Apply the changes queued by fm_RequestBudget() */
+
+/* Typed access to the LET channels (see fm_AddChannel())
+*/
+#define FM_ADDCHANNEL(name, type, where)	fm_AddChannel((name), sizeof(type), (where))
+#define FM_CHANNELWRITE(ch, type)			((type *)fm_ChannelWrite(ch))
+#define FM_CHANNELREAD(ch, type)			((const type *)fm_ChannelRead(ch))
 
 extern void fm_CreateTasks(void);
 extern void fm_Init(void);
 extern void fm_AddTask(dv_id_t frame, dv_id_t task);
+extern dv_id_t fm_AddMode(const char *name);
+extern void fm_AddModeTask(dv_id_t mode, dv_id_t frame, dv_id_t task);
+extern void fm_SetFrameLength(dv_id_t mode, dv_id_t frame, dv_u32_t us);
+extern int fm_SetJobBudget(dv_id_t mode, dv_id_t frame, dv_id_t job, dv_u32_t us);
+extern int fm_RequestBudget(dv_id_t mode, dv_id_t frame, dv_id_t job, dv_u32_t us);
+extern int fm_SetTaskWcet(dv_id_t task, dv_u32_t us);
+extern int fm_CheckSchedule(int measured);
+extern void fm_StartTicker(void);
+extern dv_u64_t fm_NextTick(void);
+extern enum fm_idle_e fm_IdleStrategy(void);
+extern int fm_StatsRecording(void);
+extern int fm_Stopped(void);
+extern dv_u32_t fm_StatsResets(void);
+extern void fm_RequestMode(dv_id_t mode);
+extern dv_id_t fm_FindMode(const char *name);
 extern void fm_TaskStart(void);
 extern void fm_TaskEnd(void);
 extern void fm_StartFrame(void);
+extern void fm_BudgetExpired(void);
+extern dv_id_t fm_AddWork(const char *name, dv_u32_t n_slices);
+extern dv_u32_t fm_WorkSlice(dv_id_t work);
+extern void fm_WorkDone(dv_id_t work);
+extern dv_id_t fm_AddChannel(const char *name, dv_u32_t size, enum fm_frameLocation_e where);
+extern void *fm_ChannelWrite(dv_id_t ch);
+extern void fm_ChannelWritten(dv_id_t ch);
+extern const void *fm_ChannelRead(dv_id_t ch);
+extern void fm_ChannelMismatch(dv_id_t ch);
+extern dv_id_t fm_AddIsr(const char *name);
+extern void fm_IsrStart(dv_id_t isr);
+extern void fm_IsrEnd(dv_id_t isr);
+extern int fm_JobAborted(void);
+extern void *fm_ScratchAlloc(dv_u32_t size);
+extern void fm_GetConfig(struct fm_config_s *cfg);
+extern void fm_Request(dv_u32_t req, const struct fm_config_s *cfg);
+extern void fm_PrintConfig(void);
+extern void fm_PrintTimes(struct timing_s *t, char *descr, char *obj, dv_id_t id);
+extern void fm_PrintSTimes(struct stiming_s *t, char *descr, char *obj, dv_id_t id);
+extern dv_id_t fm_FindJob(dv_id_t mode, dv_id_t frame, dv_id_t task);
+extern void fm_Poll(void);
+extern void fm_PrintResults(void);
+extern void fm_PrintTrace(void);
+extern void fm_FlightArm(int on);
+extern void fm_FlightMargin(dv_u32_t us);
+extern void fm_FlightPoll(void);
+extern void fm_PrintFlight(void);
+extern void fm_AddHotSet(void);
 
 #endif
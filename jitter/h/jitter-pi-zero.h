@@ -37,10 +37,175 @@ static inline void hw_EnableUartRxInterrupt(void)
 	dv_arm_bcm2835_uart.ier |= DV_IER_RxInt;
 }
 
-static inline void hw_InitialiseMillisecondTicker(int millis)
+static inline void hw_EnableUartTxInterrupt(void)
+{
+	dv_arm_bcm2835_uart.ier |= DV_IER_TxInt;
+}
+
+static inline void hw_DisableUartTxInterrupt(void)
+{
+	dv_arm_bcm2835_uart.ier &= ~DV_IER_TxInt;
+}
+
+/* The interval timer runs at 250 MHz with a prescaler of 1.
+ * The free-running counter that dv_readtime() uses is set to the same rate in callout_autostart(),
+ * so times and timer ticks can be compared directly.
+*/
+#define hw_TicksPerMicrosecond	250
+
+static inline void hw_InitialiseTicker(dv_u32_t ticks)
 {
 	dv_arm_bcm2835_armtimer_init(1);			/* Use a prescaler of 1 for high resolution */
-	dv_arm_bcm2835_armtimer_set_load(250000 * millis);
+	dv_arm_bcm2835_armtimer_set_load(ticks);
+}
+
+static inline void hw_InitialiseMillisecondTicker(int millis)
+{
+	hw_InitialiseTicker(hw_TicksPerMicrosecond * 1000 * millis);
+}
+
+/* hw_SetTimerReload() - set the value that the timer reloads when it next expires
+ *
+ * Unlike the load register, writing the reload register doesn't disturb the current count.
+*/
+static inline void hw_SetTimerReload(dv_u32_t ticks)
+{
+	dv_arm_bcm2835_armtimer.reload = ticks;
+}
+
+/* hw_CoreId() - return the number of the core that the caller is running on
+*/
+static inline int hw_CoreId(void)
+{
+	return 0;								/* Single core */
+}
+
+/* Idle: wait for an interrupt, wait for an event, signal an event
+ *
+ * The ARM1176 waits for an interrupt with a CP15 operation. It has no event register: the WFE and SEV
+ * hints execute as NOPs. With a single core an event can only come from an interrupt, so waiting for
+ * an event is the same as waiting for an interrupt, and there's no-one to signal.
+*/
+static inline void hw_WaitForInterrupt(void)
+{
+	__asm__ volatile("mcr p15, 0, %0, c7, c0, 4" : : "r"(0) : "memory");
+}
+
+static inline void hw_WaitForEvent(void)
+{
+	hw_WaitForInterrupt();
+}
+
+static inline void hw_SendEvent(void)
+{
+}
+
+/* hw_InvalidateTlb() - invalidate all TLB entries
+*/
+static inline void hw_InvalidateTlb(void)
+{
+	__asm__ volatile("mcr p15, 0, %0, c8, c7, 0" : : "r"(0));	/* Invalidate unified TLB */
+	__asm__ volatile("mcr p15, 0, %0, c7, c10, 4" : : "r"(0));	/* DSB */
+	__asm__ volatile("mcr p15, 0, %0, c7, c5, 4" : : "r"(0));		/* Flush prefetch buffer */
+}
+
+/* hw_CleanDataRange() - clean and invalidate the data cache lines of a range of addresses
+*/
+#define hw_DCacheLineSize	32
+
+static inline void hw_CleanDataRange(const void *p, dv_u32_t size)
+{
+	dv_u32_t end = (dv_u32_t)p + size;
+
+	for ( dv_u32_t a = (dv_u32_t)p & ~(hw_DCacheLineSize - 1); a < end; a += hw_DCacheLineSize )
+		__asm__ volatile("mcr p15, 0, %0, c7, c14, 1" : : "r"(a) : "memory");	/* Clean and invalidate line by MVA */
+	__asm__ volatile("mcr p15, 0, %0, c7, c10, 4" : : "r"(0) : "memory");		/* DSB */
+}
+
+/* The system timer: a free-running 1 MHz counter with four compare channels. The GPU uses channels 0 and 2.
+ * Channel 1 is the budget timer for the frame manager's job budgets. Its interrupt is GPU IRQ 1.
+ * Channel 3 is the event timer, a source of sporadic interrupts for the event server. Its interrupt is GPU IRQ 3.
+*/
+typedef struct hw_systimer_s
+{
+	volatile dv_u32_t cs;					/* Match flags; write 1 to clear */
+	volatile dv_u32_t clo;					/* Counter, lower 32 bits */
+	volatile dv_u32_t chi;					/* Counter, upper 32 bits */
+	volatile dv_u32_t c[4];					/* Compare registers */
+} hw_systimer_t;
+
+#define hw_systimer				(*(hw_systimer_t *)0x20003000)
+#define HW_BUDGETCHANNEL		1
+#define HW_EVENTCHANNEL			3
+#define HW_SYSTIMER_M1			(1u << HW_BUDGETCHANNEL)	/* Match flags of the budget and event channels */
+#define HW_SYSTIMER_M3			(1u << HW_EVENTCHANNEL)
+#define hw_BudgetInterruptId	HW_BUDGETCHANNEL			/* Channel n interrupts on GPU IRQ n */
+#define hw_EventInterruptId		HW_EVENTCHANNEL
+
+/* hw_SetBudgetTimer() - request a budget timer interrupt in us microseconds
+ *
+ * The compare matches when the counter reaches the compare value, so the shortest useful budget is 2 us.
+*/
+static inline void hw_SetBudgetTimer(dv_u32_t us)
+{
+	hw_systimer.cs = HW_SYSTIMER_M1;
+	hw_systimer.c[HW_BUDGETCHANNEL] = hw_systimer.clo + us;
+}
+
+/* hw_CancelBudgetTimer() - move the compare value as far into the future as it goes (about 71 minutes)
+ * and clear any match that happened in the meantime
+*/
+static inline void hw_CancelBudgetTimer(void)
+{
+	hw_systimer.c[HW_BUDGETCHANNEL] = hw_systimer.clo - 1;
+	hw_systimer.cs = HW_SYSTIMER_M1;
+}
+
+/* hw_ClearBudgetTimer() - clear the budget timer interrupt
+*/
+static inline void hw_ClearBudgetTimer(void)
+{
+	hw_systimer.cs = HW_SYSTIMER_M1;
+}
+
+/* hw_SetEventTimer() - request an event timer interrupt in us microseconds
+*/
+static inline void hw_SetEventTimer(dv_u32_t us)
+{
+	hw_systimer.cs = HW_SYSTIMER_M3;
+	hw_systimer.c[HW_EVENTCHANNEL] = hw_systimer.clo + us;
+}
+
+/* hw_CancelEventTimer() - as hw_CancelBudgetTimer(), for the event timer
+*/
+static inline void hw_CancelEventTimer(void)
+{
+	hw_systimer.c[HW_EVENTCHANNEL] = hw_systimer.clo - 1;
+	hw_systimer.cs = HW_SYSTIMER_M3;
+}
+
+/* hw_ClearEventTimer() - clear the event timer interrupt
+*/
+static inline void hw_ClearEventTimer(void)
+{
+	hw_systimer.cs = HW_SYSTIMER_M3;
+}
+
+/* The performance monitor: count register 0 counts instruction cache misses (event 0x00).
+ * The frame manager reads it at the start and end of each frame.
+*/
+static inline void hw_InitPmu(void)
+{
+	__asm__ volatile("mcr p15, 0, %0, c15, c12, 0" : : "r"((0x00 << 20) | 0x03));	/* PMNC: EvtCount0, reset, enable */
+}
+
+/* hw_ReadICacheMisses() - return the number of instruction cache misses (wraps at 2^32)
+*/
+static inline dv_u32_t hw_ReadICacheMisses(void)
+{
+	dv_u32_t v;
+	__asm__ volatile("mrc p15, 0, %0, c15, c12, 2" : "=r"(v));
+	return v;
 }
 
 #endif
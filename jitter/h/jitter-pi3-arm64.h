@@ -39,10 +39,209 @@ static inline void hw_EnableUartRxInterrupt(void)
 	dv_arm_bcm2835_uart.ier |= DV_IER_RxInt;
 }
 
-static inline void hw_InitialiseMillisecondTicker(int millis)
+static inline void hw_EnableUartTxInterrupt(void)
+{
+	dv_arm_bcm2835_uart.ier |= DV_IER_TxInt;
+}
+
+static inline void hw_DisableUartTxInterrupt(void)
+{
+	dv_arm_bcm2835_uart.ier &= ~DV_IER_TxInt;
+}
+
+/* The interval timer runs at 250 MHz with a prescaler of 1.
+ * The free-running counter that dv_readtime() uses is set to the same rate in callout_autostart(),
+ * so times and timer ticks can be compared directly.
+*/
+#define hw_TicksPerMicrosecond	250
+
+static inline void hw_InitialiseTicker(dv_u32_t ticks)
 {
 	dv_arm_bcm2835_armtimer_init(1);			/* Use a prescaler of 1 for high resolution */
-	dv_arm_bcm2835_armtimer_set_load(250000 * millis);
+	dv_arm_bcm2835_armtimer_set_load(ticks);
+}
+
+static inline void hw_InitialiseMillisecondTicker(int millis)
+{
+	hw_InitialiseTicker(hw_TicksPerMicrosecond * 1000 * millis);
+}
+
+/* hw_SetTimerReload() - set the value that the timer reloads when it next expires
+ *
+ * Unlike the load register, writing the reload register doesn't disturb the current count.
+*/
+static inline void hw_SetTimerReload(dv_u32_t ticks)
+{
+	dv_arm_bcm2835_armtimer.reload = ticks;
+}
+
+/* hw_CoreId() - return the number of the core that the caller is running on
+*/
+static inline int hw_CoreId(void)
+{
+	return (int)(dv_arm64_mrs(MPIDR_EL1) & 0xff);
+}
+
+/* Idle: wait for an interrupt, wait for an event, signal an event to all cores
+*/
+static inline void hw_WaitForInterrupt(void)
+{
+	__asm__ volatile("wfi" : : : "memory");
+}
+
+static inline void hw_WaitForEvent(void)
+{
+	__asm__ volatile("wfe" : : : "memory");
+}
+
+static inline void hw_SendEvent(void)
+{
+	__asm__ volatile("dsb sy; sev" : : : "memory");
+}
+
+/* hw_InvalidateTlb() - invalidate all TLB entries
+*/
+static inline void hw_InvalidateTlb(void)
+{
+	__asm__ volatile("tlbi vmalle1; dsb sy; isb" : : : "memory");
+}
+
+/* hw_CleanDataRange() - clean and invalidate the data cache lines of a range of addresses
+*/
+#define hw_DCacheLineSize	64
+
+static inline void hw_CleanDataRange(const void *p, dv_u32_t size)
+{
+	dv_u64_t end = (dv_u64_t)p + size;
+
+	for ( dv_u64_t a = (dv_u64_t)p & ~(dv_u64_t)(hw_DCacheLineSize - 1); a < end; a += hw_DCacheLineSize )
+		__asm__ volatile("dc civac, %0" : : "r"(a) : "memory");
+	__asm__ volatile("dsb sy" : : : "memory");
+}
+
+/* The system timer: a free-running 1 MHz counter with four compare channels. The GPU uses channels 0 and 2.
+ * Channel 1 is the budget timer for the frame manager's job budgets. Its interrupt is GPU IRQ 1.
+ * Channel 3 is the event timer, a source of sporadic interrupts for the event server. Its interrupt is GPU IRQ 3.
+*/
+typedef struct hw_systimer_s
+{
+	volatile dv_u32_t cs;					/* Match flags; write 1 to clear */
+	volatile dv_u32_t clo;					/* Counter, lower 32 bits */
+	volatile dv_u32_t chi;					/* Counter, upper 32 bits */
+	volatile dv_u32_t c[4];					/* Compare registers */
+} hw_systimer_t;
+
+#define hw_systimer				(*(hw_systimer_t *)0x3f003000)
+#define HW_BUDGETCHANNEL		1
+#define HW_EVENTCHANNEL			3
+#define HW_SYSTIMER_M1			(1u << HW_BUDGETCHANNEL)	/* Match flags of the budget and event channels */
+#define HW_SYSTIMER_M3			(1u << HW_EVENTCHANNEL)
+#define hw_BudgetInterruptId	HW_BUDGETCHANNEL			/* Channel n interrupts on GPU IRQ n */
+#define hw_EventInterruptId		HW_EVENTCHANNEL
+
+/* hw_SetBudgetTimer() - request a budget timer interrupt in us microseconds
+ *
+ * The compare matches when the counter reaches the compare value, so the shortest useful budget is 2 us.
+*/
+static inline void hw_SetBudgetTimer(dv_u32_t us)
+{
+	hw_systimer.cs = HW_SYSTIMER_M1;
+	hw_systimer.c[HW_BUDGETCHANNEL] = hw_systimer.clo + us;
+}
+
+/* hw_CancelBudgetTimer() - move the compare value as far into the future as it goes (about 71 minutes)
+ * and clear any match that happened in the meantime
+*/
+static inline void hw_CancelBudgetTimer(void)
+{
+	hw_systimer.c[HW_BUDGETCHANNEL] = hw_systimer.clo - 1;
+	hw_systimer.cs = HW_SYSTIMER_M1;
+}
+
+/* hw_ClearBudgetTimer() - clear the budget timer interrupt
+*/
+static inline void hw_ClearBudgetTimer(void)
+{
+	hw_systimer.cs = HW_SYSTIMER_M1;
+}
+
+/* hw_SetEventTimer() - request an event timer interrupt in us microseconds
+*/
+static inline void hw_SetEventTimer(dv_u32_t us)
+{
+	hw_systimer.cs = HW_SYSTIMER_M3;
+	hw_systimer.c[HW_EVENTCHANNEL] = hw_systimer.clo + us;
+}
+
+/* hw_CancelEventTimer() - as hw_CancelBudgetTimer(), for the event timer
+*/
+static inline void hw_CancelEventTimer(void)
+{
+	hw_systimer.c[HW_EVENTCHANNEL] = hw_systimer.clo - 1;
+	hw_systimer.cs = HW_SYSTIMER_M3;
+}
+
+/* hw_ClearEventTimer() - clear the event timer interrupt
+*/
+static inline void hw_ClearEventTimer(void)
+{
+	hw_systimer.cs = HW_SYSTIMER_M3;
+}
+
+/* The PMU: event counter 0 counts L1 instruction cache refills (event 0x01) at EL1 and EL0.
+ * The frame manager reads it at the start and end of each frame.
+*/
+static inline void hw_InitPmu(void)
+{
+	dv_arm64_msr(PMEVTYPER0_EL0, 0x01);
+	dv_arm64_msr(PMCNTENSET_EL0, 0x01);
+	dv_arm64_msr(PMCR_EL0, dv_arm64_mrs(PMCR_EL0) | 0x03);	/* Enable, reset the event counters */
+	__asm__ volatile("isb");
+}
+
+/* hw_ReadICacheMisses() - return the number of L1 instruction cache refills (wraps at 2^32)
+*/
+static inline dv_u32_t hw_ReadICacheMisses(void)
+{
+	return (dv_u32_t)dv_arm64_mrs(PMEVCNTR0_EL0);
+}
+
+/* The per-core mailboxes of the BCM2836 local peripherals. Each core has four 32-bit mailboxes: writing to
+ * the set register sets bits, writing to the clear register clears them. The mailbox interrupts are not
+ * enabled; the multicore benchmark (c/multicore-pi3.c) polls the mailboxes.
+*/
+#define hw_NCores				4
+#define HW_MBOX_SET(core, mb)	(*(volatile dv_u32_t *)(0x40000080uL + 0x10 * (core) + 4 * (mb)))
+#define HW_MBOX_CLR(core, mb)	(*(volatile dv_u32_t *)(0x400000c0uL + 0x10 * (core) + 4 * (mb)))
+
+/* hw_MailboxWrite() - set bits in a mailbox, and wake the other cores in case they wait in WFE
+*/
+static inline void hw_MailboxWrite(int core, int mb, dv_u32_t bits)
+{
+	HW_MBOX_SET(core, mb) = bits;
+	hw_SendEvent();
+}
+
+static inline dv_u32_t hw_MailboxRead(int core, int mb)
+{
+	return HW_MBOX_CLR(core, mb);
+}
+
+static inline void hw_MailboxClear(int core, int mb, dv_u32_t bits)
+{
+	HW_MBOX_CLR(core, mb) = bits;
+}
+
+/* hw_ReadLocalCounter() - read the core's own generic timer counter (CNTVCT_EL0), at hw_LocalCounterFrequency()
+*/
+static inline dv_u64_t hw_ReadLocalCounter(void)
+{
+	return dv_arm64_mrs(CNTVCT_EL0);
+}
+
+static inline dv_u32_t hw_LocalCounterFrequency(void)
+{
+	return (dv_u32_t)dv_arm64_mrs(CNTFRQ_EL0);
 }
 
 #endif
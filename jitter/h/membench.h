@@ -0,0 +1,30 @@
+/* membench.h - header file for the memory hierarchy benchmark
+ *
+ * (c) David Haworth
+*/
+#ifndef membench_h
+#define membench_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* Size of the benchmark's buffer. The largest working set of the latency test.
+*/
+#define MB_MAXSIZE		(8*1024*1024)
+
+/* Loads per latency measurement, and the number of times each measurement is repeated (the best is kept)
+*/
+#define MB_STEPS		200000
+#define MB_REPEAT		3
+
+/* Bytes per bandwidth measurement
+*/
+#define MB_STREAMBYTES	(16*1024*1024)
+
+/* Executions of each cache operation
+*/
+#define MB_OPREPEAT		100
+
+extern void mb_Bench(void);
+
+#endif
@@ -0,0 +1,75 @@
+/* mmu.h - header file for the experiment's MMU setup
+ *
+ * (c) David Haworth
+*/
+#ifndef mmu_h
+#define mmu_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* Mapping granularity. Select with MMU_GRANULE (e.g. make MMU_GRANULE=2)
+ *
+ *	MMU_DAVROSKA	- use davroska's page tables (dv_armv6_mmu_setup() or dv_armv8_mmu_setup())
+ *	MMU_SMALL		- 4 KB pages for the program region, MMU_MEDIUM for the rest
+ *	MMU_MEDIUM		- 1 MB sections (ARMv6) or 2 MB blocks (ARMv8)
+ *	MMU_LARGE		- 16 MB supersections (ARMv6) or 1 GB blocks (ARMv8) wherever size, alignment and
+ *					  attributes allow, otherwise MMU_MEDIUM
+ *
+ * Mapping all of RAM with 4 KB pages would need about half a megabyte of level 2 tables,
+ * so MMU_SMALL only uses pages for the first region (the program).
+*/
+#define MMU_DAVROSKA	0
+#define MMU_SMALL		1
+#define MMU_MEDIUM		2
+#define MMU_LARGE		3
+
+#ifndef MMU_GRANULE
+#define MMU_GRANULE		MMU_DAVROSKA
+#endif
+
+/* Size of the hot set: number of ranges and number of distinct TLB entries that are counted
+*/
+#define MMU_MAXHOT			32
+#define MMU_MAXHOTENTRIES	64
+
+/* Assumed size of a function in the hot set. C doesn't know how big a function is, so the report
+ * counts this many bytes from the entry point.
+*/
+#define MMU_HOTCODE			256
+
+/* Memory attributes for a region
+*/
+enum mmu_attr_e
+{
+	mmu_code,			/* Normal memory, write-back cacheable, executable */
+	mmu_data,			/* Normal memory, write-back cacheable, never executed */
+	mmu_device			/* Device memory, not cacheable, never executed */
+};
+
+/* A region of the address space. The regions are identity-mapped.
+*/
+struct mmu_region_s
+{
+	const char *name;
+	dv_address_t base;
+	dv_u32_t size;
+	enum mmu_attr_e attr;
+};
+
+extern const struct mmu_region_s mmu_regions[];
+extern const int mmu_nregions;
+extern const char * const mmu_granuleNames[4];
+
+/* Target-specific: mmu-armv6.c or mmu-armv8.c
+*/
+extern void mmu_Setup(int create);
+extern dv_u32_t mmu_MappingSize(dv_address_t addr);
+
+/* Common: mmu-report.c
+*/
+extern void mmu_AddHot(const char *name, const void *start, dv_u32_t size);
+extern dv_u32_t mmu_EntriesFor(dv_address_t start, dv_u32_t size);
+extern void mmu_Report(void);
+
+#endif
@@ -0,0 +1,26 @@
+/* multicore.h - header file for the multicore benchmark (pi3)
+ *
+ * (c) David Haworth
+*/
+#ifndef multicore_h
+#define multicore_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* For the experiment: number of measurements per test and core (the "multicore" command can change it)
+*/
+#define MC_NSAMPLES		10000
+
+/* Histogram for the percentiles: one bucket per timer tick, up to MC_HISTSIZE ticks (about 4 us)
+*/
+#define MC_HISTSIZE		1024
+
+/* The mailbox (of the four on each core) that the benchmark uses
+*/
+#define MC_MBOX			3
+
+extern void mc_Worker(int core);
+extern void mc_Bench(dv_u32_t n);
+
+#endif
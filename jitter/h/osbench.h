@@ -0,0 +1,33 @@
+/* osbench.h - header file for the OS primitive benchmark
+ *
+ * (c) David Haworth
+*/
+#ifndef osbench_h
+#define osbench_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* For the experiment: number of warm and of cold iterations (the "osbench" command can change it)
+*/
+#define OB_NITERATIONS	1000
+
+/* Histogram for the percentiles: OB_HISTSIZE buckets of (1 << OB_HISTSHIFT) ticks each (about 16 us)
+*/
+#define OB_HISTSIZE		1024
+#define OB_HISTSHIFT	2
+
+/* Priorities of the benchmark's tasks: above the frame tasks, below the ISRs
+*/
+#define OB_PRIO			5
+#define OB_PRIO_HI		6
+
+/* Delay from arming the budget timer to the interrupt, in microseconds
+*/
+#define OB_ISRDELAY		5
+
+extern void ob_CreateTasks(void);
+extern void ob_Bench(dv_u32_t n);
+extern int ob_BudgetIsr(void);
+
+#endif
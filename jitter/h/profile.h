@@ -0,0 +1,34 @@
+/* profile.h - header file for the function profile of the frame path
+ *
+ * (c) David Haworth
+*/
+#ifndef profile_h
+#define profile_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* Profiling build. Select with make PROFILE=1
+ *
+ *	FM_PROFILE == 0	- normal build
+ *	FM_PROFILE == 1	- the program is compiled with -finstrument-functions. Every function entry is counted
+ *					  in a table (c/profile.c), together with the number of frames in which the function ran
+ *					  and its position in the sequence of functions of the frame. tools/hotlayout.py turns
+ *					  the "profile dump" output into a function order for make FM_LAYOUT=2.
+ *
+ * The instrumentation adds a call to every function entry and exit, so the timings of a profiling build
+ * are not representative.
+*/
+#ifndef FM_PROFILE
+#define FM_PROFILE		0
+#endif
+
+/* Size of the function table. Must be a power of 2.
+*/
+#define PF_NFUNCS		512
+
+extern void pf_Enable(int on);
+extern void pf_Reset(void);
+extern void pf_Print(void);
+
+#endif
@@ -0,0 +1,48 @@
+/* rm-manager.h - header file for the rate-monotonic alternative to the frame manager
+ *
+ * (c) David Haworth
+*/
+#ifndef rm_manager_h
+#define rm_manager_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* Scheduler selection. Select with make SCHED=frame|rm
+ *
+ *	SCHED_RM == 0	- the frame-based executive (frame-manager.c). All tasks have the same priority and
+ *					  are chained in sequence within each frame.
+ *	SCHED_RM == 1	- rate-monotonic preemptive scheduling (rm-manager.c). Each task is activated by its own
+ *					  alarm on a counter that the timer ISR advances, and the task with the shortest period
+ *					  has the highest priority.
+*/
+#ifndef SCHED_RM
+#define SCHED_RM		0
+#endif
+
+/* Length of a counter tick in microseconds. The periods and offsets must be multiples of this.
+*/
+#define RM_TICK			1000
+
+/* Length of the frames of the frame-based schedule in microseconds. Each activation is reported with the
+ * frame and job that it corresponds to in the default mode, so the results can be compared directly.
+*/
+#define RM_FRAME		5000
+
+#define RM_MAXTASKS		16
+
+extern void rm_CreateCounter(void);
+extern void rm_AddTask(const char *name, dv_id_t task, dv_u32_t period, dv_u32_t offset);
+extern void rm_Start(void);
+extern void rm_Tick(void);
+extern void rm_TaskStart(dv_id_t task);
+extern void rm_TaskEnd(dv_id_t task);
+extern void rm_Request(dv_u32_t req);
+extern void rm_Poll(void);
+extern dv_u64_t rm_NextTick(void);
+extern int rm_StatsRecording(void);
+extern int rm_Stopped(void);
+extern dv_u32_t rm_StatsResets(void);
+extern void rm_PrintResults(void);
+
+#endif
@@ -0,0 +1,29 @@
+/* uart-buffer.h - header file for the buffered uart output
+ *
+ * (c) David Haworth
+*/
+#ifndef uart_buffer_h
+#define uart_buffer_h	1
+
+#define DV_ASM  0
+#include <davroska.h>
+
+/* Size of the transmit ring buffer. Must be a power of 2.
+*/
+#define UB_TXSIZE		8192
+
+/* UB_TXINTERRUPT selects how the ring buffer gets emptied:
+ *	1 - by the uart's transmitter-empty interrupt
+ *	0 - only by ub_Poll(), e.g. from the idle loop. No uart interrupts occur during the frames.
+*/
+#define UB_TXINTERRUPT	1
+
+extern void ub_Init(void);
+extern int ub_Putc(int c);
+extern void ub_Poll(void);
+extern void ub_WaitSpace(dv_u32_t n);
+extern void ub_UartIsr(void);
+extern void ub_Flush(void);
+extern void ub_PrintStats(void);
+
+#endif
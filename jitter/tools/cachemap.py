@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+#	cachemap.py - report the L1 cache sets occupied by the jitter experiment's hot set
+#
+#	Copyright 2019 David Haworth
+#
+#	This file is part of Dave's determinism experiments.
+#
+#	The experiments are free software: you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation, either version 3 of the License, or
+#	(at your option) any later version.
+#
+#	The experiments are distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with Dave's determinism experiments.
+#	If not, see <http://www.gnu.org/licenses/>.
+#
+#	Usage:
+#		objdump -t bin/jitter.elf | cachemap.py [--board pi-zero|pi3-arm64] [--symbol NAME ...] [symfile]
+#
+#	Reads a symbol table in the format of objdump -t (make cachemap does this).
+#	The hot set is every symbol in the .fm_hot.* sections (make FM_LAYOUT=1) plus any symbols named
+#	with --symbol. If there are no hot sections, a default list of the frame manager's per-frame
+#	functions and data is used.
+#
+#	Functions are mapped onto the L1 instruction cache and objects onto the L1 data cache.
+#	For each cache the report shows the sets that each symbol occupies, a map of the number of hot
+#	lines in each set and the sets in which the hot set has more lines than the cache has ways,
+#	i.e. where the hot set evicts itself.
+#
+#	Only the python standard library is used.
+
+import sys
+import re
+import argparse
+
+# L1 cache geometry: (size, ways, line size)
+boards = {
+	'pi-zero':		{ 'icache': (16384, 4, 32), 'dcache': (16384, 4, 32) },		# ARM1176JZF-S
+	'pi3-arm64':	{ 'icache': (32768, 2, 64), 'dcache': (32768, 4, 64) }		# Cortex-A53
+}
+
+default_symbols = [
+	'fm_StartFrame', 'main_FrameStart', 'fm_TaskStart', 'fm_TaskEnd', 'main_FrameEnd',
+	'fm_ComputeTimes', 'fm_CacheMaintenance', 'main_Timer',
+	'main_T5a', 'main_T5b', 'main_T10a', 'main_T10b', 'main_T20a', 'main_T20b', 'main_T20c', 'main_T20d',
+	'framemanager'
+]
+
+# objdump -t: address, 7 flag characters, section, size, name
+symline = re.compile(r'^([0-9a-fA-F]+)\s(.{7})\s(\S+)\s+([0-9a-fA-F]+)\s+(\S+)\s*$')
+
+def read_symbols(f):
+	syms = []
+	for line in f:
+		m = symline.match(line)
+		if m:
+			addr, flags, section, size, name = m.groups()
+			syms.append({ 'name': name, 'addr': int(addr, 16), 'size': int(size, 16),
+						  'section': section, 'func': 'F' in flags })
+	return syms
+
+def report(title, geometry, hot):
+	size, ways, line = geometry
+	nsets = size // (ways * line)
+	occupancy = [0] * nsets
+	users = [[] for i in range(nsets)]
+
+	print('%s: %d bytes, %d-way, %d-byte lines, %d sets' % (title, size, ways, line, nsets))
+
+	for s in sorted(hot, key=lambda s: s['addr']):
+		first = s['addr'] // line
+		last = (s['addr'] + max(s['size'], 1) - 1) // line
+		for l in range(first, last + 1):
+			occupancy[l % nsets] += 1
+			users[l % nsets].append(s['name'])
+		print('  %-24s 0x%08x %6d bytes  %-14s lines %4d  sets %d..%d' %
+			(s['name'], s['addr'], s['size'], s['section'], last - first + 1, first % nsets, last % nsets))
+
+	used = sum(1 for n in occupancy if n > 0)
+	lines = sum(occupancy)
+	print('  %d lines in %d of %d sets' % (lines, used, nsets))
+
+	# One character per set: . = unused, 1-9 = lines, + = more than 9
+	row = ''.join('.' if n == 0 else (str(n) if n < 10 else '+') for n in occupancy)
+	for i in range(0, nsets, 64):
+		print('  %4d %s' % (i, row[i:i+64]))
+
+	conflicts = [i for i in range(nsets) if occupancy[i] > ways]
+	if conflicts:
+		print('  %d sets have more hot lines than ways:' % len(conflicts))
+		for i in conflicts:
+			print('    set %d: %s' % (i, ' '.join(sorted(set(users[i])))))
+	else:
+		print('  no set has more hot lines than ways')
+	print('')
+
+def main():
+	ap = argparse.ArgumentParser(description = 'Report the cache sets occupied by the hot set')
+	ap.add_argument('--board', default = 'pi3-arm64', choices = sorted(boards.keys()))
+	ap.add_argument('--symbol', action = 'append', default = [], help = 'add a symbol to the hot set')
+	ap.add_argument('symfile', nargs = '?', help = 'objdump -t output (default stdin)')
+	args = ap.parse_args()
+
+	if args.symfile:
+		with open(args.symfile) as f:
+			syms = read_symbols(f)
+	else:
+		syms = read_symbols(sys.stdin)
+
+	hot = [s for s in syms if s['section'].startswith('.fm_hot') and s['size'] > 0]
+	if not hot:
+		print('No .fm_hot sections (FM_LAYOUT=0?) - using the default symbol list')
+		names = set(default_symbols)
+	else:
+		names = set()
+	names |= set(args.symbol)
+
+	hot += [s for s in syms if s['name'] in names and s not in hot]
+
+	missing = names - set(s['name'] for s in hot)
+	if missing:
+		print('Symbols not found: %s' % ' '.join(sorted(missing)))
+
+	print('Hot set for %s' % args.board)
+	print('')
+	report('L1 instruction cache', boards[args.board]['icache'], [s for s in hot if s['func']])
+	report('L1 data cache', boards[args.board]['dcache'], [s for s in hot if not s['func']])
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+#	compare.py - compare the job timings of jitter runs with different cache maintenance strategies
+#
+#	Copyright 2019 David Haworth
+#
+#	This file is part of Dave's determinism experiments.
+#
+#	The experiments are free software: you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation, either version 3 of the License, or
+#	(at your option) any later version.
+#
+#	The experiments are distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with Dave's determinism experiments.
+#	If not, see <http://www.gnu.org/licenses/>.
+#
+#	Usage:
+#		compare.py [--tag KEY,...] [--metric latency|runtime] [--rank jitter|p99] [--baseline TAG]
+#					[--alpha A] [--boot N] [--seed S] [--detail] logfile ...
+#
+#	Reads the results that fm_PrintResults() writes to the console: a "Config: ..." line followed by
+#	the "S round mode frame job latency runtime" sample lines. Each Config line starts a new run and
+#	the runs are grouped into configurations by the Config fields named with --tag (default
+#	"mode,where,ops", i.e. the cache maintenance strategy). Several runs of the same configuration,
+#	in one log or several, are pooled. Don't dump the same run twice.
+#
+#	The latency of a sample is the time from the job's release to its start: from the tick that activated
+#	the frame (frame manager) or the task (rate-monotonic scheduler). It includes the runtime of the jobs
+#	that ran before it, so it is comparable between the two schedulers. The runtime is from the job's
+#	start to its end, including any preemption.
+#
+#	Each configuration is compared with the baseline (default: the first configuration found), job by
+#	job, on the chosen metric (default: latency):
+#		- Mann-Whitney U test, two-sided, normal approximation with tie correction. The p-values of a
+#		  configuration's jobs are adjusted with Holm's method for the number of jobs.
+#		- The difference of the 99th percentiles with a bootstrap confidence interval (1 - alpha).
+#	A job counts as better (worse) if the adjusted p-value is below alpha and the confidence interval
+#	of the p99 difference lies entirely below (above) zero.
+#
+#	The configurations are ranked by the mean over the jobs of their jitter (p99 - p1) relative to the
+#	baseline, or of their p99 with --rank p99. --detail prints the comparison of every job.
+#
+#	Only the python standard library is used.
+
+import sys
+import re
+import math
+import random
+import argparse
+
+def parse_config(line):
+	w = line.split()[1:]
+	return dict(zip(w[0::2], w[1::2]))
+
+def read_runs(files, tagkeys, metric):
+	configs = {}			# tag -> { (mode, frame, job): [values] }
+	order = []
+	col = 5 if metric == 'latency' else 6
+	for f in files:
+		tag = None
+		for line in f:
+			if line.startswith('Config:'):
+				cfg = parse_config(line)
+				tag = ' '.join('%s=%s' % (k, cfg.get(k, '-')) for k in tagkeys)
+				if tag not in configs:
+					configs[tag] = {}
+					order.append(tag)
+				continue
+			w = line.split()
+			if len(w) != 7 or w[0] != 'S' or tag is None:
+				continue
+			key = (int(w[2]), int(w[3]), int(w[4]))
+			configs[tag].setdefault(key, []).append(int(w[col]))
+	return configs, [t for t in order if configs[t]]
+
+def percentile(xs, q):
+	# Nearest rank on sorted data
+	i = max(0, min(len(xs) - 1, int(math.ceil(q * len(xs))) - 1))
+	return xs[i]
+
+def mann_whitney(a, b):
+	n1, n2 = len(a), len(b)
+	both = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+	r1 = 0.0
+	ties = 0.0
+	i = 0
+	n = n1 + n2
+	while i < n:
+		j = i
+		while j < n and both[j][0] == both[i][0]:
+			j += 1
+		rank = (i + j + 1) / 2.0			# Mean of ranks i+1 .. j
+		t = j - i
+		ties += t * t * t - t
+		r1 += rank * sum(1 for k in range(i, j) if both[k][1] == 0)
+		i = j
+	u1 = r1 - n1 * (n1 + 1) / 2.0
+	mu = n1 * n2 / 2.0
+	var = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1)))
+	if var <= 0:
+		return u1, 1.0
+	z = (u1 - mu) / math.sqrt(var)
+	return u1, math.erfc(abs(z) / math.sqrt(2))
+
+def bootstrap_p99_diff(a, b, nboot, alpha, rng):
+	d = []
+	for i in range(nboot):
+		ra = sorted(rng.choices(a, k = len(a)))
+		rb = sorted(rng.choices(b, k = len(b)))
+		d.append(percentile(rb, 0.99) - percentile(ra, 0.99))
+	d.sort()
+	return percentile(d, alpha / 2), percentile(d, 1 - alpha / 2)
+
+def holm(pvalues):
+	m = len(pvalues)
+	idx = sorted(range(m), key = lambda i: pvalues[i])
+	adj = [0.0] * m
+	prev = 0.0
+	for r, i in enumerate(idx):
+		p = min(1.0, (m - r) * pvalues[i])
+		prev = max(prev, p)
+		adj[i] = prev
+	return adj
+
+def main():
+	ap = argparse.ArgumentParser(description = 'Compare job timings between cache maintenance strategies')
+	ap.add_argument('--tag', default = 'mode,where,ops', help = 'Config fields that identify a configuration')
+	ap.add_argument('--metric', choices = ['latency', 'runtime'], default = 'latency')
+	ap.add_argument('--rank', choices = ['jitter', 'p99'], default = 'jitter',
+					help = 'rank by the spread p99 - p1 (default) or by p99')
+	ap.add_argument('--baseline', help = 'the configuration to compare with (default: the first one)')
+	ap.add_argument('--alpha', type = float, default = 0.05, help = 'significance level (default 0.05)')
+	ap.add_argument('--boot', type = int, default = 500, help = 'bootstrap resamples (default 500)')
+	ap.add_argument('--seed', type = int, default = 1, help = 'random seed for the bootstrap')
+	ap.add_argument('--detail', action = 'store_true', help = 'print the comparison of every job')
+	ap.add_argument('files', nargs = '*', type = argparse.FileType('r'))
+	args = ap.parse_args()
+
+	tagkeys = [k for k in args.tag.split(',') if k]
+	configs, order = read_runs(args.files or [sys.stdin], tagkeys, args.metric)
+	if len(order) < 2:
+		print('Need samples from at least two configurations, found %d' % len(order))
+		for t in order:
+			print('  %s' % t)
+		return 1
+
+	base = args.baseline if args.baseline else order[0]
+	if base not in configs:
+		print('Baseline "%s" not found. The configurations are:' % base)
+		for t in order:
+			print('  %s' % t)
+		return 1
+
+	rng = random.Random(args.seed)
+	bdata = { k: sorted(v) for k, v in configs[base].items() }
+
+	print('Metric: %s, baseline: %s, alpha %g, %d bootstrap resamples' % (args.metric, base, args.alpha, args.boot))
+	print('')
+
+	summary = []
+	for tag in order:
+		if tag == base:
+			continue
+		jobs = sorted(k for k in configs[tag] if k in bdata)
+		if not jobs:
+			continue
+		rows = []
+		for k in jobs:
+			a = bdata[k]
+			b = sorted(configs[tag][k])
+			u, p = mann_whitney(a, b)
+			lo, hi = bootstrap_p99_diff(a, b, args.boot, args.alpha, rng)
+			rows.append({ 'job': k, 'n': (len(a), len(b)), 'p': p, 'ci': (lo, hi),
+						  'med': (percentile(a, 0.5), percentile(b, 0.5)),
+						  'p99': (percentile(a, 0.99), percentile(b, 0.99)),
+						  'jitter': (percentile(a, 0.99) - percentile(a, 0.01), percentile(b, 0.99) - percentile(b, 0.01)),
+						  'max': (a[-1], b[-1]) })
+		for r, padj in zip(rows, holm([r['p'] for r in rows])):
+			r['padj'] = padj
+			sig = padj < args.alpha
+			r['verdict'] = 'better' if sig and r['ci'][1] < 0 else ('worse' if sig and r['ci'][0] > 0 else '-')
+
+		ratios = [r['p99'][1] / r['p99'][0] for r in rows if r['p99'][0] > 0]
+		jratios = [r['jitter'][1] / r['jitter'][0] for r in rows if r['jitter'][0] > 0]
+		summary.append({ 'tag': tag, 'rows': rows,
+						 'p99': sum(ratios) / len(ratios) if ratios else 1.0,
+						 'jitter': sum(jratios) / len(jratios) if jratios else 1.0,
+						 'better': sum(1 for r in rows if r['verdict'] == 'better'),
+						 'worse': sum(1 for r in rows if r['verdict'] == 'worse') })
+
+		if args.detail:
+			print('%s' % tag)
+			print('  %-18s %7s %7s %9s %9s %9s %9s %10s %19s  %s' % ('mode/frame/job', 'n base', 'n',
+					'med base', 'med', 'p99 base', 'p99', 'p (Holm)', 'p99 diff CI', 'verdict'))
+			for r in rows:
+				print('  %-18s %7d %7d %9d %9d %9d %9d %10.3g %9d..%-9d  %s' % ('%d/%d/%d' % r['job'],
+						r['n'][0], r['n'][1], r['med'][0], r['med'][1], r['p99'][0], r['p99'][1],
+						r['padj'], r['ci'][0], r['ci'][1], r['verdict']))
+			print('')
+
+	print('Ranking by mean %s %s relative to the baseline (lower is better):' %
+				('jitter (p99 - p1)' if args.rank == 'jitter' else 'p99', args.metric))
+	print('  %4s %8s %8s %6s %6s %5s  %s' % ('rank', 'jit/base', 'p99/base', 'better', 'worse', 'jobs', 'configuration'))
+	for i, s in enumerate(sorted(summary, key = lambda s: (s[args.rank], s['worse'] - s['better']))):
+		print('  %4d %8.3f %8.3f %6d %6d %5d  %s' % (i + 1, s['jitter'], s['p99'], s['better'], s['worse'],
+				len(s['rows']), s['tag']))
+	print('  %4s %8.3f %8.3f %6s %6s %5d  %s (baseline)' % ('', 1.0, 1.0, '', '', len(bdata), base))
+	return 0
+
+if __name__ == '__main__':
+	sys.exit(main())
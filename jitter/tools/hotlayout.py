@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#	hotlayout.py - generate a profile-guided layout of the jitter experiment's frame path
+#
+#	Copyright 2019 David Haworth
+#
+#	This file is part of Dave's determinism experiments.
+#
+#	The experiments are free software: you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation, either version 3 of the License, or
+#	(at your option) any later version.
+#
+#	The experiments are distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with Dave's determinism experiments.
+#	If not, see <http://www.gnu.org/licenses/>.
+#
+#	Usage:
+#		objdump -t bin/jitter.elf | hotlayout.py [--board pi-zero|pi3-arm64] [--min-frames PERCENT]
+#							[--ld FILE] [--objcopy FILE] logfile ...
+#
+#	Reads the symbol table of a profiling build (make PROFILE=1) in the format of objdump -t and the
+#	"P address calls frames position" lines that pf_Print() ("profile dump") writes to the console.
+#	If a log contains several dumps, the last one is used. make hotlayout PROFILE_LOG=<log> does this.
+#
+#	A function is hot if it ran in at least --min-frames percent of the profiled frames (default 50).
+#	The hot functions are ordered by their mean position in the frames, i.e. in the order in which the
+#	frame path reaches them, so that the path runs through the code from start to end. Everything else
+#	(results, commands, startup, exception handling) is cold and stays in .text.
+#
+#	--ld writes a linker script fragment (ld/fm-order.ld) that places the hot functions, followed by the
+#	hot data, in the page-aligned output section .fm_hot. --objcopy writes the objcopy options
+#	(ld/fm-order.objcopy) that rename each hot function's section from .text.<name> (-ffunction-sections)
+#	to .fm_hot.text.<n>, so that davroska's linker script doesn't take it into .text first.
+#	make FM_LAYOUT=2 uses both files.
+#
+#	The report shows the hot functions and the size of the hot code compared with the L1 instruction cache.
+#	Use make cachemap on the FM_LAYOUT=2 build to check the cache sets.
+#
+#	Only the python standard library is used.
+
+import sys
+import re
+import argparse
+
+from cachemap import boards, read_symbols
+
+pline = re.compile(r'^P\s+([0-9a-fA-F]+)\s+(\d+)\s+(\d+)\s+(\d+)\s*$')
+hline = re.compile(r'^Profile:\s+(\d+)\s+frames')
+
+def read_profile(f):
+	n_frames = 0
+	funcs = {}
+	for line in f:
+		m = hline.match(line)
+		if m:
+			n_frames = int(m.group(1))
+			funcs = {}
+			continue
+		m = pline.match(line)
+		if m:
+			addr, calls, frames, pos = m.groups()
+			funcs[int(addr, 16)] = { 'calls': int(calls), 'frames': int(frames), 'possum': int(pos) }
+	return n_frames, funcs
+
+def write_ld(path, hot):
+	with open(path, 'w') as f:
+		f.write('/*\tfm-order.ld - generated by tools/hotlayout.py. Do not edit.\n')
+		f.write(' *\n')
+		f.write(' *\tUsed together with davroska\'s linker script (make FM_LAYOUT=2). The hot functions, in the\n')
+		f.write(' *\torder in which the frame path runs them, followed by the hot data, each on a page boundary.\n')
+		f.write('*/\n')
+		f.write('SECTIONS\n{\n')
+		f.write('\t.fm_hot ALIGN(4096) :\n\t{\n')
+		f.write('\t\tfm_hot_text_start = .;\n')
+		for i, s in enumerate(hot):
+			f.write('\t\t*(.fm_hot.text.%04d)\t\t/* %s */\n' % (i, s['name']))
+		f.write('\t\tfm_hot_text_end = .;\n')
+		f.write('\t\t. = ALIGN(4096);\n')
+		f.write('\t\tfm_hot_data_start = .;\n')
+		f.write('\t\t*(.fm_hot.data)\n')
+		f.write('\t\tfm_hot_data_end = .;\n')
+		f.write('\t\t. = ALIGN(4096);\n')
+		f.write('\t}\n}\nINSERT AFTER .text;\n')
+
+def write_objcopy(path, hot):
+	with open(path, 'w') as f:
+		for i, s in enumerate(hot):
+			f.write('--rename-section .text.%s=.fm_hot.text.%04d\n' % (s['name'], i))
+
+def main():
+	ap = argparse.ArgumentParser(description = 'Generate a profile-guided layout of the frame path')
+	ap.add_argument('--board', default = 'pi3-arm64', choices = sorted(boards.keys()))
+	ap.add_argument('--min-frames', type = float, default = 50.0,
+					help = 'percentage of the frames in which a hot function runs (default 50)')
+	ap.add_argument('--ld', help = 'write the linker script fragment to this file')
+	ap.add_argument('--objcopy', help = 'write the objcopy options to this file')
+	ap.add_argument('logfile', nargs = '+', help = 'console capture with a "profile dump"')
+	args = ap.parse_args()
+
+	syms = [s for s in read_symbols(sys.stdin) if s['func'] and s['size'] > 0]
+	byaddr = {}
+	for s in syms:
+		byaddr.setdefault(s['addr'], s)
+
+	n_frames = 0
+	profile = {}
+	for name in args.logfile:
+		with open(name) as f:
+			n, funcs = read_profile(f)
+		n_frames += n
+		for addr, p in funcs.items():
+			q = profile.setdefault(addr, { 'calls': 0, 'frames': 0, 'possum': 0 })
+			for k in q:
+				q[k] += p[k]
+
+	if n_frames == 0:
+		sys.exit('No profile found (make PROFILE=1, then "profile on" and "profile dump")')
+
+	entries = []
+	unknown = 0
+	for addr, p in profile.items():
+		s = byaddr.get(addr)
+		if s is None:
+			unknown += 1
+			continue
+		entries.append(dict(s, **p))
+
+	threshold = n_frames * args.min_frames / 100.0
+	hot = sorted([e for e in entries if e['frames'] >= threshold],
+				key = lambda e: (e['possum'] / e['frames'], e['name']))
+
+	# A name can appear more than once (static functions); the section is renamed in every object
+	seen = set()
+	order = []
+	for e in hot:
+		if e['name'] not in seen:
+			seen.add(e['name'])
+			order.append(e)
+
+	size, ways, line = boards[args.board]['icache']
+	hot_size = sum(e['size'] for e in hot)
+	cold = [s for s in syms if s['name'] not in seen]
+
+	print('Profile: %d frames, %d functions (%d not in the symbol table)' % (n_frames, len(profile), unknown))
+	print('Hot functions (in at least %g%% of the frames), in layout order:' % args.min_frames)
+	print('  %-28s %6s %8s %8s %6s' % ('function', 'bytes', 'calls/fr', 'frames%', 'pos'))
+	for e in order:
+		print('  %-28s %6d %8.2f %8.1f %6.1f' % (e['name'], e['size'], e['calls'] / n_frames,
+					100.0 * e['frames'] / n_frames, e['possum'] / e['frames']))
+	print('Hot code: %d bytes, %d lines of %d bytes; L1 I-cache (%s): %d bytes' %
+				(hot_size, (hot_size + line - 1) // line, line, args.board, size))
+	print('Cold code: %d functions, %d bytes' % (len(cold), sum(s['size'] for s in cold)))
+
+	if args.ld:
+		write_ld(args.ld, order)
+	if args.objcopy:
+		write_objcopy(args.objcopy, order)
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+#	pwcet.py - probabilistic WCET estimation from the jitter experiment's sample dump
+#
+#	Copyright 2019 David Haworth
+#
+#	This file is part of Dave's determinism experiments.
+#
+#	The experiments are free software: you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation, either version 3 of the License, or
+#	(at your option) any later version.
+#
+#	The experiments are distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with Dave's determinism experiments.
+#	If not, see <http://www.gnu.org/licenses/>.
+#
+#	Usage:
+#		pwcet.py [--key job|frame] [--block N] [--min-blocks M] [--prob P ...] [--ns-per-tick X] [logfile ...]
+#
+#	Reads the "S round mode frame job latency runtime" lines that fm_PrintSamples() writes to the console.
+#	Only the runtime (job start to end) is used; the latency is from the job's release (see compare.py).
+#	The runtimes are grouped by job (default) or summed per frame execution. For each group the
+#	series is cut into blocks of N consecutive executions and the block maxima are fitted to
+#	a Gumbel distribution (maximum likelihood) and a GEV distribution (probability weighted moments).
+#	A fit needs at least M blocks (default 10). By default N is 20, reduced (to no less than 5) for a short
+#	series so that there are M blocks; a block of fewer than 20 executions is flagged because the maxima
+#	are then a poor model of the tail. Each job runs once per round, so a job series has one sample per round: for a
+#	proper analysis run the experiment for at least 200 rounds ("rounds 200").
+#	The pWCET is then reported at each exceedance probability, expressed per execution of
+#	the job or frame (i.e. per frame in which it runs).
+#
+#	Goodness of fit is reported as the Kolmogorov-Smirnov statistic D with its asymptotic p-value
+#	and the Anderson-Darling statistic A2. The lag-1 autocorrelation of the raw series is shown
+#	as a rough check of the independence assumption that EVT needs.
+#
+#	Only the python standard library is used.
+
+import sys
+import math
+import argparse
+
+def read_samples(files, key):
+	series = {}
+	frame_total = {}
+	for f in files:
+		for line in f:
+			w = line.split()
+			if len(w) != 7 or w[0] != 'S':
+				continue
+			rnd, mode, frame, job, runtime = int(w[1]), int(w[2]), int(w[3]), int(w[4]), int(w[6])
+			if key == 'job':
+				series.setdefault((mode, frame, job), []).append(runtime)
+			else:
+				k = (rnd, mode, frame)
+				if k not in frame_total:
+					frame_total[k] = 0
+				frame_total[k] += runtime
+	if key == 'frame':
+		for (rnd, mode, frame) in sorted(frame_total):
+			series.setdefault((mode, frame), []).append(frame_total[(rnd, mode, frame)])
+	return series
+
+#	The block size for a series of n samples: the requested size, or if none was given the largest size
+#	up to 20 that still gives min_blocks blocks. 0 if the series is too short for blocks of at least 5.
+#
+def block_size(n, requested, min_blocks):
+	if requested > 0:
+		return requested
+	b = min(20, n // min_blocks)
+	return b if b >= 5 else 0
+
+def block_maxima(x, b):
+	return [max(x[i:i+b]) for i in range(0, len(x) - b + 1, b)]
+
+def autocorr1(x):
+	n = len(x)
+	if n < 3:
+		return 0.0
+	m = sum(x) / n
+	v = sum((a - m) ** 2 for a in x)
+	if v == 0:
+		return 0.0
+	return sum((x[i] - m) * (x[i+1] - m) for i in range(n - 1)) / v
+
+#	Gumbel: F(x) = exp(-exp(-(x-mu)/beta))
+#
+def gumbel_fit(x):
+	n = len(x)
+	m = sum(x) / n
+	s = math.sqrt(sum((a - m) ** 2 for a in x) / (n - 1))
+	if s == 0:
+		return (m, 0.0)
+	beta = s * math.sqrt(6) / math.pi
+	x0 = min(x)
+	for i in range(200):
+		w = [math.exp(-(a - x0) / beta) for a in x]
+		sw = sum(w)
+		nb = m - sum(a * wi for a, wi in zip(x, w)) / sw
+		if nb <= 0:
+			break
+		if abs(nb - beta) < 1e-9 * beta:
+			beta = nb
+			break
+		beta = nb
+	w = [math.exp(-(a - x0) / beta) for a in x]
+	mu = x0 - beta * math.log(sum(w) / n)
+	return (mu, beta)
+
+def gumbel_cdf(p, x):
+	mu, beta = p
+	if beta == 0:
+		return 1.0 if x >= mu else 0.0
+	return math.exp(-math.exp(-(x - mu) / beta))
+
+#	Quantiles are given the exceedance probability e = 1 - F(x) to keep precision in the far tail
+#
+def gumbel_quantile(p, e):
+	mu, beta = p
+	return mu - beta * math.log(-math.log1p(-e))
+
+#	GEV in Hosking's parametrisation (k = -shape): F(x) = exp(-(1 - k(x-xi)/alpha)^(1/k))
+#
+def gev_fit(x):
+	xs = sorted(x)
+	n = len(xs)
+	b0 = sum(xs) / n
+	b1 = sum(i * xs[i] for i in range(n)) / (n * (n - 1))
+	b2 = sum(i * (i - 1) * xs[i] for i in range(n)) / (n * (n - 1) * (n - 2))
+	if (3 * b2 - b0) == 0 or (2 * b1 - b0) == 0:
+		return None
+	c = (2 * b1 - b0) / (3 * b2 - b0) - math.log(2) / math.log(3)
+	k = 7.8590 * c + 2.9554 * c * c
+	if abs(k) < 1e-6:
+		mu, beta = gumbel_fit(x)
+		return (mu, beta, 0.0)
+	g = math.gamma(1 + k)
+	alpha = (2 * b1 - b0) * k / (g * (1 - 2 ** (-k)))
+	xi = b0 + alpha * (g - 1) / k
+	return (xi, alpha, k)
+
+def gev_cdf(p, x):
+	xi, alpha, k = p
+	if k == 0:
+		return gumbel_cdf((xi, alpha), x)
+	y = 1 - k * (x - xi) / alpha
+	if y <= 0:
+		return 1.0 if k > 0 else 0.0
+	return math.exp(-y ** (1 / k))
+
+def gev_quantile(p, e):
+	xi, alpha, k = p
+	if k == 0:
+		return gumbel_quantile((xi, alpha), e)
+	return xi + alpha * (1 - (-math.log1p(-e)) ** k) / k
+
+def ks_test(x, cdf):
+	xs = sorted(x)
+	n = len(xs)
+	d = 0.0
+	for i, a in enumerate(xs):
+		f = cdf(a)
+		d = max(d, f - i / n, (i + 1) / n - f)
+	lam = (math.sqrt(n) + 0.12 + 0.11 / math.sqrt(n)) * d
+	pv = 0.0
+	for j in range(1, 101):
+		pv += 2 * (-1) ** (j - 1) * math.exp(-2 * j * j * lam * lam)
+	return d, min(max(pv, 0.0), 1.0)
+
+def ad_test(x, cdf):
+	xs = sorted(x)
+	n = len(xs)
+	eps = 1e-300
+	s = 0.0
+	for i in range(n):
+		fi = min(max(cdf(xs[i]), eps), 1 - 1e-16)
+		fr = min(max(cdf(xs[n - 1 - i]), eps), 1 - 1e-16)
+		s += (2 * i + 1) * (math.log(fi) + math.log(1 - fr))
+	return -n - s / n
+
+def main():
+	ap = argparse.ArgumentParser(description='pWCET estimation from jitter sample dumps')
+	ap.add_argument('--key', choices=['job', 'frame'], default='job',
+					help='analyse each job, or the summed runtime of each frame execution')
+	ap.add_argument('--block', type=int, default=0,
+					help='block size for the block maxima (default: 20, or smaller for a short series)')
+	ap.add_argument('--min-blocks', type=int, default=10, help='fewest blocks for a fit')
+	ap.add_argument('--prob', type=float, nargs='+', default=[1e-3, 1e-6, 1e-9, 1e-12],
+					help='exceedance probabilities per execution')
+	ap.add_argument('--ns-per-tick', type=float, default=0.0,
+					help='if given, also print the pWCET in microseconds')
+	ap.add_argument('files', nargs='*', type=argparse.FileType('r'))
+	args = ap.parse_args()
+
+	series = read_samples(args.files or [sys.stdin], args.key)
+	if not series:
+		print('No samples found')
+		return 1
+
+	for k in sorted(series):
+		x = series[k]
+		name = ('mode %d frame %d job %d' % k) if args.key == 'job' else ('mode %d frame %d' % k)
+		b = block_size(len(x), args.block, args.min_blocks)
+		if b == 0:
+			print('%s: %d samples, observed max %d: too few for a fit (need at least %d; raise "rounds")\n'
+					% (name, len(x), max(x), 5 * args.min_blocks))
+			continue
+		bm = block_maxima(x, b)
+		print('%s: %d samples, observed max %d, %d blocks of %d, lag-1 autocorrelation %.3f'
+				% (name, len(x), max(x), len(bm), b, autocorr1(x)))
+		if len(bm) < args.min_blocks:
+			print('  too few blocks for a fit (need at least %d)\n' % args.min_blocks)
+			continue
+		if b < 20:
+			print('  note: blocks of %d executions; the estimate is rough (raise "rounds" for blocks of 20)' % b)
+
+		gu = gumbel_fit(bm)
+		gv = gev_fit(bm)
+		fits = [('Gumbel', gu, lambda v: gumbel_cdf(gu, v), lambda e: gumbel_quantile(gu, e))]
+		if gv is not None:
+			fits.append(('GEV', gv, lambda v: gev_cdf(gv, v), lambda e: gev_quantile(gv, e)))
+
+		for fname, par, cdf, qf in fits:
+			d, pv = ks_test(bm, cdf)
+			a2 = ad_test(bm, cdf)
+			print('  %-6s params %s  KS D=%.4f p=%.3f  AD A2=%.3f'
+					% (fname, ' '.join('%.4g' % v for v in par), d, pv, a2))
+			for p in args.prob:
+				# Exceedance per execution ==> exceedance per block of B executions
+				pb = -math.expm1(b * math.log1p(-p))
+				v = qf(pb)
+				if args.ns_per_tick > 0:
+					print('    pWCET(%g) = %.0f ticks (%.3f us)' % (p, v, v * args.ns_per_tick / 1000))
+				else:
+					print('    pWCET(%g) = %.0f ticks' % (p, v))
+			if fname == 'GEV' and par[2] > 0:
+				print('    note: GEV shape indicates a bounded (Weibull) tail, upper bound %.0f ticks'
+						% (par[0] + par[1] / par[2]))
+		print('')
+	return 0
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+#	trace2json.py - convert the jitter experiment's event trace to Chrome trace (Perfetto) JSON
+#
+#	Copyright 2019 David Haworth
+#
+#	This file is part of Dave's determinism experiments.
+#
+#	The experiments are free software: you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation, either version 3 of the License, or
+#	(at your option) any later version.
+#
+#	The experiments are distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with Dave's determinism experiments.
+#	If not, see <http://www.gnu.org/licenses/>.
+#
+#	Usage:
+#		trace2json.py [--ticks-per-us N] [--task ID=NAME ...] [--around-overrun N] [logfile] > trace.json
+#
+#	Reads the "T time core type mode frame job task" lines that fm_PrintTrace() ("trace dump") writes
+#	to the console and writes a JSON file that can be opened in https://ui.perfetto.dev or chrome://tracing.
+#
+#	Each core is a process. Within a core there is one track for the frames (FrameStart to the next
+#	FrameStart), one for the frame manager's own activity (FrameStart and FrameEnd tasks, cache
+#	maintenance), one for the timer ticks, one for the instrumented ISRs and one for each task. Overruns, budget overruns and mode
+#	switches are shown as global instant events, so they're visible at any zoom level.
+#
+#	--isr ID=NAME names an ISR (the order of fm_AddIsr() calls: 0=Timer 1=Uart 2=Budget).
+#	--around-overrun N keeps only the events within N frames of an overrun.
+#
+#	Only the python standard library is used.
+
+import sys
+import re
+import json
+import argparse
+
+TID_FRAMES	= 1
+TID_FM		= 2
+TID_TICKS	= 3
+TID_ISRS	= 4
+TID_TASK0	= 10
+
+traceline = re.compile(r'^T (\d+) (\d+) (\S) (\d+) (\d+) (\d+) (-?\d+)\s*$')
+
+def read_trace(f):
+	events = []
+	for line in f:
+		m = traceline.match(line)
+		if m:
+			t, core, ty, mode, frame, job, task = m.groups()
+			events.append({ 't': int(t), 'core': int(core), 'type': ty, 'mode': int(mode),
+							'frame': int(frame), 'job': int(job), 'task': int(task) })
+	return events
+
+def select_around_overruns(events, nframes):
+	# Index of each FrameStart; keep the events between the FrameStarts N frames before and after each overrun
+	starts = [i for i, e in enumerate(events) if e['type'] == 'F']
+	keep = [False] * len(events)
+	for i, e in enumerate(events):
+		if e['type'] == 'O':
+			before = [s for s in starts if s <= i]
+			after = [s for s in starts if s > i]
+			lo = before[-(nframes + 1)] if len(before) > nframes else 0
+			hi = after[nframes] if len(after) > nframes else len(events)
+			for k in range(lo, hi):
+				keep[k] = True
+	return [e for k, e in zip(keep, events) if k]
+
+def convert(events, ticks_per_us, task_names, isr_names):
+	out = []
+	threads = set()
+	open_jobs = {}
+	open_frame = {}
+	open_fm = {}
+	open_cache = {}
+	open_isrs = {}
+	where = { 0: 'none', 1: 'round', 2: 'start', 3: 'end' }
+
+	def us(t):
+		return t / ticks_per_us
+
+	def thread(core, tid, name):
+		if (core, tid) not in threads:
+			threads.add((core, tid))
+			out.append({ 'ph': 'M', 'name': 'thread_name', 'pid': core, 'tid': tid, 'args': { 'name': name } })
+			out.append({ 'ph': 'M', 'name': 'thread_sort_index', 'pid': core, 'tid': tid, 'args': { 'sort_index': tid } })
+
+	def span(core, tid, name, t0, t1, args):
+		out.append({ 'ph': 'X', 'name': name, 'pid': core, 'tid': tid, 'ts': us(t0), 'dur': us(t1 - t0), 'args': args })
+
+	def taskname(task):
+		return task_names.get(task, 'task %d' % task)
+
+	cores = sorted(set(e['core'] for e in events))
+	for c in cores:
+		out.append({ 'ph': 'M', 'name': 'process_name', 'pid': c, 'args': { 'name': 'core %d' % c } })
+
+	for e in events:
+		c = e['core']
+		t = e['t']
+		ty = e['type']
+		args = { 'mode': e['mode'], 'frame': e['frame'] }
+
+		if ty == 'K':
+			thread(c, TID_TICKS, 'timer')
+			out.append({ 'ph': 'i', 's': 't', 'name': 'tick', 'pid': c, 'tid': TID_TICKS, 'ts': us(t), 'args': args })
+
+		elif ty == 'F':
+			thread(c, TID_FRAMES, 'frames')
+			thread(c, TID_FM, 'frame manager')
+			if c in open_frame:
+				f0, a0 = open_frame[c]
+				span(c, TID_FRAMES, 'frame %d' % a0['frame'], f0, t, a0)
+			open_frame[c] = (t, args)
+			open_fm[c] = (t, 'FrameStart', args)
+
+		elif ty == 'S':
+			tid = TID_TASK0 + e['task']
+			thread(c, tid, taskname(e['task']))
+			if c in open_fm:
+				t0, name, a0 = open_fm.pop(c)
+				span(c, TID_FM, name, t0, t, a0)
+			open_jobs[(c, e['task'])] = (t, dict(args, job = e['job']))
+
+		elif ty == 'E':
+			key = (c, e['task'])
+			if key in open_jobs:
+				t0, a0 = open_jobs.pop(key)
+				span(c, TID_TASK0 + e['task'], taskname(e['task']), t0, t, a0)
+
+		elif ty == 'X':
+			thread(c, TID_FM, 'frame manager')
+			open_fm[c] = (t, 'FrameEnd', args)
+
+		elif ty == 'x':
+			if c in open_fm:
+				t0, name, a0 = open_fm.pop(c)
+				span(c, TID_FM, name, t0, t, a0)
+
+		elif ty == 'C':
+			thread(c, TID_FM, 'frame manager')
+			open_cache[c] = (t, dict(args, where = where.get(e['job'], e['job'])))
+
+		elif ty == 'c':
+			if c in open_cache:
+				t0, a0 = open_cache.pop(c)
+				span(c, TID_FM, 'cache maintenance', t0, t, a0)
+
+		elif ty == 'O':
+			out.append({ 'ph': 'i', 's': 'g', 'name': 'overrun', 'pid': c, 'tid': TID_FRAMES, 'ts': us(t),
+						 'args': dict(args, job = e['job']) })
+
+		elif ty == 'I':
+			thread(c, TID_ISRS, 'interrupts')
+			open_isrs.setdefault(c, []).append((t, e['job'], args))
+
+		elif ty == 'i':
+			if open_isrs.get(c):
+				t0, isr, a0 = open_isrs[c].pop()
+				span(c, TID_ISRS, isr_names.get(isr, 'isr %d' % isr), t0, t, a0)
+
+		elif ty == 'B':
+			out.append({ 'ph': 'i', 's': 'g', 'name': 'budget overrun', 'pid': c, 'tid': TID_FRAMES, 'ts': us(t),
+						 'args': dict(args, job = e['job'], task = taskname(e['task'])) })
+
+		elif ty == 'M':
+			out.append({ 'ph': 'i', 's': 'g', 'name': 'mode switch', 'pid': c, 'tid': TID_FRAMES, 'ts': us(t),
+						 'args': args })
+
+	# Unfinished spans at the end of the trace are dropped.
+	return out
+
+def main():
+	ap = argparse.ArgumentParser(description = 'Convert a jitter event trace to Chrome trace JSON')
+	ap.add_argument('--ticks-per-us', type = float, default = 250.0, help = 'timer ticks per microsecond')
+	ap.add_argument('--task', action = 'append', default = [], metavar = 'ID=NAME', help = 'name a task track')
+	ap.add_argument('--isr', action = 'append', default = [], metavar = 'ID=NAME', help = 'name an ISR')
+	ap.add_argument('--around-overrun', type = int, default = None, metavar = 'N',
+					help = 'keep only the events within N frames of an overrun')
+	ap.add_argument('logfile', nargs = '?', help = 'console capture (default stdin)')
+	args = ap.parse_args()
+
+	task_names = {}
+	for t in args.task:
+		i, n = t.split('=', 1)
+		task_names[int(i)] = n
+
+	isr_names = { 0: 'Timer', 1: 'Uart', 2: 'Budget' }
+	for t in args.isr:
+		i, n = t.split('=', 1)
+		isr_names[int(i)] = n
+
+	if args.logfile:
+		with open(args.logfile) as f:
+			events = read_trace(f)
+	else:
+		events = read_trace(sys.stdin)
+
+	if not events:
+		sys.stderr.write('No trace events found\n')
+		sys.exit(1)
+
+	if args.around_overrun is not None:
+		events = select_around_overruns(events, args.around_overrun)
+		if not events:
+			sys.stderr.write('No overruns in the trace\n')
+			sys.exit(1)
+
+	json.dump({ 'traceEvents': convert(events, args.ticks_per_us, task_names, isr_names), 'displayTimeUnit': 'ns' },
+				sys.stdout, separators = (',', ':'))
+	sys.stdout.write('\n')
+
+if __name__ == '__main__':
+	main()